@@ -0,0 +1,74 @@
+#include "aot.h"
+
+// the runtime side of the translated code. The translator itself is clip8-aot.c
+
+void setAotProgram(machine_t *m, const aot_program_t *program) {
+    m->aot = program;
+    if (program != NULL) aotSync(m, 0, m->memoryEnd + 1);
+}
+
+// whether the instruction at an even address is still what was translated
+static int aotUnchanged(const machine_t *m, int address) {
+    const aot_program_t *p = m->aot;
+    for (int i = address; i < address + 2; i++) {
+        int offset = i - PROGRAM_START;
+        uint8_t original = offset >= 0 && (size_t)offset < p->romSize ? p->rom[offset] : 0;
+        if (m->ram[i] != original) return 0;
+    }
+    return 1;
+}
+
+void aotSync(machine_t *m, int from, int to) {
+    const aot_program_t *p = m->aot;
+    if (p == NULL) return;
+    if (from < 0) from = 0;
+    if (to > m->memoryEnd + 1) to = m->memoryEnd + 1;
+
+    // start from the first block touched, it may begin before from
+    int address = from & ~1;
+    if (address < to && p->entries[address >> 1].code != NULL) address = p->entries[address >> 1].block;
+
+    while (address < to) {
+        const aot_entry_t *entry = &p->entries[address >> 1];
+        if (entry->code == NULL) {
+            address += 2;
+            continue;
+        }
+        // the whole block goes stale if any of its instructions changed, and comes back if they're all restored
+        uint16_t block = entry->block;
+        int stale = 0;
+        for (; address < RAM_SIZE && p->entries[address >> 1].code != NULL && p->entries[address >> 1].block == block;
+             address += 2) {
+            if (!aotUnchanged(m, address)) stale = 1;
+        }
+        m->aotStale[block >> 1] = stale;
+    }
+}
+
+int runCyclesAot(machine_t *m, int count) {
+    const aot_program_t *p = m->aot;
+    if (p == NULL || p->quirks != m->quirks || p->wrapSprites != m->wrapSprites) {
+        return runCyclesSwitch(m, count); // translated for another machine
+    }
+
+    int budget = count;
+    while (budget > 0) {
+        uint16_t pc = m->PC &= m->memoryEnd;
+        if (!(pc & 1)) {
+            if (m->decodeCache[pc >> 1].idleLength) {
+                budget -= idleFastForward(m, pc, budget);
+                if (budget == 0) break;
+            }
+            const aot_entry_t *entry = &p->entries[pc >> 1];
+            if (entry->code != NULL && !m->aotStale[entry->block >> 1]) {
+                int before = budget;
+                m->PC = entry->code(m, pc, &budget);
+                m->aotNativeInstructions += before - budget;
+                continue;
+            }
+        }
+        budget--;
+        if (clockCycle(m)) return count - budget;
+    }
+    return count;
+}
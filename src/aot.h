@@ -0,0 +1,41 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "chip8.h"
+
+// ##########  AHEAD-OF-TIME TRANSLATION  ##########
+// clip8-aot turns a rom into C: every basic block it can reach from 0x200 becomes a function, with the
+// V registers and I in locals. The generated file defines one aot_program_t, and linked with the
+// frontend (see clip8_add_rom() in CMakeLists.txt) it's a native executable for that rom, running on
+// CORE_AOT. Whatever wasn't translated (computed jump targets it couldn't follow, code outside the rom,
+// blocks the rom has rewritten) runs on the interpreter instead
+
+// runs the block containing pc, from pc, until it leaves the block or the budget runs out.
+// Takes the instructions it ran off *budget and returns the PC to continue from
+typedef uint16_t (*aot_block_fn_t)(machine_t *m, uint16_t pc, int *budget);
+
+// one entry per even address
+typedef struct {
+    aot_block_fn_t code;    // NULL if nothing was translated here
+    uint16_t       block;   // address of the first instruction of the block this one is in
+} aot_entry_t;
+
+typedef struct aot_program {
+    const char    *name;            // the rom it was translated from
+    const uint8_t *rom;             // its image, loaded at 0x200 like loadRom() does
+    size_t         romSize;
+    quirks_t       quirks;          // what the code was translated for. Run with other quirks, the
+    int            wrapSprites;     // interpreter runs everything instead
+    const aot_entry_t *entries;     // RAM_SIZE / 2 of them, the dispatch table
+} aot_program_t;
+
+// gives the machine a translated rom to run on CORE_AOT. It still has to be loaded like any other
+void setAotProgram(machine_t *m, const aot_program_t *program);
+
+// rechecks the blocks overlapping [from, to) against the translated rom image, after RAM was written
+void aotSync(machine_t *m, int from, int to);
+
+// the AOT core: runs translated blocks, and clockCycle() for everything else
+int runCyclesAot(machine_t *m, int count);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "audio.h"
+
+// ##########  BEEPER  ##########
+// see audio.h
+
+beeper_t *createBeeper(int sampleRate, int bufferFrames) {
+    beeper_t *b = calloc(1, sizeof(beeper_t));
+    if (b == NULL) return NULL;
+    b->sampleRate = sampleRate;
+    b->bufferFrames = bufferFrames;
+    memset(b->pattern, 0xF0, sizeof(b->pattern)); // what a machine starts with
+    b->pitch = DEFAULT_PITCH;
+    b->waveSequence = UINT32_MAX;                // so the first fill builds the wave
+    return b;
+}
+
+void destroyBeeper(beeper_t *b) {
+    free(b);
+}
+
+double audioPlaybackRate(uint8_t pitch) {
+    return 4000.0 * pow(2.0, (pitch - 64) / 48.0);
+}
+
+void beeperTick(beeper_t *b, const machine_t *m) {
+    if (m->pitch != b->pitch || memcmp(m->audioPattern, b->pattern, AUDIO_PATTERN_SIZE) != 0) {
+        uint32_t sequence = atomic_load_explicit(&b->sequence, memory_order_relaxed);
+        atomic_store_explicit(&b->sequence, sequence + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy(b->pattern, m->audioPattern, AUDIO_PATTERN_SIZE);
+        b->pitch = m->pitch;
+        atomic_store_explicit(&b->sequence, sequence + 2, memory_order_release);
+    }
+    int on = m->ST > 0;
+    if (on != atomic_load_explicit(&b->on, memory_order_relaxed)) {
+        atomic_store_explicit(&b->switchedNs, nanoTime(), memory_order_relaxed);
+        atomic_store_explicit(&b->on, on, memory_order_release);
+    }
+}
+
+// one loop of the pattern at its rate, from the latest pattern and pitch. Keeps the old wave if they're being written
+static void buildWave(beeper_t *b) {
+    uint32_t sequence = atomic_load_explicit(&b->sequence, memory_order_acquire);
+    if (sequence == b->waveSequence || (sequence & 1)) return;
+    uint8_t pattern[AUDIO_PATTERN_SIZE];
+    memcpy(pattern, b->pattern, AUDIO_PATTERN_SIZE);
+    uint8_t pitch = b->pitch;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&b->sequence, memory_order_relaxed) != sequence) return;
+
+    double rate = audioPlaybackRate(pitch);
+    int length = (int)(AUDIO_PATTERN_BITS * (double)b->sampleRate / rate + 0.5);
+    if (length > AUDIO_WAVE_MAX) length = AUDIO_WAVE_MAX;
+    if (length < 1) length = 1;
+    for (int i = 0; i < length; i++) {
+        int bit = (int)(i * rate / b->sampleRate) % AUDIO_PATTERN_BITS;
+        b->wave[i] = pattern[bit >> 3] >> (7 - (bit & 7)) & 1 ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+    }
+    b->waveLength = length;
+    b->phase %= length;
+    b->waveSequence = sequence;
+}
+
+void beeperFill(beeper_t *b, int16_t *out, unsigned frames) {
+    uint64_t now = nanoTime();
+    uint64_t bufferNs = (uint64_t)b->bufferFrames * 1000000000ULL / b->sampleRate;
+    if (b->lastFillNs && now - b->lastFillNs > bufferNs + bufferNs / 2) b->underruns++;
+    b->lastFillNs = now;
+    b->fills++;
+
+    buildWave(b);
+    int on = atomic_load_explicit(&b->on, memory_order_acquire);
+    if (on != b->playing) {
+        uint64_t latency = now - atomic_load_explicit(&b->switchedNs, memory_order_relaxed) + bufferNs;
+        b->switches++;
+        b->latencyTotalNs += latency;
+        if (latency > b->latencyWorstNs) b->latencyWorstNs = latency;
+        b->playing = on;
+        b->phase = 0; // every beep starts the pattern from its first bit
+    }
+
+    if (!on) {
+        memset(out, 0, frames * sizeof(int16_t));
+        return;
+    }
+    for (unsigned i = 0; i < frames; i++) {
+        out[i] = b->wave[b->phase];
+        if (++b->phase == b->waveLength) b->phase = 0;
+    }
+}
+
+void printBeeperStats(const beeper_t *b) {
+    if (b->fills == 0) return;
+    printf("audio: %d-frame buffers (%.1f ms), %llu underruns in %llu fills, %llu beeps started or stopped",
+           b->bufferFrames, b->bufferFrames * 1e3 / b->sampleRate, (unsigned long long)b->underruns,
+           (unsigned long long)b->fills, (unsigned long long)b->switches);
+    if (b->switches) {
+        printf(", %.1f ms average latency (worst %.1f ms)", b->latencyTotalNs / 1e6 / b->switches, b->latencyWorstNs / 1e6);
+    }
+    printf("\n");
+}
@@ -0,0 +1,61 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdatomic.h>
+#include "chip8.h"
+
+// ##########  BEEPER  ##########
+// the sound timer as sound: while ST > 0 the machine's audio pattern plays, 128 bits looped at the rate its pitch
+// says (XO-CHIP's F002 and Fx3A, a 500 Hz square wave for everything else). The machine's thread hands over ST,
+// the pattern and the pitch once a tick with beeperTick(), and never waits. The audio thread pulls samples with
+// beeperFill() a buffer at a time, copying them from a waveform built once per pattern and pitch, so with small
+// buffers a change of ST is heard within a frame. The pattern and pitch go across under a seqlock (like shm.h's),
+// the audio thread just builds from the previous ones if it catches them halfway
+
+#define AUDIO_SAMPLE_RATE    44100
+#define AUDIO_DEFAULT_BUFFER 512        // frames per callback, 11.6 ms
+#define AUDIO_PATTERN_BITS   (AUDIO_PATTERN_SIZE * 8)
+#define AUDIO_WAVE_MAX       4096       // samples in one loop of the pattern, the lowest pitch needs ~3560
+#define AUDIO_AMPLITUDE      6000       // of the 16-bit samples, a beep shouldn't be deafening
+
+typedef struct {
+    int sampleRate, bufferFrames;
+
+    // the machine's side
+    _Atomic uint32_t sequence;          // odd while pattern and pitch are being written
+    uint8_t  pattern[AUDIO_PATTERN_SIZE];
+    uint8_t  pitch;
+    _Atomic int      on;                // ST > 0
+    _Atomic uint64_t switchedNs;        // nanoTime() when on last changed, for the latency
+
+    // the audio thread's side
+    int16_t  wave[AUDIO_WAVE_MAX];
+    int      waveLength;
+    uint32_t waveSequence;              // the sequence wave was built from
+    int      phase;                     // where in wave the next sample comes from
+    int      playing;
+    uint64_t lastFillNs;
+
+    // counters, written by the audio thread and read when it's stopped
+    uint64_t fills, underruns;          // underruns: callbacks that came later than the buffer before could last
+    uint64_t switches, latencyTotalNs, latencyWorstNs; // ST going on or off until its first buffer is queued, plus
+                                                       // the buffer's length, it plays after the one before it
+} beeper_t;
+
+// a beeper that's quiet until the first tick. NULL if it can't be allocated
+beeper_t *createBeeper(int sampleRate, int bufferFrames);
+void destroyBeeper(beeper_t *b);
+
+// the machine's thread, once a tick: whether it sounds, and the pattern and pitch if they changed
+void beeperTick(beeper_t *b, const machine_t *m);
+
+// the audio thread: the next frames mono samples
+void beeperFill(beeper_t *b, int16_t *out, unsigned frames);
+
+// XO-CHIP's playback rate for a pitch, in pattern bits per second
+double audioPlaybackRate(uint8_t pitch);
+
+// prints the latency and underrun counters
+void printBeeperStats(const beeper_t *b);
+
+#endif
@@ -0,0 +1,155 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "batch.h"
+
+// each worker owns a deque of job indexes: it pops its own from the bottom, and when it runs
+// dry it steals from the top of the others. Jobs never create more jobs, so once every deque
+// is empty the batch is done. Jobs are whole rom runs, so a lock per deque costs nothing.
+typedef struct {
+    pthread_mutex_t lock;
+    int *jobs;
+    int  top, bottom;           // [top, bottom) are still waiting
+} job_deque_t;
+
+typedef struct batch batch_t;
+
+typedef struct {
+    batch_t  *batch;
+    int       index;
+    uint64_t  steals;
+    int       ran;              // got a machine and took jobs
+    pthread_t thread;
+} worker_t;
+
+struct batch {
+    batch_job_t          *jobs;
+    const batch_config_t *config;
+    job_deque_t          *deques;
+    worker_t             *workers;
+    int                   threads;
+};
+
+static int popBottom(job_deque_t *q) {
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->bottom > q->top) job = q->jobs[--q->bottom];
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static int stealTop(job_deque_t *q) {
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->bottom > q->top) job = q->jobs[q->top++];
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static void runJob(machine_t *m, batch_job_t *job, const batch_config_t *config) {
+    resetMachine(m);
+    if (loadRomImage(m, job->rom, job->romSize)) {
+        job->failed = 1;
+        return;
+    }
+    job->halted = runUnpaced(m, config->maxCycles, config->maxFrames, &job->cycles, &job->frames) != 0;
+    job->hash = hashFrameBuffer(m);
+}
+
+static void *workerMain(void *arg) {
+    worker_t *self = arg;
+    batch_t *batch = self->batch;
+
+    // one machine per worker, reset between jobs
+    machine_t *m = createMachine(batch->config->core);
+    if (m == NULL) return NULL; // the other workers will steal this one's jobs
+    setQuirks(m, batch->config->quirks, batch->config->wrapSprites);
+    m->seed = batch->config->seed;
+    m->skipIdle = batch->config->skipIdle;
+    self->ran = 1;
+
+    for (;;) {
+        int job = popBottom(&batch->deques[self->index]);
+        // own queue is empty: go round the others, starting with the next one
+        for (int k = 1; job < 0 && k < batch->threads; k++) {
+            job = stealTop(&batch->deques[(self->index + k) % batch->threads]);
+            if (job >= 0) self->steals++;
+        }
+        if (job < 0) break;
+        runJob(m, &batch->jobs[job], batch->config);
+    }
+
+    destroyMachine(m);
+    return NULL;
+}
+
+int onlineCpus() {
+#ifdef _SC_NPROCESSORS_ONLN
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+#else
+    return 1;
+#endif
+}
+
+int runBatch(batch_job_t *jobs, int jobCount, const batch_config_t *config, batch_stats_t *stats) {
+    batch_t batch = { .jobs = jobs, .config = config };
+    batch.threads = config->threads > 0 ? config->threads : onlineCpus();
+    if (batch.threads > jobCount) batch.threads = jobCount > 0 ? jobCount : 1;
+
+    batch.deques  = calloc(batch.threads, sizeof(job_deque_t));
+    batch.workers = calloc(batch.threads, sizeof(worker_t));
+    int *slots    = malloc(sizeof(int) * (jobCount > 0 ? jobCount : 1));
+    if (batch.deques == NULL || batch.workers == NULL || slots == NULL) {
+        free(batch.deques); free(batch.workers); free(slots);
+        return -1;
+    }
+
+    // deal the jobs out in contiguous chunks, stealing evens out whatever imbalance is left
+    for (int t = 0; t < batch.threads; t++) {
+        job_deque_t *q = &batch.deques[t];
+        int first = (int)((int64_t)jobCount * t / batch.threads);
+        int last  = (int)((int64_t)jobCount * (t + 1) / batch.threads);
+        pthread_mutex_init(&q->lock, NULL);
+        q->jobs = &slots[first];
+        q->top = 0;
+        q->bottom = last - first;
+        // popped from the bottom, so store them backwards to run each chunk in order
+        for (int j = first; j < last; j++) q->jobs[last - 1 - j] = j;
+    }
+
+    uint64_t start = nanoTime();
+    int started = 0;
+    for (int t = 0; t < batch.threads; t++) {
+        batch.workers[t].batch = &batch;
+        batch.workers[t].index = t;
+        if (pthread_create(&batch.workers[t].thread, NULL, workerMain, &batch.workers[t]) != 0) break;
+        started++;
+    }
+    if (started == 0) { // not even one thread, run everything here. It steals from every deque like any worker
+        batch.workers[0].batch = &batch;
+        workerMain(&batch.workers[0]);
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(batch.workers[t].thread, NULL);
+    }
+    // whatever is still queued, nobody was alive to run: every worker failed to start or to get a machine
+    for (int t = 0; t < batch.threads; t++) {
+        for (int job; (job = stealTop(&batch.deques[t])) >= 0; ) jobs[job].failed = 1;
+    }
+
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(*stats));
+        stats->elapsedNs = nanoTime() - start;
+        for (int t = 0; t < batch.threads; t++) {
+            stats->threads += batch.workers[t].ran;
+            stats->steals += batch.workers[t].steals;
+        }
+        for (int j = 0; j < jobCount; j++) stats->totalCycles += jobs[j].cycles;
+    }
+
+    for (int t = 0; t < batch.threads; t++) pthread_mutex_destroy(&batch.deques[t].lock);
+    free(batch.deques);
+    free(batch.workers);
+    free(slots);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "chip8.h"
+
+// ##########  BATCH RUNNER  ##########
+// runs many headless machines in parallel, one job per machine run, on a work-stealing thread pool
+
+// one run of a rom. The runner fills in the results
+typedef struct {
+    const char    *name;        // for printing
+    const uint8_t *rom;         // rom image, shared between jobs, never written
+    size_t         romSize;
+    int            instance;    // which copy of the rom this is
+
+    uint64_t cycles, frames;    // results
+    uint64_t hash;
+    int      halted;
+    int      failed;            // the rom couldn't even be loaded
+} batch_job_t;
+
+typedef struct {
+    int      threads;           // worker threads, 0 = one per online CPU
+    core_t   core;
+    quirks_t quirks;
+    int      wrapSprites;
+    uint64_t seed;              // every job starts RND from the same seed
+    int      skipIdle;          // fast-forward idle loops, see idleFastForward()
+    uint64_t maxCycles;         // per job, same meaning as in runUnpaced()
+    uint64_t maxFrames;
+} batch_config_t;
+
+typedef struct {
+    int      threads;           // how many actually ran
+    uint64_t steals;            // jobs taken from another worker's queue
+    uint64_t totalCycles;
+    uint64_t elapsedNs;
+} batch_stats_t;
+
+// runs every job and fills in its results. -1 if the workers couldn't be started
+int runBatch(batch_job_t *jobs, int jobCount, const batch_config_t *config, batch_stats_t *stats);
+
+// number of online CPUs, at least 1
+int onlineCpus();
+
+#endif
@@ -0,0 +1,367 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture.h"
+
+// ##########  VIDEO CAPTURE  ##########
+// see capture.h. The ring's head is only written by the emulator and its tail by the encoder, each publishing
+// with a release store what the other reads with an acquire load, so neither side ever takes a lock
+
+#define ENCODER_POLL_NS 2000000         // how long the encoder sleeps when the ring is empty
+#define GIF_MIN_DELAY 2                 // centiseconds. Browsers show shorter frames for 1/10 s instead
+
+// what the window shows for off, plane 1, plane 2 and both
+static const uint8_t shades[4] = { 0x00, 0xFF, 0x80, 0xC0 };
+
+static uint32_t crcTable[256];
+
+static void sleepNs(long ns) {
+    struct timespec t = { 0, ns };
+    nanosleep(&t, NULL);
+}
+
+
+// ##########  PACKING  ##########
+// only the words the screen uses: word 0 of the first 32 rows in lo-res, all of them in hi-res, and the second
+// plane only when something's on it
+static void packFrame(capture_frame_t *out, const frame_buffer_t *f, uint64_t tick) {
+    int height = f->hires ? HIRES_HEIGHT : SCREEN_HEIGHT, words = f->hires ? ROW_WORDS : 1;
+    uint64_t secondPlane = 0;
+    for (int j = 0; j < height; j++) {
+        for (int w = 0; w < words; w++) secondPlane |= f->rows[1][j][w];
+    }
+    out->tick = tick;
+    out->hires = f->hires;
+    out->planes = secondPlane ? 2 : 1;
+
+    uint64_t *word = out->rows;
+    for (int p = 0; p < out->planes; p++) {
+        for (int j = 0; j < height; j++) {
+            for (int w = 0; w < words; w++) *word++ = f->rows[p][j][w];
+        }
+    }
+    out->words = (uint16_t)(word - out->rows);
+}
+
+static int sameFrame(const capture_frame_t *a, const capture_frame_t *b) {
+    return a->hires == b->hires && a->planes == b->planes && a->words == b->words
+        && memcmp(a->rows, b->rows, a->words * sizeof(uint64_t)) == 0;
+}
+
+// palette indexes on the scaled 128x64 canvas
+static void renderFrame(capture_t *c, const capture_frame_t *frame) {
+    int height = frame->hires ? HIRES_HEIGHT : SCREEN_HEIGHT, words = frame->hires ? ROW_WORDS : 1;
+    int pixelSize = c->scale * (frame->hires ? 1 : 2), planeWords = height * words;
+    for (int y = 0; y < c->height; y++) {
+        const uint64_t *row = frame->rows + (y / pixelSize) * words;
+        uint8_t *out = c->pixels + (size_t)y * c->width;
+        for (int x = 0; x < c->width; x++) {
+            int column = x / pixelSize, w = column >> 6, bit = 63 - (column & 63);
+            int pixel = row[w] >> bit & 1;
+            if (frame->planes > 1) pixel |= (row[planeWords + w] >> bit & 1) << 1;
+            out[x] = (uint8_t)pixel;
+        }
+    }
+}
+
+
+// ##########  GIF  ##########
+// a 4 color global palette, a loop forever extension, and per frame a delay and the canvas compressed with LZW
+
+typedef struct {
+    FILE    *file;
+    uint8_t  block[256];                // sub-block being filled, its length first
+    uint32_t bits;
+    int      bitCount;
+} gif_writer_t;
+
+static void gifFlushBlock(gif_writer_t *g) {
+    if (g->block[0] == 0) return;
+    fwrite(g->block, 1, g->block[0] + 1, g->file);
+    g->block[0] = 0;
+}
+
+static void gifCode(gif_writer_t *g, unsigned code, int size) {
+    g->bits |= code << g->bitCount;
+    g->bitCount += size;
+    while (g->bitCount >= 8) {
+        g->block[++g->block[0]] = (uint8_t)g->bits;
+        g->bits >>= 8;
+        g->bitCount -= 8;
+        if (g->block[0] == 255) gifFlushBlock(g);
+    }
+}
+
+static void gifHeader(capture_t *c) {
+    uint8_t header[13 + 12 + 19] = {
+        'G', 'I', 'F', '8', '9', 'a',
+        c->width & 0xFF, c->width >> 8, c->height & 0xFF, c->height >> 8,
+        0xF1, 0, 0,                                         // a global palette of 4 colors
+    };
+    for (int i = 0; i < 4; i++) memset(header + 13 + i * 3, shades[i], 3);
+    static const uint8_t loop[19] = { 0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+                                      3, 1, 0, 0, 0 };
+    memcpy(header + 25, loop, sizeof(loop));
+    fwrite(header, 1, sizeof(header), c->file);
+}
+
+static void gifFrame(capture_t *c, unsigned delay) {
+    uint8_t header[8 + 10 + 1] = {
+        0x21, 0xF9, 4, 0, delay & 0xFF, delay >> 8, 0, 0,   // graphic control: the delay
+        0x2C, 0, 0, 0, 0, c->width & 0xFF, c->width >> 8, c->height & 0xFF, c->height >> 8, 0,
+        2,                                                  // LZW minimum code size
+    };
+    fwrite(header, 1, sizeof(header), c->file);
+
+    // the dictionary: code of a string followed by a pixel, by the string's code. 0 if it isn't in it yet
+    enum { CLEAR = 4, END = 5, FIRST = 6, MAX_CODES = 4096 };
+    uint16_t (*next)[4] = (uint16_t (*)[4])c->scratch;
+    gif_writer_t g = { .file = c->file };
+    int size = 3;
+    unsigned available = FIRST;
+    memset(next, 0, MAX_CODES * sizeof(next[0]));
+    gifCode(&g, CLEAR, size);
+
+    size_t count = (size_t)c->width * c->height;
+    unsigned prefix = c->pixels[0];
+    for (size_t i = 1; i < count; i++) {
+        uint8_t pixel = c->pixels[i];
+        if (next[prefix][pixel]) {
+            prefix = next[prefix][pixel];
+            continue;
+        }
+        gifCode(&g, prefix, size);
+        if (available < MAX_CODES) {
+            next[prefix][pixel] = (uint16_t)available;
+            if (available == 1u << size && size < 12) size++;
+            available++;
+        } else { // full, start over
+            gifCode(&g, CLEAR, size);
+            memset(next, 0, MAX_CODES * sizeof(next[0]));
+            size = 3;
+            available = FIRST;
+        }
+        prefix = pixel;
+    }
+    gifCode(&g, prefix, size);
+    if (available == 1u << size && size < 12) size++; // the decoder adds an entry for the last code before it reads END
+    gifCode(&g, END, size);
+    if (g.bitCount > 0) gifCode(&g, 0, 8 - g.bitCount);
+    gifFlushBlock(&g);
+    fputc(0, c->file);
+}
+
+
+// ##########  PNG  ##########
+// 8-bit grayscale, deflated with stored blocks only: bigger files, but no zlib needed
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = crcTable[(crc ^ data[i]) & 0xFF] ^ crc >> 8;
+    return ~crc;
+}
+
+static uint8_t *putBigEndian(uint8_t *out, uint32_t value) {
+    out[0] = value >> 24; out[1] = value >> 16; out[2] = value >> 8; out[3] = (uint8_t)value;
+    return out + 4;
+}
+
+static void pngChunk(FILE *file, const char *type, const uint8_t *data, uint32_t length) {
+    uint8_t header[8];
+    putBigEndian(header, length);
+    memcpy(header + 4, type, 4);
+    uint8_t crc[4];
+    putBigEndian(crc, crc32Update(crc32Update(0, header + 4, 4), data, length));
+    fwrite(header, 1, 8, file);
+    if (length) fwrite(data, 1, length, file); // IEND has no data
+    fwrite(crc, 1, 4, file);
+}
+
+static int writePng(capture_t *c) {
+    char path[512];
+    size_t base = strlen(c->path);
+    if (base >= 4 && strcmp(c->path + base - 4, ".png") == 0) base -= 4;
+    snprintf(path, sizeof(path), "%.*s-%06llu.png", (int)base, c->path, (unsigned long long)c->written);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return -1;
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, 8, file);
+    uint8_t ihdr[13];
+    putBigEndian(putBigEndian(ihdr, c->width), c->height);
+    memcpy(ihdr + 8, (uint8_t[]){ 8, 0, 0, 0, 0 }, 5); // 8 bits of gray, not interlaced
+    pngChunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+    // each row is a filter byte (none) and its pixels, then the whole image goes out in 64 KB stored blocks
+    uint8_t *out = c->scratch, *zlib = out;
+    *out++ = 0x78;
+    *out++ = 0x01;
+    size_t rowSize = (size_t)c->width + 1, rawSize = rowSize * c->height, blockLeft = 0;
+    uint32_t a = 1, b = 0; // adler-32
+    for (size_t i = 0; i < rawSize; i++) {
+        if (blockLeft == 0) {
+            blockLeft = rawSize - i < 65535 ? rawSize - i : 65535;
+            *out++ = blockLeft == rawSize - i;
+            *out++ = blockLeft & 0xFF; *out++ = blockLeft >> 8;
+            *out++ = ~blockLeft & 0xFF; *out++ = (~blockLeft >> 8) & 0xFF;
+        }
+        size_t x = i % rowSize;
+        uint8_t byte = x == 0 ? 0 : shades[c->pixels[(i / rowSize) * c->width + x - 1]];
+        *out++ = byte;
+        blockLeft--;
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    out = putBigEndian(out, b << 16 | a);
+    pngChunk(file, "IDAT", zlib, (uint32_t)(out - zlib));
+    pngChunk(file, "IEND", NULL, 0);
+
+    long size = ftell(file);
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed) return -1;
+    c->bytes += size;
+    return 0;
+}
+
+
+// ##########  ENCODER THREAD  ##########
+
+// a distinct frame is done, and was on screen for ticks frames
+static void encodeFrame(capture_t *c, const capture_frame_t *frame, uint64_t ticks) {
+    if (c->failed) return;
+    renderFrame(c, frame);
+    c->frames++;
+
+    switch (c->format) {
+        case CAPTURE_GIF: {
+            // delays are in 1/100 s, rounded so they add up to the real time, but never below what browsers show
+            uint64_t end = ((frame->tick + ticks) * 100 + 30) / 60;
+            uint64_t delay = end > c->gifCentiseconds + GIF_MIN_DELAY ? end - c->gifCentiseconds : GIF_MIN_DELAY;
+            if (delay > 0xFFFF) delay = 0xFFFF;
+            c->gifCentiseconds += delay;
+            gifFrame(c, (unsigned)delay);
+            c->written++;
+            break;
+        }
+        case CAPTURE_PNG:
+            if (writePng(c) == 0) c->written++;
+            else c->failed = 1;
+            break;
+        case CAPTURE_RAW: {
+            size_t size = (size_t)c->width * c->height;
+            for (size_t i = 0; i < size; i++) c->scratch[i] = shades[c->pixels[i]];
+            for (uint64_t t = 0; t < ticks; t++) fwrite(c->scratch, 1, size, c->file);
+            c->written += ticks;
+            break;
+        }
+    }
+    if (c->file != NULL && ferror(c->file)) c->failed = 1;
+}
+
+static void *encoderThread(void *arg) {
+    capture_t *c = arg;
+    int holding = 0;
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+        if (tail == atomic_load_explicit(&c->head, memory_order_acquire)) {
+            if (atomic_load_explicit(&c->stop, memory_order_acquire)) break;
+            sleepNs(ENCODER_POLL_NS);
+            continue;
+        }
+        const capture_frame_t *frame = &c->ring[tail & (CAPTURE_RING_SLOTS - 1)];
+        if (!holding || !sameFrame(frame, &c->last)) {
+            if (holding) encodeFrame(c, &c->last, frame->tick - c->last.tick);
+            memcpy(&c->last, frame, offsetof(capture_frame_t, rows) + frame->words * sizeof(uint64_t));
+            holding = 1;
+        }
+        atomic_store_explicit(&c->tail, tail + 1, memory_order_release);
+    }
+    if (holding) encodeFrame(c, &c->last, c->ticks > c->last.tick ? c->ticks - c->last.tick : 1);
+    return NULL;
+}
+
+
+// ##########  EMULATOR SIDE  ##########
+
+capture_t *startCapture(const char *path, int scale, int lossless) {
+    capture_t *c = calloc(1, sizeof(capture_t));
+    if (c == NULL) return NULL;
+    size_t length = strlen(path);
+    c->format = length >= 4 && strcmp(path + length - 4, ".gif") == 0 ? CAPTURE_GIF
+              : length >= 4 && strcmp(path + length - 4, ".png") == 0 ? CAPTURE_PNG : CAPTURE_RAW;
+    c->path = path;
+    c->scale = scale < 1 ? 1 : scale;
+    c->width = HIRES_WIDTH * c->scale;
+    c->height = HIRES_HEIGHT * c->scale;
+    c->lossless = lossless;
+
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++) crc = crc & 1 ? 0xEDB88320u ^ crc >> 1 : crc >> 1;
+        crcTable[i] = crc;
+    }
+
+    // the GIF dictionary, a PNG's deflate stream or a raw frame, whichever is biggest
+    size_t pixels = (size_t)c->width * c->height, pngSize = pixels + c->height + (pixels / 65535 + 1) * 5 + 6;
+    size_t scratchSize = pngSize > 4096 * 4 * sizeof(uint16_t) ? pngSize : 4096 * 4 * sizeof(uint16_t);
+    c->pixels = malloc(pixels);
+    c->scratch = malloc(scratchSize);
+    if (c->format != CAPTURE_PNG) c->file = fopen(path, "wb");
+    if (c->pixels == NULL || c->scratch == NULL || (c->format != CAPTURE_PNG && c->file == NULL)) {
+        printf("Couldn't start capturing to %s\n", path);
+        if (c->file != NULL) fclose(c->file);
+        free(c->pixels);
+        free(c->scratch);
+        free(c);
+        return NULL;
+    }
+    if (c->format == CAPTURE_GIF) gifHeader(c);
+
+    if (pthread_create(&c->thread, NULL, encoderThread, c) != 0) {
+        printf("Couldn't start the capture thread\n");
+        if (c->file != NULL) fclose(c->file);
+        free(c->pixels);
+        free(c->scratch);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void captureFrame(capture_t *c, const frame_buffer_t *f) {
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&c->tail, memory_order_acquire) == CAPTURE_RING_SLOTS) {
+        if (!c->lossless) { // the encoder is behind, this frame is lost and the one before lasts longer
+            c->dropped++;
+            c->ticks++;
+            return;
+        }
+        sleepNs(ENCODER_POLL_NS / 20);
+    }
+    packFrame(&c->ring[head & (CAPTURE_RING_SLOTS - 1)], f, c->ticks++);
+    atomic_store_explicit(&c->head, head + 1, memory_order_release);
+}
+
+void stopCapture(capture_t *c) {
+    if (c == NULL) return;
+    atomic_store_explicit(&c->stop, 1, memory_order_release);
+    pthread_join(c->thread, NULL);
+
+    if (c->file != NULL) {
+        if (c->format == CAPTURE_GIF) fputc(0x3B, c->file);
+        c->bytes = (uint64_t)ftell(c->file);
+        if (fclose(c->file) != 0) c->failed = 1;
+    }
+    printf("capture: %llu frames, %llu distinct, %llu dropped, %llu %s (%.2f MB) in %s%s\n",
+           (unsigned long long)c->ticks, (unsigned long long)c->frames, (unsigned long long)c->dropped,
+           (unsigned long long)c->written, c->format == CAPTURE_PNG ? "files" : "frames written",
+           c->bytes / 1048576.0, c->path, c->failed ? ", but writing it failed" : "");
+    if (c->format == CAPTURE_RAW) {
+        printf("         play it with ffplay -f rawvideo -pix_fmt gray -video_size %dx%d -framerate 60 %s\n",
+               c->width, c->height, c->path);
+    }
+    free(c->pixels);
+    free(c->scratch);
+    free(c);
+}
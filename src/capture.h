@@ -0,0 +1,72 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "chip8.h"
+
+// ##########  VIDEO CAPTURE  ##########
+// --capture FILE records the screen. The emulator's side only packs each 60 Hz frame into a slot of a lock-free
+// single producer, single consumer ring (256 bytes for a lo-res one-plane screen, the words of the second plane and
+// of hi-res only when they're in use) and moves on. A thread of its own folds runs of identical frames into one
+// longer frame and encodes them, by the file's extension:
+//   .gif   an animated GIF
+//   .png   a PNG per distinct frame, FILE-000000.png, FILE-000001.png...
+//   other  raw 8-bit grayscale frames, every 60 Hz frame, for `ffmpeg -f rawvideo -pix_fmt gray -r 60 -s WxH`
+// Every format is drawn on the 128x64 canvas the window uses (lo-res pixels 2x2) times the scale. If the encoder
+// falls behind and the ring fills up, frames are dropped and counted, the frames around them just last longer
+
+#define CAPTURE_RING_SLOTS 256          // a power of two, about 4 seconds
+#define CAPTURE_MAX_WORDS (PLANES * HIRES_HEIGHT * ROW_WORDS)
+#define CAPTURE_DEFAULT_SCALE 4
+
+typedef enum {
+    CAPTURE_GIF,
+    CAPTURE_PNG,
+    CAPTURE_RAW,
+} capture_format_t;
+
+// one packed frame
+typedef struct {
+    uint64_t tick;                      // frames captured before it, dropped ones included
+    uint8_t  hires;
+    uint8_t  planes;                    // 1, or 2 if the second plane has anything on it
+    uint16_t words;                     // used of rows: planes x rows x words per row, in that order
+    uint64_t rows[CAPTURE_MAX_WORDS];
+} capture_frame_t;
+
+typedef struct {
+    capture_format_t format;
+    const char *path;
+    int      scale, width, height;      // the canvas, scaled
+    int      lossless;                  // captureFrame() waits for room instead of dropping, for headless runs
+
+    capture_frame_t ring[CAPTURE_RING_SLOTS];
+    _Alignas(64) _Atomic uint64_t head; // next slot the emulator fills
+    _Alignas(64) _Atomic uint64_t tail; // next slot the encoder reads
+    _Alignas(64) uint64_t ticks;        // the emulator's, frames offered so far
+    uint64_t dropped;
+    atomic_int stop;
+    pthread_t thread;
+
+    // the encoder's
+    FILE    *file;
+    uint8_t *pixels;                    // width x height, palette indexes (0-3, what the planes have on)
+    uint8_t *scratch;                   // encoder output before it's written
+    capture_frame_t last;               // the frame being held while it doesn't change
+    uint64_t frames, written, bytes;    // frames encoded (distinct ones), files or frames written, bytes
+    uint64_t gifCentiseconds;           // GIF delay handed out so far
+    int      failed;
+} capture_t;
+
+// opens the file and starts the encoder thread. scale is how many pixels a hi-res pixel gets. NULL if it can't
+capture_t *startCapture(const char *path, int scale, int lossless);
+
+// hands a frame to the encoder, once per 60 Hz frame. Never waits unless the capture is lossless
+void captureFrame(capture_t *c, const frame_buffer_t *f);
+
+// encodes what's left in the ring, finishes the file and prints what was captured and dropped
+void stopCapture(capture_t *c);
+
+#endif
@@ -0,0 +1,1315 @@
+#include <time.h>
+#include "chip8.h"
+#include "aot.h"
+#include "trace.h"
+
+// one interpreter specialized for a set of QUIRK_ bits, see the QUIRK CORES section
+typedef struct quirk_core {
+    unsigned bits;
+    int  (*execute)(machine_t *m, const decoded_t *d);     // runInstruction()
+    int  (*clockCycle)(machine_t *m);
+    int  (*runCycles)(machine_t *m, int count);            // runCyclesSwitch()
+    void (*draw)(machine_t *m, const decoded_t *d);        // drawSpriteToFramebuffer()
+    int  (*runTraced)(machine_t *m, int count);            // runCyclesTraced()
+} quirk_core_t;
+
+static ALWAYS_INLINE void drawSprite(machine_t *m, const decoded_t *d, const unsigned quirks);
+
+
+// ######################################
+// ########## FUNCTION BODIES ###########
+// ######################################
+machine_t *createMachine(core_t core) {
+    machine_t *m = calloc(1, sizeof(machine_t));
+    if (m == NULL) return NULL;
+    m->skipIdle = 1;
+    m->fuse = 1;
+    setQuirks(m, QUIRKS_CLIP8, 0);
+    resetMachine(m);
+    if (setCore(m, core)) setCore(m, CORE_SWITCH);
+    return m;
+}
+
+void destroyMachine(machine_t *m) {
+    if (m == NULL) return;
+#ifdef HAVE_JIT
+    jitFree(m);
+#endif
+    free(m);
+}
+
+void resetMachine(machine_t *m) {
+    memset(m->ram, 0, sizeof(m->ram));
+    resetFrameBuffer(&m->frameBuffer);
+    memset(m->stack, 0, sizeof(m->stack));
+    memset(m->rpl, 0, sizeof(m->rpl));
+    memset(m->audioPattern, 0xF0, sizeof(m->audioPattern)); // 4 bits on, 4 off, at the default pitch
+    m->pitch = DEFAULT_PITCH;
+    memset(m->v, 0, sizeof(m->v));
+    m->SP = m->DT = m->ST = 0;
+    m->I = 0;
+    m->PC = PROGRAM_START;
+    m->stopped = 0;
+    m->keypad = 0;
+    m->keyHeld = KEY_NONE;
+    m->screenDirty = 1;
+    m->idleCycles = 0;
+    m->fusedInstructions = 0;
+    m->aotNativeInstructions = 0;
+    m->rngState = m->seed; // same random sequence every run with the same seed
+
+    addHex(m); // before the rom, so the decode cache sees the whole RAM
+    buildDecodeCache(m);
+#ifdef HAVE_JIT
+    jitFlush(m);
+    m->jitBlocksCompiled = m->jitFlushes = m->jitNativeInstructions = 0;
+#endif
+}
+
+uint8_t *readRomFile(const char *path, size_t *size) {
+    FILE* romFile = fopen(path, "rb"); // open the ROM file
+    if (romFile == NULL) { // if the file isn't found, exit with an error
+        perror("Error opening file");
+        return NULL;
+    }
+
+    fseek(romFile, 0L, SEEK_END); // search for EOF to determine size
+    long length = ftell(romFile);
+    rewind(romFile); // go to start of file
+
+    uint8_t *data = malloc(length > 0 ? length : 1);
+    size_t result = data ? fread(data, 1, length, romFile) : 0;
+
+    if (data == NULL || length < 0 || result != (size_t)length) { // fread() and the manual check don't match
+        perror("Error reading file");
+        free(data);
+        fclose(romFile);
+        return NULL;
+    }
+
+    fclose(romFile); // close the ROM file
+    *size = result;
+    return data;
+}
+
+int loadRom(machine_t *m, const char *path) {
+    size_t size;
+    uint8_t *rom = readRomFile(path, &size);
+    if (rom == NULL) return -1;
+
+    int status = loadRomImage(m, rom, size);
+    free(rom);
+    return status;
+}
+
+int loadRomImage(machine_t *m, const uint8_t *rom, size_t size) {
+    if (size > m->memoryEnd + 1u - PROGRAM_START) {
+        printf("ROM is too big (%zu bytes, at most %d fit)\n", size, m->memoryEnd + 1 - PROGRAM_START);
+        return -1;
+    }
+    memcpy(&m->ram[PROGRAM_START], rom, size);
+    buildDecodeCache(m);
+    return 0;
+}
+
+opcode_t decodeInstruction(unsigned short codedInstruction) {
+    uint16_t hi   = (codedInstruction & 0xF000) >> 12;
+    uint8_t  lo8  =  codedInstruction & 0x00FF;
+    uint8_t  lo4  =  codedInstruction & 0x000F;
+
+    if (codedInstruction == 0x0000) return ROM_END;
+
+    switch (hi) {
+        case 0x0: {
+            if      (codedInstruction == 0x00E0) return CLS;   // 00E0
+            else if (codedInstruction == 0x00EE) return RET;   // 00EE
+            else if ((codedInstruction & 0xFFF0) == 0x00C0) return SCD; // 00Cn
+            else if ((codedInstruction & 0xFFF0) == 0x00D0) return SCU; // 00Dn
+            else if (codedInstruction == 0x00FB) return SCR;   // 00FB
+            else if (codedInstruction == 0x00FC) return SCL;   // 00FC
+            else if (codedInstruction == 0x00FD) return EXIT;  // 00FD
+            else if (codedInstruction == 0x00FE) return LOW;   // 00FE
+            else if (codedInstruction == 0x00FF) return HIGH;  // 00FF
+            else                                 return SYS;   // 0NNN
+        }
+
+        case 0x1:  return JPADR;  // 1nnn
+        case 0x2:  return CALL;   // 2nnn
+        case 0x3:  return SEIMM;  // 3xkk
+        case 0x4:  return SNE;    // 4xkk
+
+        case 0x5: {
+            switch (lo4) {
+                case 0:    return SEREG;    // 5xy0
+                case 2:    return SAVE;     // 5xy2
+                case 3:    return LOAD;     // 5xy3
+                default:   return ILLEGAL;
+            }
+        }
+
+        case 0x6: return LDIMM; //6xkk
+        case 0x7: return ADDIMM; //7xkk
+
+        case 0x8: {
+            switch (lo4) {
+                case 0:    return LDI;      // 8xy0
+                case 1:    return OR;       // 8xy1
+                case 2:    return AND;      // 8xy2
+                case 3:    return XOR;      // 8xy3
+                case 4:    return ADDREG;   // 8xy4
+                case 5:    return SUB;      // 8xy5
+                case 6:    return SHR;      // 8xy6
+                case 7:    return SUBN;     // 8xy7
+                case 0xE:  return SHL;      // 8xyE
+                default:   return ILLEGAL;
+            }
+        }
+
+        case 0x9:  return lo4 == 0 ? SNEREG : ILLEGAL;
+
+        case 0xA:  return LD;       // Annn
+        case 0xB:  return JPREG;    // Bnnn
+        case 0xC:  return RND;      // Cxkk
+        case 0xD:  return DRW;      // Dxyn
+
+        case 0xE: {
+            if      (lo8 == 0x9E) return SKP;       // Ex9E
+            else if (lo8 == 0xA1) return SKNP;      // ExA1
+            else                  return ILLEGAL;
+        }
+
+        //THIS ONE TOO
+        case 0xF: {
+            unsigned short byte2 = (codedInstruction & 0x00FF);
+            if (codedInstruction == 0xF000) return LDILONG; // F000 nnnn
+            if (codedInstruction == 0xF002) return AUDIO;   // F002
+            switch (byte2) {
+                case 0x01:  return PLANE;       // Fn01
+                case 0x07:  return LDREGDT;     // Fx07
+                case 0x0A:  return LDK;         // Fx0A
+                case 0x15:  return LDDTVX;      // Fx15
+                case 0x18:  return LDSTVX;      // Fx18
+                case 0x1E:  return ADDIVX;      // Fx1E
+                case 0x29:  return LDFVX;       // Fx29
+                case 0x33:  return LDBVX;       // Fx33
+                case 0x55:  return LDIVX;       // Fx55
+                case 0x65:  return LDVXI;       // Fx65
+                case 0x30:  return LDHF;        // Fx30
+                case 0x3A:  return PITCH;       // Fx3A
+                case 0x75:  return LDRVX;       // Fx75
+                case 0x85:  return LDVXR;       // Fx85
+                default:    return ILLEGAL;
+            }
+        }
+
+        default:
+            return ILLEGAL;
+    }
+}
+
+#define WRITES_NONE 0
+#define WRITES_VX   1
+#define WRITES_VY   2
+#define WRITES_VF   3
+
+// which register each opcode writes, by [opcode - ROM_END]. Vx for the ALU ones even when VF is set too
+static const uint8_t writes[OPCODE_COUNT] = {
+    [LDIMM - ROM_END]   = WRITES_VX, [ADDIMM - ROM_END]  = WRITES_VX, [LDI - ROM_END]     = WRITES_VX,
+    [OR - ROM_END]      = WRITES_VX, [AND - ROM_END]     = WRITES_VX, [XOR - ROM_END]     = WRITES_VX,
+    [ADDREG - ROM_END]  = WRITES_VX, [SUB - ROM_END]     = WRITES_VX, [SHR - ROM_END]     = WRITES_VX,
+    [SUBN - ROM_END]    = WRITES_VX, [SHL - ROM_END]     = WRITES_VX, [RND - ROM_END]     = WRITES_VX,
+    [LDREGDT - ROM_END] = WRITES_VX, [LDK - ROM_END]     = WRITES_VX, [LDVXI - ROM_END]   = WRITES_VX,
+    [LDVXR - ROM_END]   = WRITES_VX, [LOAD - ROM_END]    = WRITES_VY, [DRW - ROM_END]     = WRITES_VF,
+};
+
+decoded_t decodeWord(uint16_t instruction) {
+    decoded_t d;
+    d.opcode      = decodeInstruction(instruction);
+    d.x           = (instruction & 0x0F00) >> 8;
+    d.y           = (instruction & 0x00F0) >> 4;
+    d.n           =  instruction & 0x000F;
+    d.kk          =  instruction & 0x00FF;
+    d.nnn         =  instruction & 0x0FFF;
+    d.instruction =  instruction;
+    d.handler     =  NULL;
+    d.idleLength  =  0;
+    d.fused       =  FUSED_NONE;
+    const uint8_t written[4] = { [WRITES_NONE] = TRACE_NO_REGISTER, [WRITES_VX] = d.x, [WRITES_VY] = d.y,
+                                 [WRITES_VF] = 0xF };
+    d.writes      =  written[writes[d.opcode - ROM_END]]; // a lookup, random words don't mispredict it
+    return d;
+}
+
+// decodes the word at an even address into the cache. markSequences() has to run on it afterwards
+static void decodeAt(machine_t *m, int address) {
+    m->decodeCache[address >> 1] = decodeWord(m->ram[address] << 8 | m->ram[address + 1]);
+}
+
+// points an entry at its threaded core handler, if that core has bound this machine: the superinstruction's
+// when one starts here, the opcode's otherwise
+static void bindHandler(const machine_t *m, decoded_t *d) {
+    if (m->threadedHandlers == NULL) return;
+    if (m->fuse && d->fused != FUSED_NONE) d->handler = m->threadedHandlers[OPCODE_COUNT + d->fused];
+    else                                   d->handler = m->threadedHandlers[d->opcode - ROM_END];
+}
+
+// flags the idle loops and superinstructions starting in [from, to). They're up to 3 instructions long,
+// so a write can change the ones starting up to 4 bytes before it
+static void markSequences(machine_t *m, int from, int to) {
+    if (from < 0) from = 0;
+    for (int i = from & ~1; i < to; i += 2) {
+        decoded_t *d = &m->decodeCache[i >> 1];
+        d->idleLength = idleLoopLength(m, i);
+        d->fused = superinstructionAt(m, i);
+        bindHandler(m, d);
+    }
+}
+
+void buildDecodeCache(machine_t *m) {
+    for (int i = 0; i < RAM_SIZE; i += 2) {
+        decodeAt(m, i);
+    }
+    markSequences(m, 0, RAM_SIZE);
+    aotSync(m, 0, RAM_SIZE);
+}
+
+void invalidateDecodeCache(machine_t *m, uint16_t address, int length) {
+    int end = address + length;
+    if (end > m->memoryEnd + 1) { // the store wrapped around and carried on from 0
+        invalidateDecodeCache(m, 0, end - (m->memoryEnd + 1));
+        end = m->memoryEnd + 1;
+    }
+    for (int i = address & ~1; i < end; i += 2) {
+        decodeAt(m, i);
+    }
+    markSequences(m, (address & ~1) - 4, end);
+    aotSync(m, address, end);
+#ifdef HAVE_JIT
+    jitInvalidate(m, address, end - address);
+#endif
+}
+
+int idleLoopLength(const machine_t *m, uint16_t address) {
+    const decoded_t *first = &m->decodeCache[address >> 1];
+    const decoded_t *second = address + 2 <= m->memoryEnd ? first + 1 : NULL;
+    const decoded_t *third = address + 4 <= m->memoryEnd ? first + 2 : NULL;
+
+    if (first->opcode == JPADR && first->nnn == address) return 1;
+    if (first->opcode == LDK) return 1;
+    if ((first->opcode == SKP || first->opcode == SKNP) && second != NULL
+        && second->opcode == JPADR && second->nnn == address) return 2;
+    if (first->opcode == LDREGDT && second != NULL && (second->opcode == SEIMM || second->opcode == SNE)
+        && second->x == first->x && third != NULL && third->opcode == JPADR && third->nnn == address) return 3;
+    return 0;
+}
+
+fused_t superinstructionAt(const machine_t *m, uint16_t address) {
+    const decoded_t *first = &m->decodeCache[address >> 1];
+    const decoded_t *second = address + 2 <= m->memoryEnd ? first + 1 : NULL;
+    const decoded_t *third = address + 4 <= m->memoryEnd ? first + 2 : NULL;
+    if (second == NULL) return FUSED_NONE;
+
+    switch (first->opcode) {
+        case LD:      return second->opcode == DRW ? FUSED_LD_DRW : FUSED_NONE;
+        case SEIMM:   return second->opcode == JPADR ? FUSED_SE_JP : FUSED_NONE;
+        case SNE:     return second->opcode == JPADR ? FUSED_SNE_JP : FUSED_NONE;
+        case SEREG:   return second->opcode == JPADR ? FUSED_SEREG_JP : FUSED_NONE;
+        case SNEREG:  return second->opcode == JPADR ? FUSED_SNEREG_JP : FUSED_NONE;
+        case ADDIMM:  return second->opcode == SEIMM ? FUSED_ADD_SE : second->opcode == SNE ? FUSED_ADD_SNE : FUSED_NONE;
+        case LDREGDT: if (third == NULL || third->opcode != JPADR) return FUSED_NONE;
+                      return second->opcode == SEIMM ? FUSED_DT_SE_JP : second->opcode == SNE ? FUSED_DT_SNE_JP : FUSED_NONE;
+        default:      return FUSED_NONE;
+    }
+}
+
+void setFusion(machine_t *m, int fuse) {
+    m->fuse = fuse != 0;
+    m->threadedHandlers = NULL; // bound again on the threaded core's next run
+}
+
+int idleFastForward(machine_t *m, uint16_t pc, int budget) {
+    const decoded_t *head = &m->decodeCache[pc >> 1];
+    int length = head->idleLength;
+    if (!m->skipIdle || budget < length) return 0;
+
+    // would it go round again? DT and the keypad only change between runs, so it's the same answer every time
+    switch (length) {
+        case 1: // jumps to itself forever, or an Fx0A that will see the same keys as last time
+            if (head->opcode == LDK) {
+                uint16_t keypad = readKeypad(m);
+                if (m->keyHeld == KEY_NONE ? keypad != 0 : !(keypad >> m->keyHeld & 1)) return 0;
+            }
+            break;
+        case 2: { // SKP skips the jump back once the key is down, SKNP once it's up
+            int pressed = readKeypad(m) >> (m->v[head->x] & 0xF) & 1;
+            if (pressed != (head->opcode == SKNP)) return 0;
+            break;
+        }
+        case 3: { // Fx07 then 3xkk skips the jump back once DT == kk, 4xkk once it isn't
+            const decoded_t *test = head + 1;
+            if ((m->DT == test->kk) == (test->opcode == SEIMM)) return 0;
+            m->v[head->x] = m->DT; // what every iteration leaves behind
+            break;
+        }
+        default: return 0;
+    }
+
+    int skipped = budget - budget % length;
+    m->idleCycles += skipped;
+    return skipped;
+}
+
+uint8_t randomByte(machine_t *m) {
+    return nextRandomByte(&m->rngState);
+}
+
+uint8_t nextRandomByte(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint8_t)((z ^ (z >> 31)) >> 56);
+}
+
+// runInstruction() for one set of quirks, a constant in every copy of it
+static ALWAYS_INLINE int execute(machine_t *m, const decoded_t *d, const unsigned quirks) {
+    uint8_t *v = m->v;
+    uint8_t x = d->x, y = d->y, kk = d->kk;
+    uint16_t nnn = d->nnn;
+    const uint16_t memoryEnd = MEMORY_MASK(quirks);
+    #define SKIP (skipLength(m->ram, m->PC, quirks) - 2) // what a taken skip adds on top of the usual + 2
+
+    switch (d->opcode) {
+        case ROM_END: printf("ROM END READ\n");         goto stop;
+        case ILLEGAL: printf("Illegal instruction\n");  goto stop;
+        case SYS:     printf("Syscall (illegal)\n");    goto stop;
+
+        case CLS:    clearFrameBuffer(m);                break;
+
+        case RET:    m->PC = m->stack[m->SP & (STACK_SIZE - 1)]; m->SP--; break;
+
+        case JPADR:  m->PC = nnn - 2;                    break;
+
+        case CALL:   m->SP++; m->stack[m->SP & (STACK_SIZE - 1)] = m->PC; m->PC = nnn - 2; break;
+
+        case SEIMM:  if (v[x] == kk) m->PC += SKIP;      break;
+
+        case SNE:    if (v[x] != kk) m->PC += SKIP;      break;
+
+        case SEREG:  if (v[x] == v[y]) m->PC += SKIP;    break;
+
+        case LDIMM:  v[x] = kk;                          break;
+
+        case ADDIMM: v[x] += kk;                         break;
+
+        case LDI:    v[x] = v[y];                        break;
+
+        case OR:     v[x] |= v[y];
+                     if (quirks & QUIRK_VF_RESET) v[0xF] = 0; break;
+
+        case AND:    v[x] &= v[y];
+                     if (quirks & QUIRK_VF_RESET) v[0xF] = 0; break;
+
+        case XOR:    v[x] ^= v[y];
+                     if (quirks & QUIRK_VF_RESET) v[0xF] = 0; break;
+
+        case ADDREG: uint32_t res1 = v[x] + v[y];
+                     v[x] = res1 & 0x00FF;
+                     v[0xF] = (res1 & 0xFF00) != 0 ? 1 : 0;    break;
+
+        case SUB:    uint32_t res2 = v[x] - v[y];
+                     v[x] = res2 & 0x00FF;
+                     v[0xF] = (res2 & 0xFF00) == 0 ? 1 : 0;    break;
+
+        case SHR:    byte f1 = v[quirks & QUIRK_SHIFT_VY ? y : x];
+                     v[x] = f1 >> 1; v[0xF] = f1 & 0x01; break;
+
+        case SUBN:   v[x] = v[y] - v[x];
+                     v[0xF] = v[y] > v[x];               break;
+
+        case SHL:    byte f2 = v[quirks & QUIRK_SHIFT_VY ? y : x];
+                     v[x] = f2 << 1; v[0xF] = f2 >> 7;   break;
+
+        case SNEREG: m->PC += v[x] != v[y] ? SKIP : 0;   break;
+
+        case LD:     m->I = nnn;                         break;
+
+        case JPREG:  m->PC = nnn + v[quirks & QUIRK_JUMP_VX ? x : 0x0] - 2; break;
+
+        case RND:    v[x] = randomByte(m) & kk;          break;
+
+        case DRW:    drawSprite(m, d, quirks);           break;
+
+        case SKP:    if (readKeypad(m) >> (v[x] & 0xF) & 1) m->PC += SKIP; break;
+
+        case SKNP:   if (!(readKeypad(m) >> (v[x] & 0xF) & 1)) m->PC += SKIP; break;
+
+        case LDREGDT:v[x] = m->DT;                       break;
+
+        case LDK:    if (waitForKey(m, x)) m->PC -= 2;   break;
+
+        case LDDTVX: m->DT = v[x];                       break;
+
+        case LDSTVX: m->ST = v[x];                       break;
+
+        case ADDIVX: m->I += v[x];                       break;
+
+        case LDFVX:  m->I = v[x] * 5;                    break;
+
+        case LDBVX:  uint8_t value = v[x];
+                     m->ram[m->I & memoryEnd]       = value / 100;
+                     m->ram[(m->I + 1) & memoryEnd] = (value / 10) % 10;
+                     m->ram[(m->I + 2) & memoryEnd] = value % 10;
+                     invalidateDecodeCache(m, m->I & memoryEnd, 3); break;
+
+        case LDIVX: {for (int i = 0; i <= x; i++) {
+                     m->ram[(m->I + i) & memoryEnd] = v[i]; }
+                     invalidateDecodeCache(m, m->I & memoryEnd, x + 1);
+                     if (quirks & QUIRK_LOAD_I)   m->I += x + 1;
+                     if (quirks & QUIRK_LOAD_I_X) m->I += x;     break; }
+
+        case LDVXI: {for (int i = 0; i <= x; i++) {
+                     v[i] = m->ram[(m->I + i) & memoryEnd]; }
+                     if (quirks & QUIRK_LOAD_I)   m->I += x + 1;
+                     if (quirks & QUIRK_LOAD_I_X) m->I += x;     break; }
+
+        case SCD:    scrollDown(&m->frameBuffer, d->n);  m->screenDirty = 1; break;
+
+        case SCU:    scrollUp(&m->frameBuffer, d->n);    m->screenDirty = 1; break;
+
+        case SCR:    scrollRight(&m->frameBuffer);       m->screenDirty = 1; break;
+
+        case SCL:    scrollLeft(&m->frameBuffer);        m->screenDirty = 1; break;
+
+        case EXIT:   printf("Exit (00FD)\n");            goto stop;
+
+        case LOW:    setResolution(&m->frameBuffer, 0);  m->screenDirty = 1; break;
+
+        case HIGH:   setResolution(&m->frameBuffer, 1);  m->screenDirty = 1; break;
+
+        case LDHF:   m->I = BIG_FONT_START + (v[x] & 0xF) * 10; break;
+
+        case LDRVX:  memcpy(m->rpl, v, x + 1);           break;
+
+        case LDVXR:  memcpy(v, m->rpl, x + 1);           break;
+
+        case SAVE: { int step = x <= y ? 1 : -1, count = (x <= y ? y - x : x - y) + 1;
+                     for (int i = 0; i < count; i++) {
+                     m->ram[(m->I + i) & memoryEnd] = v[x + i * step]; }
+                     invalidateDecodeCache(m, m->I & memoryEnd, count); break; }
+
+        case LOAD: { int step = x <= y ? 1 : -1, count = (x <= y ? y - x : x - y) + 1;
+                     for (int i = 0; i < count; i++) {
+                     v[x + i * step] = m->ram[(m->I + i) & memoryEnd]; } break; }
+
+        case LDILONG:m->I = m->ram[(m->PC + 2) & memoryEnd] << 8 | m->ram[(m->PC + 3) & memoryEnd];
+                     m->PC += 2;                         break;
+
+        case PLANE:  m->frameBuffer.planes = x & 3;      break;
+
+        case AUDIO:  for (int i = 0; i < AUDIO_PATTERN_SIZE; i++) {
+                     m->audioPattern[i] = m->ram[(m->I + i) & memoryEnd]; } break;
+
+        case PITCH:  m->pitch = v[x];                    break;
+
+        default:      printf("OPCODE UNDEFINED\n");      goto stop;
+    }
+    #undef SKIP
+    return 0;
+
+    stop: // stays stopped, even if it was the last instruction of a run and runCycles() ran all it was asked to
+    m->stopped = 1;
+    return -1;
+
+}
+
+// clockCycle() for one set of quirks
+static ALWAYS_INLINE int cycle(machine_t *m, const unsigned quirks) {
+    const uint16_t memoryEnd = MEMORY_MASK(quirks);
+    m->PC &= memoryEnd;
+    if (m->PC & 1) { // jumped to an odd address, the cache only covers even ones
+        decoded_t d = decodeWord(m->ram[m->PC] << 8 | m->ram[(m->PC + 1) & memoryEnd]);
+        int status = execute(m, &d, quirks);
+        m->PC += 2;
+        return status;
+    }
+    int status = execute(m, &m->decodeCache[m->PC >> 1], quirks);
+    m->PC += 2;
+    return status;
+}
+
+// runCyclesSwitch() for one set of quirks
+static ALWAYS_INLINE int runSwitch(machine_t *m, int count, const unsigned quirks) {
+    const uint16_t memoryEnd = MEMORY_MASK(quirks);
+    for (int i = 0; i < count; i++) {
+        if (cycle(m, quirks)) return i + 1;
+        uint16_t pc = m->PC & memoryEnd;
+        if (!(pc & 1) && m->decodeCache[pc >> 1].idleLength) i += idleFastForward(m, pc, count - i - 1);
+    }
+    return count;
+}
+
+// runCyclesTraced() for one set of quirks. Same as cycle(), with the record built from the entry it already has,
+// and no idle loop fast-forwarding since every instruction gets one
+static ALWAYS_INLINE int runTraced(machine_t *m, int count, const unsigned quirks) {
+    const uint16_t memoryEnd = MEMORY_MASK(quirks);
+    trace_t *t = m->trace;
+    trace_record_t *records = t->records;
+    const uint32_t mask = t->mask;
+    uint64_t written = t->written;
+    int ran = count;
+    for (int i = 0; i < count; i++) {
+        uint16_t pc = m->PC & memoryEnd;
+        decoded_t odd;
+        const decoded_t *d = &m->decodeCache[pc >> 1];
+        if (pc & 1) { // the cache only covers even addresses
+            odd = decodeWord(m->ram[pc] << 8 | m->ram[(pc + 1) & memoryEnd]);
+            d = &odd;
+        }
+        uint16_t instruction = d->instruction; // the entry changes if the instruction writes over itself
+        uint8_t reg = d->writes;
+
+        m->PC = pc;
+        int status = execute(m, d, quirks);
+        m->PC += 2;
+
+        records[written++ & mask] = (trace_record_t){ pc, instruction, m->I, reg, m->v[reg & 0xF] };
+        if (status) { ran = i + 1; break; }
+    }
+    t->written = written;
+    t->header->written = written; // readers, and whoever finds the file after a crash, see up to here
+    return ran;
+}
+
+int runInstruction(machine_t *m, const decoded_t *d) {
+    return m->quirkCore->execute(m, d);
+}
+
+int clockCycle(machine_t *m) {
+    return m->quirkCore->clockCycle(m);
+}
+
+int runCycles(machine_t *m, int count) {
+    if (m->debug != NULL) return runCyclesDebug(m, count);      // and all the debugger costs with nothing armed
+    if (m->trace != NULL) return runCyclesTraced(m, count);     // same for tracing
+    if (m->profile != NULL) return runCyclesProfiled(m, count); // all profiling costs when it's off
+#ifdef HAVE_THREADED_CORE
+    if (m->core == CORE_THREADED) return runCyclesThreaded(m, count);
+#endif
+#ifdef HAVE_JIT
+    if (m->core == CORE_JIT) return runCyclesJit(m, count);
+#endif
+    if (m->core == CORE_AOT) return runCyclesAot(m, count);
+    return runCyclesSwitch(m, count);
+}
+
+int runCyclesSwitch(machine_t *m, int count) {
+    return m->quirkCore->runCycles(m, count);
+}
+
+int runCyclesTraced(machine_t *m, int count) {
+    return m->quirkCore->runTraced(m, count);
+}
+
+#ifdef HAVE_THREADED_CORE
+int runCyclesThreaded(machine_t *m, int count) {
+    static const void *const labels[OPCODE_COUNT] = {
+        [ROM_END - ROM_END] = &&op_STOP,   [ILLEGAL - ROM_END] = &&op_STOP,   [SYS - ROM_END]     = &&op_STOP,
+        [CLS - ROM_END]     = &&op_CLS,    [RET - ROM_END]     = &&op_RET,    [JPADR - ROM_END]   = &&op_JPADR,
+        [CALL - ROM_END]    = &&op_CALL,   [SEIMM - ROM_END]   = &&op_SEIMM,  [SNE - ROM_END]     = &&op_SNE,
+        [SEREG - ROM_END]   = &&op_SEREG,  [LDIMM - ROM_END]   = &&op_LDIMM,  [ADDIMM - ROM_END]  = &&op_ADDIMM,
+        [LDI - ROM_END]     = &&op_LDI,    [OR - ROM_END]      = &&op_OR,     [AND - ROM_END]     = &&op_AND,
+        [XOR - ROM_END]     = &&op_XOR,    [ADDREG - ROM_END]  = &&op_ADDREG, [SUB - ROM_END]     = &&op_SUB,
+        [SHR - ROM_END]     = &&op_SHR,    [SUBN - ROM_END]    = &&op_SUBN,   [SHL - ROM_END]     = &&op_SHL,
+        [SNEREG - ROM_END]  = &&op_SNEREG, [LD - ROM_END]      = &&op_LD,     [JPREG - ROM_END]   = &&op_JPREG,
+        [RND - ROM_END]     = &&op_RND,    [DRW - ROM_END]     = &&op_DRW,    [SKP - ROM_END]     = &&op_SKP,
+        [SKNP - ROM_END]    = &&op_SKNP,   [LDREGDT - ROM_END] = &&op_LDREGDT,[LDK - ROM_END]     = &&op_LDK,
+        [LDDTVX - ROM_END]  = &&op_LDDTVX, [LDSTVX - ROM_END]  = &&op_LDSTVX, [ADDIVX - ROM_END]  = &&op_ADDIVX,
+        [LDFVX - ROM_END]   = &&op_LDFVX,  [LDBVX - ROM_END]   = &&op_LDBVX,  [LDIVX - ROM_END]   = &&op_LDIVX,
+        [LDVXI - ROM_END]   = &&op_LDVXI,
+        [SCD - ROM_END]     = &&op_EXT,    [SCR - ROM_END]     = &&op_EXT,    [SCL - ROM_END]     = &&op_EXT,
+        [EXIT - ROM_END]    = &&op_EXT,    [LOW - ROM_END]     = &&op_EXT,    [HIGH - ROM_END]    = &&op_EXT,
+        [LDHF - ROM_END]    = &&op_EXT,    [LDRVX - ROM_END]   = &&op_EXT,    [LDVXR - ROM_END]   = &&op_EXT,
+        [SCU - ROM_END]     = &&op_EXT,    [SAVE - ROM_END]    = &&op_EXT,    [LOAD - ROM_END]    = &&op_EXT,
+        [LDILONG - ROM_END] = &&op_EXT,    [PLANE - ROM_END]   = &&op_EXT,    [AUDIO - ROM_END]   = &&op_EXT,
+        [PITCH - ROM_END]   = &&op_EXT,
+    };
+    static const void *const fusedLabels[FUSED_COUNT] = {
+        [FUSED_NONE]      = &&op_STOP,        [FUSED_LD_DRW]    = &&op_LD_DRW,
+        [FUSED_SE_JP]     = &&op_SE_JP,       [FUSED_SNE_JP]    = &&op_SNE_JP,
+        [FUSED_SEREG_JP]  = &&op_SEREG_JP,    [FUSED_SNEREG_JP] = &&op_SNEREG_JP,
+        [FUSED_ADD_SE]    = &&op_ADD_SE,      [FUSED_ADD_SNE]   = &&op_ADD_SNE,
+        [FUSED_DT_SE_JP]  = &&op_DT_SE_JP,    [FUSED_DT_SNE_JP] = &&op_DT_SNE_JP,
+    };
+
+    if (m->threadedHandlers == NULL) { // first run with these quirks: bind every cached entry to its handler
+        const void **bound = m->threadedLabels;
+        unsigned quirks = m->quirkBits;
+        memcpy(bound, labels, sizeof(labels));
+        if (quirks & QUIRK_SHIFT_VY) {
+            bound[SHR - ROM_END] = &&op_SHR_VY;
+            bound[SHL - ROM_END] = &&op_SHL_VY;
+        }
+        if (quirks & QUIRK_VF_RESET) {
+            bound[OR - ROM_END]  = &&op_OR_VF;
+            bound[AND - ROM_END] = &&op_AND_VF;
+            bound[XOR - ROM_END] = &&op_XOR_VF;
+        }
+        if (quirks & QUIRK_JUMP_VX) bound[JPREG - ROM_END] = &&op_JPREG_VX;
+        if (quirks & (QUIRK_LOAD_I | QUIRK_LOAD_I_X)) bound[LDVXI - ROM_END] = &&op_EXEC;
+        memcpy(bound + OPCODE_COUNT, fusedLabels, sizeof(fusedLabels));
+        if (quirks & QUIRK_LONG_SKIP) { // the skips have to look at what they skip. Skips over a 1nnn can stay fused
+            static const opcode_t skips[] = { SEIMM, SNE, SEREG, SNEREG, SKP, SKNP };
+            for (size_t k = 0; k < sizeof(skips) / sizeof(skips[0]); k++) bound[skips[k] - ROM_END] = &&op_EXT;
+            bound[OPCODE_COUNT + FUSED_ADD_SE] = bound[OPCODE_COUNT + FUSED_ADD_SNE] = bound[ADDIMM - ROM_END];
+        }
+
+        m->threadedHandlers = bound;
+        for (int i = 0; i < RAM_SIZE / 2; i++) {
+            bindHandler(m, &m->decodeCache[i]);
+        }
+    }
+
+    uint8_t *const v = m->v;
+    const decoded_t *const cache = m->decodeCache;
+    const uint16_t memoryEnd = m->memoryEnd;
+    const decoded_t *d;
+    uint16_t pc = m->PC; // kept in a local, written back whenever something else might look at it
+    int executed = 0, fused = 0;
+
+    // fetch the next entry and jump straight to its handler
+    #define DISPATCH()  do { if (executed == count) goto out;                       \
+                             executed++;                                           \
+                             pc &= memoryEnd;                                      \
+                             if (pc & 1) goto odd;                                 \
+                             d = &cache[pc >> 1];                                  \
+                             goto *d->handler; } while (0)
+    #define NEXT()      do { pc += 2; DISPATCH(); } while (0)
+    #define SKIP_IF(c)  do { pc += (c) ? 4 : 2; DISPATCH(); } while (0)
+    // jumps, fast-forwarding if it lands on an idle loop
+    #define JUMP(to)    do { pc = (to);                                                                     \
+                             if (!(pc & 1) && cache[pc >> 1].idleLength)                                    \
+                                 executed += idleFastForward(m, pc, count - executed);                     \
+                             DISPATCH(); } while (0)
+    // a superinstruction only runs whole, with fewer than n more instructions left its first one runs alone
+    #define FUSE(n)     do { if (count - executed < (n)) goto *m->threadedLabels[d->opcode - ROM_END];      \
+                             executed += (n); fused += (n); } while (0)
+    // a skip + 1nnn: the skip was counted with the dispatch, the jump is only counted if it isn't skipped
+    #define SKIP_OR_JUMP(c) do { if (count - executed < 1) goto *m->threadedLabels[d->opcode - ROM_END];    \
+                                 if (c) { pc += 4; DISPATCH(); }                                           \
+                                 executed++; fused++; JUMP(d[1].nnn); } while (0)
+
+    DISPATCH();
+
+    odd: { // not in the cache, let the switch core deal with it
+        m->PC = pc;
+        decoded_t tmp = decodeWord(m->ram[pc] << 8 | m->ram[(pc + 1) & memoryEnd]);
+        int status = runInstruction(m, &tmp);
+        pc = m->PC + 2;
+        if (status) goto out;
+        DISPATCH();
+    }
+
+    op_STOP:    runInstruction(m, d); pc += 2;        goto out; // prints why and stops
+    op_CLS:     clearFrameBuffer(m);                  NEXT();
+    op_RET:     pc = m->stack[m->SP & (STACK_SIZE - 1)] + 2; m->SP--; DISPATCH();
+    op_JPADR:   JUMP(d->nnn);
+    op_CALL:    m->SP++; m->stack[m->SP & (STACK_SIZE - 1)] = pc; pc = d->nnn; DISPATCH();
+    op_SEIMM:   SKIP_IF(v[d->x] == d->kk);
+    op_SNE:     SKIP_IF(v[d->x] != d->kk);
+    op_SEREG:   SKIP_IF(v[d->x] == v[d->y]);
+    op_LDIMM:   v[d->x] = d->kk;                      NEXT();
+    op_ADDIMM:  v[d->x] += d->kk;                     NEXT();
+    op_LDI:     v[d->x] = v[d->y];                    NEXT();
+    op_OR:      v[d->x] |= v[d->y];                   NEXT();
+    op_AND:     v[d->x] &= v[d->y];                   NEXT();
+    op_XOR:     v[d->x] ^= v[d->y];                   NEXT();
+    op_ADDREG: {uint32_t res = v[d->x] + v[d->y];
+                v[d->x] = res & 0x00FF;
+                v[0xF] = (res & 0xFF00) != 0;         NEXT(); }
+    op_SUB:    {uint32_t res = v[d->x] - v[d->y];
+                v[d->x] = res & 0x00FF;
+                v[0xF] = (res & 0xFF00) == 0;         NEXT(); }
+    op_SHR:    {byte f = v[d->x] & 0x01;
+                v[d->x] >>= 1; v[0xF] = f;            NEXT(); }
+    op_SUBN:    v[d->x] = v[d->y] - v[d->x];
+                v[0xF] = v[d->y] > v[d->x];           NEXT();
+    op_SHL:    {byte f = (v[d->x] & 0x80) != 0;
+                v[d->x] <<= 1; v[0xF] = f;            NEXT(); }
+    op_SNEREG:  SKIP_IF(v[d->x] != v[d->y]);
+    op_LD:      m->I = d->nnn;                        NEXT();
+    op_JPREG:   pc = d->nnn + v[0x0];                 DISPATCH();
+    op_RND:     v[d->x] = randomByte(m) & d->kk;      NEXT();
+    op_DRW:     drawSpriteToFramebuffer(m, d);        NEXT();
+    op_SKP:     SKIP_IF(readKeypad(m) >> (v[d->x] & 0xF) & 1);
+    op_SKNP:    SKIP_IF(!(readKeypad(m) >> (v[d->x] & 0xF) & 1));
+    op_LDREGDT: v[d->x] = m->DT;                      NEXT();
+    op_LDK:     if (waitForKey(m, d->x)) JUMP(pc);    NEXT(); // again, fast-forwarding the wait
+    op_LDDTVX:  m->DT = v[d->x];                      NEXT();
+    op_LDSTVX:  m->ST = v[d->x];                      NEXT();
+    op_ADDIVX:  m->I += v[d->x];                      NEXT();
+    op_LDFVX:   m->I = v[d->x] * 5;                   NEXT();
+    op_LDBVX:   // RAM writes go through runInstruction(), it keeps the decode cache in sync
+    op_LDIVX:
+    op_EXEC:    runInstruction(m, d);                 NEXT();
+    op_LDVXI:   for (int i = 0; i <= d->x; i++) {
+                v[i] = m->ram[(m->I + i) & memoryEnd]; } NEXT();
+    op_EXT:     m->PC = pc; // SUPER-CHIP and XO-CHIP, through runInstruction() with the PC they may move
+                if (runInstruction(m, d)) { pc = m->PC + 2; goto out; }
+                pc = m->PC + 2;                       DISPATCH();
+
+    // the quirky versions, bound instead of the ones above when the machine's quirks ask for them
+    op_SHR_VY: {byte f = v[d->y];
+                v[d->x] = f >> 1; v[0xF] = f & 0x01;  NEXT(); }
+    op_SHL_VY: {byte f = v[d->y];
+                v[d->x] = f << 1; v[0xF] = f >> 7;    NEXT(); }
+    op_OR_VF:   v[d->x] |= v[d->y]; v[0xF] = 0;       NEXT();
+    op_AND_VF:  v[d->x] &= v[d->y]; v[0xF] = 0;       NEXT();
+    op_XOR_VF:  v[d->x] ^= v[d->y]; v[0xF] = 0;       NEXT();
+    op_JPREG_VX:pc = d->nnn + v[d->x];                DISPATCH();
+
+    // superinstructions, d[1] and d[2] are the instructions after the first one
+    op_LD_DRW:  FUSE(1); m->I = d->nnn;
+                drawSpriteToFramebuffer(m, &d[1]);    pc += 4; DISPATCH();
+    op_SE_JP:   SKIP_OR_JUMP(v[d->x] == d->kk);
+    op_SNE_JP:  SKIP_OR_JUMP(v[d->x] != d->kk);
+    op_SEREG_JP:SKIP_OR_JUMP(v[d->x] == v[d->y]);
+    op_SNEREG_JP:SKIP_OR_JUMP(v[d->x] != v[d->y]);
+    op_ADD_SE:  FUSE(1); v[d->x] += d->kk;
+                pc += 2; d++;                         SKIP_IF(v[d->x] == d->kk);
+    op_ADD_SNE: FUSE(1); v[d->x] += d->kk;
+                pc += 2; d++;                         SKIP_IF(v[d->x] != d->kk);
+    op_DT_SE_JP:FUSE(1); v[d->x] = m->DT; pc += 2; d++; SKIP_OR_JUMP(v[d->x] == d->kk);
+    op_DT_SNE_JP:FUSE(1); v[d->x] = m->DT; pc += 2; d++; SKIP_OR_JUMP(v[d->x] != d->kk);
+
+    out:
+    m->PC = pc;
+    m->fusedInstructions += fused;
+    return executed;
+
+    #undef DISPATCH
+    #undef NEXT
+    #undef SKIP_IF
+    #undef JUMP
+    #undef FUSE
+    #undef SKIP_OR_JUMP
+}
+#endif
+
+int setCore(machine_t *m, core_t core) {
+    if (!coreAvailable(core)) return -1;
+    if (core == CORE_AOT && m->aot == NULL) return -1; // nothing was translated for it to run
+#ifdef HAVE_JIT
+    if (core == CORE_JIT && jitInit(m)) return -1;
+#endif
+    m->core = core;
+    return 0;
+}
+
+int coreAvailable(core_t core) {
+    switch (core) {
+        case CORE_SWITCH:   return 1;
+    #ifdef HAVE_THREADED_CORE
+        case CORE_THREADED: return 1;
+    #endif
+    #ifdef HAVE_JIT
+        case CORE_JIT:      return 1;
+    #endif
+        case CORE_AOT:      return 1;
+        default:            return 0;
+    }
+}
+
+const char *coreName(core_t core) {
+    switch (core) {
+        case CORE_SWITCH:   return "switch";
+        case CORE_THREADED: return "threaded";
+        case CORE_JIT:      return "jit";
+        case CORE_AOT:      return "aot";
+        default:            return "unknown";
+    }
+}
+
+const char *opcodeName(opcode_t opcode) {
+    static const char *const names[OPCODE_COUNT] = {
+        "ROM_END", "ILLEGAL", "SYS", "CLS", "RET", "JPADR", "CALL", "SEIMM", "SNE", "SEREG",
+        "LDIMM", "ADDIMM", "LDI", "OR", "AND", "XOR", "ADDREG", "SUB", "SHR", "SUBN", "SHL",
+        "SNEREG", "LD", "JPREG", "RND", "DRW", "SKP", "SKNP", "LDREGDT", "LDK", "LDDTVX",
+        "LDSTVX", "ADDIVX", "LDFVX", "LDBVX", "LDIVX", "LDVXI", "SCD", "SCR", "SCL", "EXIT", "LOW",
+        "HIGH", "LDHF", "LDRVX", "LDVXR", "SCU", "SAVE", "LOAD", "LDILONG", "PLANE",
+        "AUDIO", "PITCH",
+    };
+    if (opcode < ROM_END || opcode > OPCODE_LAST) return "?";
+    return names[opcode - ROM_END];
+}
+
+void tickTimers(machine_t *m) {
+    m->DT -= m->DT == 0 ? 0 : 1;
+    m->ST -= m->ST == 0 ? 0 : 1;
+}
+
+int runFrame(machine_t *m) {
+    if (runCycles(m, INSTRUCTIONS_PER_FRAME) < INSTRUCTIONS_PER_FRAME || m->stopped) return -1;
+    tickTimers(m);
+    return 0;
+}
+
+int runUnpaced(machine_t *m, uint64_t maxCycles, uint64_t maxFrames, uint64_t *cycles, uint64_t *frames) {
+    *cycles = *frames = 0;
+    while ((maxCycles == 0 || *cycles < maxCycles) && (maxFrames == 0 || *frames < maxFrames)) {
+        int count = INSTRUCTIONS_PER_FRAME;
+        if (maxCycles != 0 && maxCycles - *cycles < (uint64_t)count) count = (int)(maxCycles - *cycles);
+
+        int ran = runCycles(m, count);
+        *cycles += ran;
+        if (ran < count || m->stopped) return -1;
+        if (*cycles % INSTRUCTIONS_PER_FRAME == 0) {
+            tickTimers(m);
+            (*frames)++;
+        }
+    }
+    return 0;
+}
+
+uint64_t hashFrameBuffer(const machine_t *m) {
+    return hashFrame(&m->frameBuffer);
+}
+
+uint64_t hashFrame(const frame_buffer_t *f) {
+    int height = f->hires ? HIRES_HEIGHT : SCREEN_HEIGHT, words = f->hires ? ROW_WORDS : 1;
+    uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a 64 offset basis
+    for (int p = 0; p < PLANES; p++) {
+        uint64_t any = 0;
+        if (p > 0) { // the second plane only counts once something's been drawn on it
+            for (int j = 0; j < height; j++) {
+                for (int w = 0; w < words; w++) any |= f->rows[p][j][w];
+            }
+            if (!any) break;
+        }
+        for (int j = 0; j < height; j++) {
+            for (int w = 0; w < words; w++) {
+                uint64_t row = f->rows[p][j][w];
+                for (int b = 7; b >= 0; b--) { // bytes from left to right
+                    hash ^= (row >> (b * 8)) & 0xFF;
+                    hash *= 0x100000001b3ULL;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+uint64_t nanoTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void clearFrameBuffer(machine_t *m) {
+    clearPlanes(&m->frameBuffer);
+    m->screenDirty = 1;
+}
+
+void drawSpriteToFramebuffer(machine_t *m, const decoded_t *d) {
+    m->quirkCore->draw(m, d);
+}
+
+// DRW for one set of quirks: QUIRK_WRAP, or clipping with or without QUIRK_WRAP_ORIGIN. Each selected plane
+// gets its own sprite data, one after the other from I. Returns whether anything was erased
+static ALWAYS_INLINE int drawPlanes(frame_buffer_t *f, const uint8_t *ram, uint16_t I, uint8_t x, uint8_t y,
+                                    uint8_t n, const unsigned quirks) {
+    const int hires = f->hires;
+    const int width = hires ? HIRES_WIDTH : SCREEN_WIDTH, height = hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    const int wide = n == 0; // Dxy0, 16x16
+    const int rows = wide ? 16 : n;
+    const uint16_t memoryEnd = MEMORY_MASK(quirks);
+    uint64_t collision = 0;
+
+    if (quirks & (QUIRK_WRAP | QUIRK_WRAP_ORIGIN)) {
+        x %= width;
+        y %= height;
+    }
+
+    for (int p = 0; p < PLANES; p++) {
+        if (!(f->planes >> p & 1)) continue;
+        for (int i = 0; i < rows; i++) {
+            // sprite row moved to the top bits (x = 0), then across to x
+            uint64_t bits = wide ? (uint64_t)(ram[(I + 2 * i) & memoryEnd] << 8 | ram[(I + 2 * i + 1) & memoryEnd]) << 48
+                                 : (uint64_t)ram[(I + i) & memoryEnd] << 56;
+            int row = y + i;
+            if (quirks & QUIRK_WRAP) row %= height;
+            else if (row >= height || x >= width) continue;
+            uint64_t *words = f->rows[p][row];
+
+            if (!hires) {
+                if (quirks & QUIRK_WRAP) bits = x == 0 ? bits : bits >> x | bits << (64 - x); // rotate, the right edge comes back on the left
+                else                     bits >>= x; // whatever goes past x = 63 is clipped
+                collision |= words[0] & bits;
+                words[0] ^= bits;
+            } else { // across two words, x < 64 never reaches past the second one
+                uint64_t left = x < 64 ? bits >> x : 0;
+                uint64_t right = x == 0 ? 0 : x < 64 ? bits << (64 - x) : bits >> (x - 64);
+                if ((quirks & QUIRK_WRAP) && x > 64) left = bits << (128 - x); // what went past x = 127
+                collision |= (words[0] & left) | (words[1] & right);
+                words[0] ^= left;
+                words[1] ^= right;
+            }
+        }
+        I += wide ? 32 : n;
+    }
+    return collision != 0;
+}
+
+static ALWAYS_INLINE void drawSprite(machine_t *m, const decoded_t *d, const unsigned quirks) {
+    m->v[0xF] = drawPlanes(&m->frameBuffer, m->ram, m->I, m->v[d->x], m->v[d->y], d->n, quirks);
+    m->screenDirty = 1;
+}
+
+int drawSpriteOn(frame_buffer_t *f, const uint8_t *ram, uint16_t I, uint8_t x, uint8_t y, uint8_t n, unsigned quirks) {
+    return drawPlanes(f, ram, I, x, y, n, quirks);
+}
+
+void resetFrameBuffer(frame_buffer_t *f) {
+    memset(f, 0, sizeof(*f));
+    f->planes = 1;
+}
+
+void clearPlanes(frame_buffer_t *f) {
+    for (int p = 0; p < PLANES; p++) {
+        if (!(f->planes >> p & 1)) continue;
+        if (f->hires) memset(f->rows[p], 0, sizeof(f->rows[p]));
+        else for (int j = 0; j < SCREEN_HEIGHT; j++) f->rows[p][j][0] = 0; // the rest of lo-res is always clear
+    }
+}
+
+void setResolution(frame_buffer_t *f, int hires) {
+    memset(f->rows, 0, sizeof(f->rows));
+    f->hires = hires != 0;
+}
+
+void scrollDown(frame_buffer_t *f, int n) {
+    int height = f->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    if (n > height) n = height;
+    for (int p = 0; p < PLANES; p++) {
+        if (!(f->planes >> p & 1)) continue;
+        memmove(f->rows[p][n], f->rows[p][0], (height - n) * sizeof(f->rows[p][0]));
+        memset(f->rows[p][0], 0, n * sizeof(f->rows[p][0]));
+    }
+}
+
+void scrollUp(frame_buffer_t *f, int n) {
+    int height = f->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    if (n > height) n = height;
+    for (int p = 0; p < PLANES; p++) {
+        if (!(f->planes >> p & 1)) continue;
+        memmove(f->rows[p][0], f->rows[p][n], (height - n) * sizeof(f->rows[p][0]));
+        memset(f->rows[p][height - n], 0, n * sizeof(f->rows[p][0]));
+    }
+}
+
+void scrollRight(frame_buffer_t *f) {
+    int height = f->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    for (int p = 0; p < PLANES; p++) {
+        if (!(f->planes >> p & 1)) continue;
+        for (int j = 0; j < height; j++) {
+            uint64_t *words = f->rows[p][j];
+            if (f->hires) words[1] = words[1] >> 4 | words[0] << 60; // lo-res never has anything in word 1
+            words[0] >>= 4;
+        }
+    }
+}
+
+void scrollLeft(frame_buffer_t *f) {
+    int height = f->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    for (int p = 0; p < PLANES; p++) {
+        if (!(f->planes >> p & 1)) continue;
+        for (int j = 0; j < height; j++) {
+            uint64_t *words = f->rows[p][j];
+            words[0] = words[0] << 4 | words[1] >> 60;
+            words[1] <<= 4;
+        }
+    }
+}
+
+
+// ##########  QUIRK CORES  ##########
+// every profile, with and without --wrap, gets its own copy of the switch core, runInstruction() and DRW
+// with its quirks as constants, so none of them tests a quirk while it runs. setQuirks() picks one
+#define VIP_QUIRKS      (QUIRK_SHIFT_VY | QUIRK_LOAD_I | QUIRK_VF_RESET | QUIRK_WRAP_ORIGIN)
+#define CHIP48_QUIRKS   (QUIRK_LOAD_I_X | QUIRK_JUMP_VX | QUIRK_WRAP_ORIGIN)
+#define SCHIP_QUIRKS    (QUIRK_JUMP_VX | QUIRK_WRAP_ORIGIN)
+#define XOCHIP_QUIRKS   (QUIRK_LOAD_I | QUIRK_WRAP | QUIRK_LONG_SKIP | QUIRK_RAM_64K)
+
+#define QUIRK_CORE(name, quirks)                                                                            \
+    static int  execute_##name(machine_t *m, const decoded_t *d) { return execute(m, d, quirks); }         \
+    static int  cycle_##name(machine_t *m)                        { return cycle(m, quirks); }             \
+    static int  run_##name(machine_t *m, int count)               { return runSwitch(m, count, quirks); }  \
+    static void draw_##name(machine_t *m, const decoded_t *d)    { drawSprite(m, d, quirks); }            \
+    static int  traced_##name(machine_t *m, int count)            { return runTraced(m, count, quirks); }   \
+    static const quirk_core_t core_##name = { quirks, execute_##name, cycle_##name, run_##name, draw_##name,  \
+                                              traced_##name };
+
+QUIRK_CORE(clip8,       0)
+QUIRK_CORE(clip8Wrap,   QUIRK_WRAP)
+QUIRK_CORE(vip,         VIP_QUIRKS)
+QUIRK_CORE(vipWrap,     VIP_QUIRKS | QUIRK_WRAP)
+QUIRK_CORE(chip48,      CHIP48_QUIRKS)
+QUIRK_CORE(chip48Wrap,  CHIP48_QUIRKS | QUIRK_WRAP)
+QUIRK_CORE(schip,       SCHIP_QUIRKS)
+QUIRK_CORE(schipWrap,   SCHIP_QUIRKS | QUIRK_WRAP)
+QUIRK_CORE(xochip,      XOCHIP_QUIRKS)
+
+#undef QUIRK_CORE
+
+void setQuirks(machine_t *m, quirks_t quirks, int wrapSprites) {
+    static const quirk_core_t *const cores[QUIRKS_COUNT][2] = {
+        [QUIRKS_CLIP8]  = { &core_clip8,  &core_clip8Wrap },
+        [QUIRKS_VIP]    = { &core_vip,    &core_vipWrap },
+        [QUIRKS_CHIP48] = { &core_chip48, &core_chip48Wrap },
+        [QUIRKS_SCHIP]  = { &core_schip,  &core_schipWrap },
+        [QUIRKS_XOCHIP] = { &core_xochip, &core_xochip },   // wraps either way
+    };
+    if (quirks < 0 || quirks >= QUIRKS_COUNT) quirks = QUIRKS_CLIP8;
+    const quirk_core_t *core = cores[quirks][wrapSprites != 0];
+
+    m->quirks = quirks;
+    m->wrapSprites = wrapSprites != 0;
+    if (m->quirkCore == core) return;
+    m->quirkCore = core;
+    m->quirkBits = core->bits;
+    m->memoryEnd = MEMORY_MASK(core->bits);
+
+    // the threaded core binds its handlers again on its next run, and the JIT compiles everything again
+    m->threadedHandlers = NULL;
+    markSequences(m, CHIP8_RAM_SIZE - 4, CHIP8_RAM_SIZE); // whether they run on past 4 KB or wrap to 0
+#ifdef HAVE_JIT
+    if (m->jitArena != NULL) jitFlush(m);
+#endif
+}
+
+const char *quirksName(quirks_t quirks) {
+    switch (quirks) {
+        case QUIRKS_CLIP8:  return "clip8";
+        case QUIRKS_VIP:    return "vip";
+        case QUIRKS_CHIP48: return "chip48";
+        case QUIRKS_SCHIP:  return "schip";
+        case QUIRKS_XOCHIP: return "xochip";
+        default:            return "unknown";
+    }
+}
+
+int parseQuirks(const char *name) {
+    for (int q = 0; q < QUIRKS_COUNT; q++) {
+        if (strcmp(name, quirksName(q)) == 0) return q;
+    }
+    return -1;
+}
+
+
+void addHex(machine_t *m) {
+    //character '0'
+    m->ram[0] = 0b11110000;
+    m->ram[1] = 0b10010000;
+    m->ram[2] = 0b10010000;
+    m->ram[3] = 0b10010000;
+    m->ram[4] = 0b11110000;
+
+    //character '1'
+    m->ram[5] = 0b00100000;
+    m->ram[6] = 0b01100000;
+    m->ram[7] = 0b00100000;
+    m->ram[8] = 0b00100000;
+    m->ram[9] = 0b01110000;
+
+    //character '2'
+    m->ram[10] = 0b11110000;
+    m->ram[11] = 0b00010000;
+    m->ram[12] = 0b11110000;
+    m->ram[13] = 0b10000000;
+    m->ram[14] = 0b11110000;
+
+    //character '3'
+    m->ram[15] = 0b11110000;
+    m->ram[16] = 0b00010000;
+    m->ram[17] = 0b11110000;
+    m->ram[18] = 0b00010000;
+    m->ram[19] = 0b11110000;
+
+    //character '4'
+    m->ram[20] = 0b10010000;
+    m->ram[21] = 0b10010000;
+    m->ram[22] = 0b11110000;
+    m->ram[23] = 0b00010000;
+    m->ram[24] = 0b00010000;
+
+    //character '5'
+    m->ram[25] = 0b11110000;
+    m->ram[26] = 0b10000000;
+    m->ram[27] = 0b11110000;
+    m->ram[28] = 0b00010000;
+    m->ram[29] = 0b11110000;
+
+    //character '6'
+    m->ram[30] = 0b11110000;
+    m->ram[31] = 0b10000000;
+    m->ram[32] = 0b11110000;
+    m->ram[33] = 0b10010000;
+    m->ram[34] = 0b11110000;
+
+    //character '7'
+    m->ram[35] = 0b11110000;
+    m->ram[36] = 0b00010000;
+    m->ram[37] = 0b00100000;
+    m->ram[38] = 0b01000000;
+    m->ram[39] = 0b01000000;
+
+    //character '8'
+    m->ram[40] = 0b11110000;
+    m->ram[41] = 0b10010000;
+    m->ram[42] = 0b11110000;
+    m->ram[43] = 0b10010000;
+    m->ram[44] = 0b11110000;
+
+    //character '9'
+    m->ram[45] = 0b11110000;
+    m->ram[46] = 0b10010000;
+    m->ram[47] = 0b11110000;
+    m->ram[48] = 0b00010000;
+    m->ram[49] = 0b00010000;
+
+    //character 'A'
+    m->ram[50] = 0b11110000;
+    m->ram[51] = 0b10010000;
+    m->ram[52] = 0b11110000;
+    m->ram[53] = 0b10010000;
+    m->ram[54] = 0b10010000;
+
+    //character 'B'
+    m->ram[55] = 0b11100000;
+    m->ram[56] = 0b10010000;
+    m->ram[57] = 0b11100000;
+    m->ram[58] = 0b10010000;
+    m->ram[59] = 0b11100000;
+
+    //character 'C'
+    m->ram[60] = 0b11110000;
+    m->ram[61] = 0b10000000;
+    m->ram[62] = 0b11110000;
+    m->ram[63] = 0b10000000;
+    m->ram[64] = 0b11110000;
+
+    //character 'D'
+    m->ram[65] = 0b11100000;
+    m->ram[66] = 0b10010000;
+    m->ram[67] = 0b10010000;
+    m->ram[68] = 0b10010000;
+    m->ram[69] = 0b11100000;
+
+    //character 'E'
+    m->ram[70] = 0b11110000;
+    m->ram[71] = 0b10000000;
+    m->ram[72] = 0b11110000;
+    m->ram[73] = 0b10000000;
+    m->ram[74] = 0b11110000;
+
+    //character 'F'
+    m->ram[75] = 0b11110000;
+    m->ram[76] = 0b10000000;
+    m->ram[77] = 0b11110000;
+    m->ram[78] = 0b10000000;
+    m->ram[79] = 0b10000000;
+
+    // SUPER-CHIP's big digits, 8x10. It only had 0-9, A-F are XO-CHIP's
+    static const uint8_t bigFont[16 * 10] = {
+        0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+        0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+        0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+        0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+        0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+        0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+        0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+        0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+        0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+        0x3C, 0x7E, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+        0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F
+    };
+    memcpy(&m->ram[BIG_FONT_START], bigFont, sizeof(bigFont));
+}
+
+uint8_t keypadKey(uint16_t keypad) {
+    // when several keys are down, the first one in this order wins
+    static const uint8_t priority[16] = {
+        0x1, 0x2, 0x3, 0xC,
+        0x4, 0x5, 0x6, 0xD,
+        0x7, 0x8, 0x9, 0xE,
+        0xA, 0x0, 0xB, 0xF,
+    };
+    for (int i = 0; i < 16; i++) {
+        if (keypad & (1 << priority[i])) return priority[i];
+    }
+    return KEY_NONE;
+}
+
+void keypadObserved(machine_t *m) {
+    uint64_t latency = nanoTime() - m->keyEventNs;
+    m->keyEventNs = 0;
+    m->keyLatencies++;
+    m->keyLatencyTotalNs += latency;
+    if (latency > m->keyLatencyWorstNs) m->keyLatencyWorstNs = latency;
+}
+
+int waitForKey(machine_t *m, uint8_t x) {
+    uint16_t keypad = readKeypad(m);
+    if (m->keyHeld == KEY_NONE) {
+        m->keyHeld = keypadKey(keypad); // still KEY_NONE if nothing's down yet
+        return 1;
+    }
+    if (keypad >> m->keyHeld & 1) return 1; // not let go yet
+    m->v[x] = m->keyHeld;
+    m->keyHeld = KEY_NONE;
+    return 0;
+}
+
+int waitingForKey(const machine_t *m) {
+    uint16_t pc = m->PC & m->memoryEnd;
+    return !(pc & 1) && m->decodeCache[pc >> 1].opcode == LDK; // it only stays on one while it waits
+}
+
+
+//######## DEBUGGING FUNCTIONS #######
+void printRam(machine_t *m) {
+    for (int i = 0; i < RAM_SIZE; i++) {
+        printf("%c", m->ram[i]);
+    }
+}
+
+void printDecoded(machine_t *m) {
+    for (int i = 0; i < RAM_SIZE; i += 2) {
+        uint16_t instruction = m->ram[i] << 8 | m->ram[i + 1];
+        if (i == PROGRAM_START) {
+            printf("PROM_START: ");
+        }
+        printf("%d  ", decodeInstruction(instruction));
+    }
+}
+
+void printCPU(machine_t *m) {
+    for (int i = 0; i < 0x10; i++) {
+        printf("Register v[%d] = 0x%x\n", i, m->v[i]);
+    }
+    printf("PC = 0x%x\n", m->PC);
+    printf("I = 0x%x\n", m->I);
+    printf("SP = 0x%x\n", m->SP);
+    printf("DT = 0x%x\n", m->DT);
+    printf("ST = 0x%x\n", m->ST);
+}
+
+void printStack(machine_t *m) {
+    for (int i = 0; i < STACK_SIZE / 2; i++) {
+        printf("stack[%d] : %x \n", i, m->stack[i]);
+    }
+}
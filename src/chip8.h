@@ -0,0 +1,495 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* #######  KEYBOARD LAYOUT  #######
+ *
+ *              1 2 3 C
+ *              4 5 6 D
+ *              7 8 9 E
+ *              A 0 B F
+ *
+ */
+
+// ##########  DEFINITIONS  ##########
+#define byte uint8_t
+
+#define PROGRAM_START 0x200
+#define RAM_SIZE 0x10000        // XO-CHIP's 64 KB, what the per-address tables are sized for
+#define MEMORY_END 0xFFFF
+#define CHIP8_RAM_SIZE 0x1000   // the 4 KB every other profile has, addresses wrap at its end
+#define STACK_SIZE 0x10
+
+#define SCREEN_WIDTH 64         // lo-res, the CHIP-8 screen
+#define SCREEN_HEIGHT 32
+#define HIRES_WIDTH 128         // SUPER-CHIP's hi-res mode
+#define HIRES_HEIGHT 64
+#define ROW_WORDS (HIRES_WIDTH / 64)
+#define PLANES 2                // XO-CHIP's bit planes
+
+#define FONT_START 0x000        // 5 byte hex digits, Fx29
+#define BIG_FONT_START 0x050    // 10 byte hex digits, Fx30
+#define RPL_FLAGS 16            // SUPER-CHIP's HP-48 user flags, Fx75/Fx85
+#define AUDIO_PATTERN_SIZE 16   // XO-CHIP's sound, F002 loads it
+#define DEFAULT_PITCH 64        // Fx3A's at power-on, 4000 bits a second
+
+_Static_assert(SCREEN_WIDTH == 64, "a lo-res row is a single uint64_t");
+
+#define INSTRUCTIONS_PER_FRAME 12
+
+#define KEY_NONE 0xFF   // what keypadKey() gives with no key down
+
+// the threaded core needs labels-as-values (computed goto), a GCC/Clang extension
+#if defined(__GNUC__) || defined(__clang__)
+#define HAVE_THREADED_CORE
+#endif
+
+// the JIT emits x86-64 code for the System V calling convention, in mmap'd memory
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define HAVE_JIT
+#endif
+
+// forces a helper to be inlined, so each quirk core gets its own copy with the quirks folded in as constants
+#if defined(__GNUC__) || defined(__clang__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+#define JIT_ARENA_SIZE      (1 << 20)   // bytes of native code before the whole cache is flushed
+#define JIT_MAX_BLOCK       64          // chip-8 instructions in a block at most
+
+// #define DEBUG_INSTRUCTIONS
+// #define DEBUG
+
+
+// ##########  DATA STRUCTURES FOR INSTRUCTIONS  ###########
+typedef enum {
+    ROM_END = -2,
+    ILLEGAL = -1,
+    SYS     = 0,    // 0nnn - Jump to a machine code routine at nnn.
+    CLS     = 1,    // 00E0 - Clear the display.
+    RET     = 2,    // 00EE - Return from a subroutine. [pc = 0(sp), sp--]
+    JPADR   = 3,    // 1nnn - Jump to location nnn. [pc = nnn]
+    CALL    = 4,    // 2nnn - Call subroutine at nnn. [sp++, 0(sp) = pc]
+    SEIMM   = 5,    // 3xkk - Skip next instruction if Vx = kk. [pc+=2]
+    SNE     = 6,    // 4xkk - Skip next instruction if Vx != kk. [pc+=2]
+    SEREG   = 7,    // 5xy0 - Skip next instruction if Vx = Vy. [pc+=2]
+    LDIMM   = 8,    // 6xkk - Put the value kk into register Vx.
+    ADDIMM  = 9,    // 7xkk - Adds kk to register Vx, and stores the result in Vx.
+    LDI     = 10,   // 8xy0 - Stores the value of Vy in Vx.
+    OR      = 11,   // 8xy1 - Set Vx = Vx OR Vy. (bitwise)
+    AND     = 12,   // 8xy2 - Set Vx = Vx AND Vy. (bitwise)
+    XOR     = 13,   // 8xy3 - Set Vx = Vx XOR Vy. (bitwise)
+    ADDREG  = 14,   // 8xy4 - Set Vx = Vx + Vy, set VF = carry.
+    SUB     = 15,   // 8xy5 - Set Vx = Vx - Vy, set VF = NOT borrow. (Vx > Vy => VF = 1, otherwise 0)
+    SHR     = 16,   // 8xy6 - If bit 0 of Vx = 1, VF = 1, otherwise 0., then Vx >> 1
+    SUBN    = 17,   // 8xy7 - If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx = Vy-Vx
+    SHL     = 18,   // 8xyE - If the bit 15 of Vx is 1, then VF = 1, otherwise 0. Then Vx *= 2.
+    SNEREG  = 19,   // 9xy0 - Skip next instruction if Vx != Vy.
+    LD      = 20,   // Annn - Set I = nnn.
+    JPREG   = 21,   // Bnnn - Jump to location nnn + V0 [PC = V0 + nnn]
+    RND     = 22,   // Cxkk - Set Vx = random byte AND kk (use random and a modulo operator)
+    DRW     = 23,   // Dxyn - Disp n-byte sprite starting at ptr I at (Vx, Vy), VF = collision (****)
+    SKP     = 24,   // Ex9E - Skip next instruction if key with the value of Vx is pressed.
+    SKNP    = 25,   // ExA1 - Skip next instruction if key with the value of Vx is not pressed.
+    LDREGDT = 26,   // Fx07 - Set Vx = delay timer value.
+    LDK     = 27,   // Fx0A - WAIT for a key press, store the value of the key in Vx.
+    LDDTVX  = 28,   // Fx15 - Set Vx = delay timer value. [DT = Vx]
+    LDSTVX  = 29,   // Fx18 - Set sound timer = Vx
+    ADDIVX  = 30,   // Fx1E - Set I = I + Vx.
+    LDFVX   = 31,   // Fx29 - Set I = location of sprite for digit Vx.
+    LDBVX   = 32,   // Fx33 - Store BCD representation of Vx in memory locations I, I+1,I+2. (****)
+    LDIVX   = 33,   // Fx55 - Store registers V0 through Vx in memory starting at location I
+    LDVXI   = 34,   // Fx65 - Read registers V0 through Vx from memory starting at location I.
+
+    // SUPER-CHIP
+    SCD     = 35,   // 00Cn - Scroll the display down n rows.
+    SCR     = 36,   // 00FB - Scroll the display right 4 pixels.
+    SCL     = 37,   // 00FC - Scroll the display left 4 pixels.
+    EXIT    = 38,   // 00FD - Stop the interpreter.
+    LOW     = 39,   // 00FE - Lo-res, 64x32. Clears the screen.
+    HIGH    = 40,   // 00FF - Hi-res, 128x64. Clears the screen.
+    LDHF    = 41,   // Fx30 - Set I = location of the 10 byte sprite for digit Vx.
+    LDRVX   = 42,   // Fx75 - Store V0 through Vx in the RPL user flags.
+    LDVXR   = 43,   // Fx85 - Read V0 through Vx from the RPL user flags.
+
+    // XO-CHIP
+    SCU     = 44,   // 00Dn - Scroll the display up n rows.
+    SAVE    = 45,   // 5xy2 - Store Vx through Vy (either way round) in memory starting at I. I doesn't move.
+    LOAD    = 46,   // 5xy3 - Read Vx through Vy from memory starting at I.
+    LDILONG = 47,   // F000 nnnn - Set I = nnnn, the word after it. 4 bytes long.
+    PLANE   = 48,   // Fn01 - DRW, CLS and the scrolls work on the planes in n (bit 0 = plane 1).
+    AUDIO   = 49,   // F002 - Load the 16 byte (128 bit) audio pattern from memory starting at I.
+    PITCH   = 50,   // Fx3A - Set the pitch register to Vx, the pattern plays at 4000*2^((Vx-64)/48) bits a second.
+} opcode_t;
+
+#define OPCODE_LAST  PITCH
+#define OPCODE_COUNT (OPCODE_LAST - ROM_END + 1) // for tables indexed by [opcode - ROM_END]
+
+// the interpreter cores. All of them must give exactly the same results
+typedef enum {
+    CORE_SWITCH   = 0,  // clockCycle() + the switch in runInstruction(), portable
+    CORE_THREADED = 1,  // direct threaded code, each decoded entry holds the address of its handler
+    CORE_JIT      = 2,  // basic blocks recompiled to x86-64, everything else through runInstruction()
+    CORE_AOT      = 3,  // a rom translated to C by clip8-aot and linked in, see aot.h
+    CORE_COUNT
+} core_t;
+
+// the instructions the original interpreters didn't agree on, one bit each. 0 is how clip-8 always ran them
+#define QUIRK_SHIFT_VY      0x01    // 8xy6/8xyE shift Vy into Vx, instead of shifting Vx in place
+#define QUIRK_LOAD_I        0x02    // Fx55/Fx65 leave I past the last register, I += x + 1
+#define QUIRK_LOAD_I_X      0x04    // Fx55/Fx65 leave I at the last register, I += x (CHIP-48's off by one)
+#define QUIRK_JUMP_VX       0x08    // Bxnn jumps to xnn + Vx, instead of nnn + V0
+#define QUIRK_VF_RESET      0x10    // 8xy1/8xy2/8xy3 clear VF
+#define QUIRK_WRAP_ORIGIN   0x20    // DRW starts the sprite at (Vx, Vy) modulo the screen size, then clips
+#define QUIRK_WRAP          0x40    // DRW wraps the whole sprite around the screen edges, set by --wrap
+#define QUIRK_LONG_SKIP     0x80    // a skip steps over all 4 bytes of an F000 nnnn (XO-CHIP)
+#define QUIRK_RAM_64K       0x100   // addresses wrap at 64 KB instead of 4 (XO-CHIP)
+
+// the last address for a set of quirks, what every address is masked with
+#define MEMORY_MASK(quirks) ((quirks) & QUIRK_RAM_64K ? MEMORY_END : CHIP8_RAM_SIZE - 1)
+
+// the interpreters a rom can expect. Each one is its own set of specialized cores, picked by setQuirks()
+typedef enum {
+    QUIRKS_CLIP8  = 0,  // none of the quirks, what this emulator always did
+    QUIRKS_VIP    = 1,  // the original COSMAC VIP interpreter
+    QUIRKS_CHIP48 = 2,  // CHIP-48 on the HP-48
+    QUIRKS_SCHIP  = 3,  // SUPER-CHIP 1.1
+    QUIRKS_XOCHIP = 4,  // XO-CHIP, as Octo runs it. Sprites always wrap
+    QUIRKS_COUNT
+} quirks_t;
+
+struct quirk_core;  // chip8.c
+struct aot_program; // aot.h
+
+// a compiled basic block. Gets V0-VF, I and how many instructions it may run at most, returns the PC to continue
+// from in the low 16 bits and how many it ran in the high 16
+typedef uint32_t (*jit_fn_t)(uint8_t *v, uint16_t *I, uint32_t budget);
+
+typedef struct {
+    jit_fn_t code;          // NULL if not compiled (yet, or ever if the first instruction can't be). Always runs the
+                            // whole block, the budget has to cover it
+    jit_fn_t counted;       // the same block stopping after budget instructions, compiled the first time a call's
+                            // budget runs out inside it
+    uint8_t  tried;         // compilation was attempted for this entry PC
+    uint8_t  length;        // chip-8 instructions the block runs
+} jit_block_t;
+
+// superinstructions: common pairs and triples that the threaded core runs in a single dispatch,
+// flagged on their first instruction
+typedef enum {
+    FUSED_NONE      = 0,
+    FUSED_LD_DRW    = 1,    // Annn Dxyn         set I and draw with it
+    FUSED_SE_JP     = 2,    // 3xkk 1nnn         jump unless Vx = kk
+    FUSED_SNE_JP    = 3,    // 4xkk 1nnn         jump unless Vx != kk
+    FUSED_SEREG_JP  = 4,    // 5xy0 1nnn         jump unless Vx = Vy
+    FUSED_SNEREG_JP = 5,    // 9xy0 1nnn         jump unless Vx != Vy
+    FUSED_ADD_SE    = 6,    // 7xkk 3xkk         count and compare
+    FUSED_ADD_SNE   = 7,    // 7xkk 4xkk
+    FUSED_DT_SE_JP  = 8,    // Fx07 3xkk 1nnn    timer waits
+    FUSED_DT_SNE_JP = 9,    // Fx07 4xkk 1nnn
+    FUSED_COUNT
+} fused_t;
+
+// an instruction that has already been decoded, with its operands pulled out of the word
+typedef struct {
+    opcode_t opcode;
+    uint8_t  x, y;          // register indexes, -x-- and --y-
+    uint8_t  n, kk;         // ---n and --kk
+    uint16_t nnn;           // -nnn
+    uint16_t instruction;   // the raw word, kept around for debugging
+    uint8_t  idleLength;    // an idle loop starts here, this many instructions long. 0 if not
+    uint8_t  fused;         // a superinstruction starts here (fused_t), FUSED_NONE if not
+    uint8_t  writes;        // the V register it leaves a new value in, what the trace records (see trace.h)
+    const void *handler;    // label in runCyclesThreaded(), NULL until that core has run on this machine
+} decoded_t;
+
+// the screen. Lo-res only uses word 0 of the first SCREEN_HEIGHT rows, so it packs exactly like the old 64x32
+// one did, hi-res all of it. Bit 63 of word 0 is x = 0
+typedef struct {
+    uint64_t rows[PLANES][HIRES_HEIGHT][ROW_WORDS];
+    uint8_t  hires;                     // 128x64, set by 00FF and cleared by 00FE
+    uint8_t  planes;                    // Fn01: bit n, DRW, CLS and the scrolls work on plane n. 1 unless the rom says
+} frame_buffer_t;
+
+struct profile;  // profile.h
+struct debugger; // debugger.h
+struct trace;    // trace.h
+
+// everything one chip-8 needs. Nothing in the core is global, so any number of these can run at once
+typedef struct machine {
+    uint8_t  ram[RAM_SIZE];              // CPU address space, loaded at startup
+    frame_buffer_t frameBuffer;
+    uint16_t stack[STACK_SIZE];
+    uint8_t  v[0x10];                    // general purpose registers V0-VE, VF = flag register
+    uint8_t  SP, DT, ST;                 // stack pointer, delay timer, sound timer
+    uint16_t I, PC;                      // 16-bit program counter and I register to store memory addresses
+    int      stopped;                    // the rom ran into an instruction that stops it
+    uint64_t rngState;                   // RND's generator, restarted from seed on reset
+    uint16_t keypad;                     // keys held down this frame, bit n = key n. Set by whoever runs the machine
+    uint8_t  keyHeld;                    // Fx0A: the key that went down while it waits, KEY_NONE until one does
+    uint8_t  rpl[RPL_FLAGS];             // Fx75/Fx85
+    uint8_t  audioPattern[AUDIO_PATTERN_SIZE]; // F002, what plays while ST > 0. A 500 Hz square wave until a rom sets one
+    uint8_t  pitch;                      // Fx3A
+
+    uint64_t seed;                       // for RND, so a run can be repeated exactly
+
+    core_t   core;
+    quirks_t quirks;                     // which interpreter the rom was written for
+    int      wrapSprites;                // DRW wraps around the screen edges instead of clipping
+    unsigned quirkBits;                  // QUIRK_ bits of the two above, what the JIT compiles for
+    uint16_t memoryEnd;                  // MEMORY_MASK(quirkBits): 0xFFF, 0xFFFF for XO-CHIP
+    const struct quirk_core *quirkCore;  // the switch core and runInstruction() specialized for quirkBits
+    int      screenDirty;                // set by DRW and CLS, cleared by whoever draws the screen
+    int      skipIdle;                   // fast-forward through idle loops, on unless turned off
+    uint64_t idleCycles;                 // instructions that were fast-forwarded instead of run
+    int      fuse;                       // the threaded core runs superinstructions, on unless turned off
+    uint64_t fusedInstructions;          // ran inside a superinstruction, without a dispatch of their own
+
+    // one pre-decoded entry per even address, built by loadRom() and kept in sync on RAM writes
+    decoded_t decodeCache[RAM_SIZE / 2];
+    const void *const *threadedHandlers; // runCyclesThreaded()'s label table, once it has bound the cache
+    const void *threadedLabels[OPCODE_COUNT + FUSED_COUNT]; // its handlers for this machine's quirks, then
+                                                            // the superinstructions'. What threadedHandlers points to
+
+    struct profile *profile;             // counts every instruction while set, NULL when not profiling
+    struct debugger *debug;              // set while a breakpoint, watchpoint or step is armed, NULL costs nothing
+    struct trace *trace;                 // records every instruction while set, NULL when not tracing
+
+    const struct aot_program *aot;       // the rom translated ahead of time, what CORE_AOT runs. NULL if there isn't one
+    uint8_t  aotStale[RAM_SIZE / 2];     // by block address: the rom rewrote it, so the interpreter runs it
+    uint64_t aotNativeInstructions;
+
+    // key latency: keyEventNs is when the keypad last changed (nanoTime()), set by whoever times it and
+    // cleared by the first instruction that reads the keypad afterwards, see readKeypad()
+    uint64_t keyEventNs;
+    uint64_t keyLatencies, keyLatencyTotalNs, keyLatencyWorstNs;
+
+#ifdef HAVE_JIT
+    jit_block_t jitBlocks[RAM_SIZE / 2]; // by entry PC
+    uint8_t  jitCovered[RAM_SIZE / 2];   // instructions that some block (or failed attempt) has looked at
+    uint8_t *jitArena;                   // executable memory, blocks are appended until it's full
+    size_t   jitArenaUsed;
+    uint64_t jitBlocksCompiled, jitFlushes, jitNativeInstructions;
+#endif
+} machine_t;
+
+
+// ##########  FUNCTION PROTOTYPES  ##########
+
+// allocates a machine in its power-on state, running on the given core (the switch core if that one isn't available)
+machine_t *createMachine(core_t core);
+
+// frees a machine and its JIT memory
+void destroyMachine(machine_t *m);
+
+// puts the CPU, RAM and screen back to their power-on state, the rom has to be loaded again after this
+void resetMachine(machine_t *m);
+
+// reads a whole rom file into a malloc'd buffer. NULL if it can't be read
+uint8_t *readRomFile(const char *path, size_t *size);
+
+// loads the input rom file (with its parameter name) into memory from 0x200
+int loadRom(machine_t *m, const char *path);
+
+// copies a rom image to 0x200 and builds the decode cache. -1 if it doesn't fit
+int loadRomImage(machine_t *m, const uint8_t *rom, size_t size);
+
+// gets the instruction enum from its opcode, -1 if it can't be decoded (non-existent instruction)
+// just a huge switch statement. Could be implemented with a table for better performance
+opcode_t decodeInstruction(unsigned short codedInstruction);
+
+// decodes an instruction word and extracts all of its operands
+decoded_t decodeWord(uint16_t instruction);
+
+// fills decodeCache from the whole RAM. Called after a rom is loaded
+void buildDecodeCache(machine_t *m);
+
+// re-decodes the cache entries covering [address, address + length), after the rom wrote to RAM
+void invalidateDecodeCache(machine_t *m, uint16_t address, int length);
+
+// next byte from the machine's own generator (splitmix64), what RND uses
+uint8_t randomByte(machine_t *m);
+
+// the same generator on any state, for engines that keep theirs outside a machine_t
+uint8_t nextRandomByte(uint64_t *state);
+
+// whether an idle loop starts at address (even): a jump to itself, Fx07 + 3xkk/4xkk + a jump back
+// (waiting on DT), Ex9E/ExA1 + a jump back or Fx0A (waiting on a key). Returns its length, 0 if it isn't one
+int idleLoopLength(const machine_t *m, uint16_t address);
+
+// which superinstruction starts at address (even), if any. Only looks at the decode cache
+fused_t superinstructionAt(const machine_t *m, uint16_t address);
+
+// turns superinstructions on or off, for comparing against the plain threaded core
+void setFusion(machine_t *m, int fuse);
+
+// the machine is at the start of an idle loop (pc) with budget instructions left in this run. If it
+// would really spin until then (DT and the keypad can't change before), jumps ahead by as many whole
+// iterations as fit, leaving the machine exactly as running them would. Returns the instructions skipped
+int idleFastForward(machine_t *m, uint16_t pc, int budget);
+
+// does whatever the instruction has to do, the way the machine's quirks say
+int runInstruction(machine_t *m, const decoded_t *d);
+
+// runs a cycle, doing fetch, decode, execute, and pc add. Returns -1 if the rom stopped
+int clockCycle(machine_t *m);
+
+// runs up to count instructions on the machine's core. Returns how many ran, less than count if the rom stopped
+int runCycles(machine_t *m, int count);
+
+// the portable core, just clockCycle() in a loop
+int runCyclesSwitch(machine_t *m, int count);
+
+// the switch core plus counting into m->profile, used by runCycles() whatever the core while profiling
+int runCyclesProfiled(machine_t *m, int count);
+
+// the switch core for the machine's quirks plus a record of every instruction into m->trace, used by runCycles()
+// whatever the core while tracing (see trace.h)
+int runCyclesTraced(machine_t *m, int count);
+
+// the switch core an instruction at a time, stopping in the debugger's console, used by runCycles() while
+// m->debug is set (see debugger.h)
+int runCyclesDebug(machine_t *m, int count);
+
+#ifdef HAVE_THREADED_CORE
+// the direct threaded core: no call per instruction and no -2/+2 PC fixups on jumps
+int runCyclesThreaded(machine_t *m, int count);
+#endif
+
+#ifdef HAVE_JIT
+// the JIT core: runs compiled blocks and falls back to clockCycle() for what they don't cover
+int runCyclesJit(machine_t *m, int count);
+
+// translates the basic block starting at pc (even) into native code, and caches it in jitBlocks
+void jitCompile(machine_t *m, uint16_t pc);
+
+// throws away every compiled block
+void jitFlush(machine_t *m);
+
+// drops the compiled blocks that overlap [address, address + length)
+void jitInvalidate(machine_t *m, uint16_t address, int length);
+
+// maps the executable memory for the JIT, -1 if the OS doesn't allow it
+int jitInit(machine_t *m);
+
+// unmaps it again
+void jitFree(machine_t *m);
+#endif
+
+// switches the machine to another core, -1 if it isn't available in this build (or the JIT can't start,
+// or there's no translated rom for the AOT core)
+int setCore(machine_t *m, core_t core);
+
+// whether a core was built in
+int coreAvailable(core_t core);
+
+// name of a core, for printing
+const char *coreName(core_t core);
+
+// makes the machine run roms written for another interpreter, and wrap sprites or not. Picks the
+// specialized cores for them and drops whatever was compiled or bound for the previous ones
+void setQuirks(machine_t *m, quirks_t quirks, int wrapSprites);
+
+// name of a quirk profile, for printing and for the command line
+const char *quirksName(quirks_t quirks);
+
+// the profile with that name, -1 if there isn't one
+int parseQuirks(const char *name);
+
+// mnemonic of an opcode, the same as its enum name
+const char *opcodeName(opcode_t opcode);
+
+// counts DT and ST down by one, what happens 60 times a second
+void tickTimers(machine_t *m);
+
+// runs one emulated frame worth of instructions and ticks the timers, -1 if the rom stopped
+int runFrame(machine_t *m);
+
+// runs with no pacing until maxCycles instructions or maxFrames frames (0 = no limit), whichever comes first.
+// timers tick every INSTRUCTIONS_PER_FRAME cycles like in a real frame. -1 if the rom stopped
+int runUnpaced(machine_t *m, uint64_t maxCycles, uint64_t maxFrames, uint64_t *cycles, uint64_t *frames);
+
+// FNV-1a hash of the framebuffer, see hashFrame(). Used to compare runs
+uint64_t hashFrameBuffer(const machine_t *m);
+
+// the same hash on any frame buffer: the rows on screen, left to right, of plane 1 and then of plane 2 if it
+// has anything on it. A lo-res CHIP-8 screen hashes the same as it did before there was a hi-res mode
+uint64_t hashFrame(const frame_buffer_t *f);
+
+// a blank lo-res screen drawing on plane 1
+void resetFrameBuffer(frame_buffer_t *f);
+
+// DRW on any frame buffer, with the quirks tested as it goes. For engines that keep theirs outside a machine_t.
+// n = 0 draws a 16x16 sprite. Returns what VF becomes
+int drawSpriteOn(frame_buffer_t *f, const uint8_t *ram, uint16_t I, uint8_t x, uint8_t y, uint8_t n, unsigned quirks);
+
+// CLS: clears the planes Fn01 selected, 256 bytes each in lo-res and 1 KB in hi-res
+void clearPlanes(frame_buffer_t *f);
+
+// 00FE/00FF: switches resolution, clearing the whole screen
+void setResolution(frame_buffer_t *f, int hires);
+
+// 00Cn/00Dn: moves the selected planes down or up n rows, a memmove each. In lo-res they move n lo-res rows
+void scrollDown(frame_buffer_t *f, int n);
+void scrollUp(frame_buffer_t *f, int n);
+
+// 00FB/00FC: moves the selected planes 4 pixels right or left, shifting each row's words
+void scrollRight(frame_buffer_t *f);
+void scrollLeft(frame_buffer_t *f);
+
+// how far a skip at pc jumps when it's taken: 4, or 6 over an F000 nnnn with QUIRK_LONG_SKIP
+static inline int skipLength(const uint8_t *ram, uint16_t pc, unsigned quirks) {
+    if (!(quirks & QUIRK_LONG_SKIP)) return 4;
+    uint16_t next = (pc + 2) & MEMORY_MASK(quirks);
+    return ram[next] == 0xF0 && ram[(next + 1) & MEMORY_MASK(quirks)] == 0x00 ? 6 : 4;
+}
+
+// monotonic time in nanoseconds, for benchmarking
+uint64_t nanoTime();
+
+// implements the instruction for drawing on the screen
+void drawSpriteToFramebuffer(machine_t *m, const decoded_t *d);
+
+// implements CLS
+void clearFrameBuffer(machine_t *m);
+
+// adds the hex character bitmaps to the interpreter area of memory (0x000 - 0x200), the small ones and SUPER-CHIP's
+void addHex(machine_t *m);
+
+// the key a keypad bitmap reads as when several are down, following the keypad pattern. KEY_NONE if none is
+uint8_t keypadKey(uint16_t keypad);
+
+// counts the time since keyEventNs as one key latency, and stops timing until the next change
+void keypadObserved(machine_t *m);
+
+// the keypad as an instruction sees it. Only costs a test while nobody is timing keys
+static inline uint16_t readKeypad(machine_t *m) {
+    if (m->keyEventNs) keypadObserved(m);
+    return m->keypad;
+}
+
+// Fx0A: waits for a key to go down and back up, then puts it in Vx. Returns nonzero while it's still waiting,
+// and the instruction has to run again. The keypad only changes between runs, so that's an idle loop
+int waitForKey(machine_t *m, uint8_t x);
+
+// whether the machine is stuck on an Fx0A, and nothing changes until the keypad does
+int waitingForKey(const machine_t *m);
+
+
+//  ···  just for debugging  ···
+// prints the whole RAM contents into console, for debugging
+void printRam(machine_t *m);
+// prints the whole RAM, but as decoded instructions
+void printDecoded(machine_t *m);
+// prints the current CPU state
+void printCPU(machine_t *m);
+// used for debugging calls and rets
+void printStack(machine_t *m);
+
+#endif
@@ -1,615 +1,926 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "raylib.h"
-
-/* #######  KEYBOARD LAYOUT  #######
- *
- *              1 2 3 C
- *              4 5 6 D
- *              7 8 9 E
- *              A 0 B F
- *
- */
+#include "chip8.h"
+#include "batch.h"
+#include "lockstep.h"
+#include "state.h"
+#include "replay.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "shm.h"
+#include "capture.h"
+#include "debugger.h"
+#include "trace.h"
+#include "audio.h"
+#include <signal.h>
+#ifdef CLIP8_AOT
+#include "aot.h"
+extern const aot_program_t aotProgram; // the rom this executable was translated from, see clip8_add_rom()
+#endif
+
+// the emulator itself lives in chip8.c, this file is the window, the keyboard and the command line
 
 // ##########  DEFINITIONS  ##########
-#define byte uint8_t
-
-#define PROGRAM_START 0x200
-#define RAM_SIZE 4096
-#define MEMORY_END 0xFFF
-#define STACK_SIZE 0x10
-
-#define SCREEN_WIDTH 64
-#define SCREEN_HEIGHT 32
 #define SCREEN_SIZE_MULTIPLIER 12
 
 #define TARGET_FPS 60
-#define INSTRUCTIONS_PER_FRAME 12
+#define TURBO_STEPS 4                   // Tab goes through them: 1x, 2x, 8x, unlimited
+#define TURBO_METER_NS 500000000ULL     // how often the on-screen speed is measured again
+
+#define HEADLESS_DEFAULT_CYCLES 10000000ULL
+#define BATCH_MAX_ROMS 64
+
+#define REWIND_DEFAULT_MB 4
+#define REWIND_MAX_FRAMES (TARGET_FPS * 60 * 30)   // half an hour, if the deltas are small enough
 
 // #define DEBUG_SCREEN
-// #define DEBUG_INSTRUCTIONS
-// #define DEBUG
-
-
-// ##########  DATA STRUCTURES FOR INSTRUCTIONS  ###########
-typedef enum {
-    ROM_END = -2,
-    ILLEGAL = -1,
-    SYS     = 0,    // 0nnn - Jump to a machine code routine at nnn.
-    CLS     = 1,    // 00E0 - Clear the display.
-    RET     = 2,    // 00EE - Return from a subroutine. [pc = 0(sp), sp--]
-    JPADR   = 3,    // 1nnn - Jump to location nnn. [pc = nnn]
-    CALL    = 4,    // 2nnn - Call subroutine at nnn. [sp++, 0(sp) = pc]
-    SEIMM   = 5,    // 3xkk - Skip next instruction if Vx = kk. [pc+=2]
-    SNE     = 6,    // 4xkk - Skip next instruction if Vx != kk. [pc+=2]
-    SEREG   = 7,    // 5xy0 - Skip next instruction if Vx = Vy. [pc+=2]
-    LDIMM   = 8,    // 6xkk - Put the value kk into register Vx.
-    ADDIMM  = 9,    // 7xkk - Adds kk to register Vx, and stores the result in Vx.
-    LDI     = 10,   // 8xy0 - Stores the value of Vy in Vx.
-    OR      = 11,   // 8xy1 - Set Vx = Vx OR Vy. (bitwise)
-    AND     = 12,   // 8xy2 - Set Vx = Vx AND Vy. (bitwise)
-    XOR     = 13,   // 8xy3 - Set Vx = Vx XOR Vy. (bitwise)
-    ADDREG  = 14,   // 8xy4 - Set Vx = Vx + Vy, set VF = carry.
-    SUB     = 15,   // 8xy5 - Set Vx = Vx - Vy, set VF = NOT borrow. (Vx > Vy => VF = 1, otherwise 0)
-    SHR     = 16,   // 8xy6 - If bit 0 of Vx = 1, VF = 1, otherwise 0., then Vx >> 1
-    SUBN    = 17,   // 8xy7 - If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx = Vy-Vx
-    SHL     = 18,   // 8xyE - If the bit 15 of Vx is 1, then VF = 1, otherwise 0. Then Vx *= 2.
-    SNEREG  = 19,   // 9xy0 - Skip next instruction if Vx != Vy.
-    LD      = 20,   // Annn - Set I = nnn.
-    JPREG   = 21,   // Bnnn - Jump to location nnn + V0 [PC = V0 + nnn]
-    RND     = 22,   // Cxkk - Set Vx = random byte AND kk (use random and a modulo operator)
-    DRW     = 23,   // Dxyn - Disp n-byte sprite starting at ptr I at (Vx, Vy), VF = collision (****)
-    SKP     = 24,   // Ex9E - Skip next instruction if key with the value of Vx is pressed.
-    SKNP    = 25,   // ExA1 - Skip next instruction if key with the value of Vx is not pressed.
-    LDREGDT = 26,   // Fx07 - Set Vx = delay timer value.
-    LDK     = 27,   // Fx0A - WAIT for a key press, store the value of the key in Vx.
-    LDDTVX  = 28,   // Fx15 - Set Vx = delay timer value. [DT = Vx]
-    LDSTVX  = 29,   // Fx18 - Set sound timer = Vx
-    ADDIVX  = 30,   // Fx1E - Set I = I + Vx.
-    LDFVX   = 31,   // Fx29 - Set I = location of sprite for digit Vx.
-    LDBVX   = 32,   // Fx33 - Store BCD representation of Vx in memory locations I, I+1,I+2. (****)
-    LDIVX   = 33,   // Fx55 - Store registers V0 through Vx in memory starting at location I
-    LDVXI   = 34,   // Fx65 - Read registers V0 through Vx from memory starting at location I.
-} opcode_t;
 
 
 // ##########  GLOBAL VARIABLES  ##########
-uint8_t  ram[RAM_SIZE];           // CPU address space, loaded at startup
-uint8_t  frameBuffer[SCREEN_WIDTH][SCREEN_HEIGHT] = {0};
-uint16_t stack[STACK_SIZE] = {0};
-uint8_t  v[0x10] = {0};           // general purpose registers V0-VE, VF = flag register
-uint8_t  SP = 0, DT = 0, ST = 0;  // stack pointer, delay timer, sound timer
-uint16_t I = 0, PC = 0x200;       // 16-bit program counter and I register to store memory addresses
-uint16_t currentInstruction;
+// the screen is drawn as one 128x64 grayscale texture, scaled up in a single draw call. Lo-res pixels are 2x2
+Texture2D screenTexture;
+uint8_t   screenPixels[HIRES_WIDTH * HIRES_HEIGHT];
 
+// render time instrumentation, printed when the window closes
+uint64_t renderFrames = 0, renderUploads = 0, renderTotalNs = 0, renderMaxNs = 0;
 
-// ##########  FUNCTION PROTOTYPES  ##########
+// --profile: written at exit, and whenever SIGUSR1 arrives. F2 turns counting on and off with a window
+profile_t  *profile = NULL;
+const char *profilePath = "clip8-profile.json";
+volatile sig_atomic_t profileDumpRequested = 0;
 
-// loads the input rom file (with its parameter name) into memory from 0x200
-int loadRom(char path[]);
+// --shm: every frame goes to a shared memory segment, and the keypad comes from it instead of the keyboard
+shm_export_t *shmExport = NULL;
 
-// gets the instruction enum from its opcode, -1 if it can't be decoded (non-existent instruction)
-// just a huge switch statement. Could be implemented with a table for better performance
-opcode_t decodeInstruction(unsigned short codedInstruction);
+// --capture: every frame goes to the encoder thread, see capture.h
+capture_t *capture = NULL;
 
-// does whatever the instruction has to do
-int runInstruction(opcode_t opcode, uint16_t instruction);
+// --debug: the console opens before the first instruction, and again on Ctrl-C (SIGINT only sets the flag)
+debugger_t *debugger = NULL;
+volatile sig_atomic_t debugBreakRequested = 0;
 
-// runs a cycle, doing fetch, decode, execute, and pc add
-void clockCycle();
+// --trace: every instruction goes into a ring in a mapped file, for clip8-trace
+trace_t *trace = NULL;
 
-// opens a window
-void initializeDisplay();
+// the sound timer's beep, fed from raylib's audio thread. NULL with --mute or headless
+beeper_t   *beeper = NULL;
+AudioStream audioStream;
 
-// draws rectangles on screen according to the framebuffer value
-void drawScreen();
+// what the window asks the CPU thread to do, picked up at its next tick
+typedef struct {
+    rewind_t    *history;
+    input_log_t *recording;
+    const char  *statePath;
+    const scheduler_t *scheduler;       // for the instruction count in --shm frames
+    atomic_int   saveRequested, loadRequested, profileToggled, rewinding;
+} session_t;
 
-// the core loop of the emulator. Contains both logic and drawing
-void mainLoop();
 
-// implements the instruction for drawing on the screen
-void drawSpriteToFramebuffer(uint16_t instruction);
+// ##########  FUNCTION PROTOTYPES  ##########
 
-// adds the hex character bitmaps to the interpreter area of memory (0x000 - 0x200)
-void addHex();
+// opens a window
+void initializeDisplay(machine_t *m);
 
-// returns the current key pressed in the hex format, following the keypad pattern
-uint8_t obtainKey();
+// draws a finished frame on screen, re-uploading the texture only if it changed, with overlay (if not NULL)
+// written in the corner. Returns how long it took, not counting the wait for the next frame
+uint64_t drawScreen(const frame_buffer_t *screen, int changed, const char *overlay);
 
+// starts the beep: an audio stream of bufferFrames-sample buffers, filled by audioCallback(). Without an audio
+// device it says so and carries on silent
+void startAudio(int bufferFrames);
 
-//  ···  just for debugging  ···
-// prints the whole RAM contents into console, for debugging
-void printRam();
-// prints the whole RAM, but as decoded instructions
-void printDecoded();
-// prints the current CPU state 
-void printCPU();
-// displays a grid pattern on the screen
-void testScreen();
-// used for debugging calls and rets
-void printStack();
+// raylib's audio thread asks for the next buffer
+void audioCallback(void *buffer, unsigned int frames);
 
+// stops the stream and prints the beeper's counters
+void stopAudio();
 
+// parses --turbo: 1, 2, 8 or max (SCHEDULER_UNLIMITED). -1 if it's none of them
+int parseTurbo(const char *text);
 
-// ######################################
-// ########## FUNCTION BODIES ###########
-// ######################################
-int main(int argc, char *argv[]) {
+// prints how long drawScreen() took per frame
+void printRenderStats();
 
-    SetTraceLogLevel(LOG_NONE);
+// reads the keyboard as a keypad bitmap, bit n = chip-8 key n. With --shm the segment's keypad is used instead
+uint16_t sampleKeypad();
 
-    // rom loading
-    printf("Enter a rom name\n");
-    char romFilepath[255];
-    fscanf(stdin,"%s", romFilepath);
+// the window's loop: input and drawing. The CPU runs on the scheduler's thread meanwhile
+// F5/F9 save and load, holding backspace steps back through history (if there is one), Tab changes the speed
+// (starting at turbo) and shows how fast it really goes
+void mainLoop(scheduler_t *scheduler, session_t *session, uint32_t turbo);
 
-    if (loadRom(romFilepath)) {
-        printf("###    ROM with that name not found!    ###\n"
-               "Make sure the rom is in the same folder as the .exe\n"
-               "and that you included the extension (.ch8) in the name\n\n"
-               "press any key and enter to exit!");
-        scanf("%s", romFilepath);
-        return 1;
-    }
-    printf("ROM LOADED SUCCESSFULLY!!!\n");
+// runs on the CPU thread before every tick: does what the window asked for, logs the input and
+// keeps the rewind history. Returns nonzero while rewinding, so the CPU doesn't run
+int onTick(machine_t *m, void *context);
 
-    addHex();
+// prints whether the CPU thread kept up
+void printSchedulerStats(const scheduler_t *scheduler);
 
-    initializeDisplay();
+// runs the rom with no window, as fast as possible, and prints speed stats
+// stops after maxCycles instructions or maxFrames frames (0 = no limit), whichever comes first
+// with a history, a snapshot is pushed every frame and their cost is printed too
+// with a replay, every frame gets its keypad from it, and the run ends with the recording
+// with --shm every frame is published, and the keypad comes from the segment unless there's a replay
+// with --capture every frame is captured, waiting for the encoder rather than dropping any
+// returns the instructions per second it got
+double runHeadless(machine_t *m, uint64_t maxCycles, uint64_t maxFrames, rewind_t *history, input_log_t *replay);
 
-    mainLoop();
+// loads a rom file, or in a translated rom's executable that rom when path is its name
+int loadGame(machine_t *m, const char *path);
 
-    CloseWindow();
-    CloseAudioDevice();
-    return 0;
-}
+// opens a recording and sets the machine up the way it was recorded: seed, quirks, sprite wrapping and rom. NULL if they don't match
+input_log_t *startReplay(machine_t *m, const char *path, const char *romPath);
 
-int loadRom(char path[]) {
-    FILE* romFile = fopen(path, "rb"); // open the ROM file
-    if (romFile == NULL) { // if the file isn't found, exit with an error
-        perror("Error opening file");
-        return -1;
-    }
+// prints how much history the rewind buffer holds and what the snapshots cost
+void printRewindStats(const rewind_t *history);
 
-    fseek(romFile, 0L, SEEK_END); // search for EOF to determine size
-    int size = ftell(romFile);
-    rewind(romFile); // go to start of file
-    size_t result = fread(&ram[PROGRAM_START], 1, size, romFile); // copies ROM file to memory
+// SIGUSR1 handler, only sets a flag for the loops to see
+void requestProfileDump(int signal);
 
-    if (result != size) { // if the size returned by fread() and the manual check don't match, there is an issue
-        perror("Error reading file");
-        fclose(romFile);
-        return -1;
-    }
+// SIGINT handler with --debug, the next tick or frame opens the console
+void requestDebugBreak(int signal);
 
-    fclose(romFile); // close the ROM file
-    return 0;
-}
+// writes the profile if SIGUSR1 asked for it, or always with force
+void dumpProfile(int force);
 
-opcode_t decodeInstruction(unsigned short codedInstruction) {
-    uint16_t hi   = (codedInstruction & 0xF000) >> 12;
-    uint8_t  lo8  =  codedInstruction & 0x00FF;
-    uint8_t  lo4  =  codedInstruction & 0x000F;
+// runs every rom instances times over a pool of threads, and prints a line per run plus the throughput
+int runBatchRoms(char *roms[], int romCount, int instances, const batch_config_t *config);
 
-    if (codedInstruction == 0x0000) return ROM_END;
+// runs every rom's instances in lockstep groups, then again one machine at a time on the configured core,
+// checks that they agree and prints both throughputs. Instance k is seeded with seed + k
+int runLockstepRoms(char *roms[], int romCount, int instances, const batch_config_t *config);
 
-    switch (hi) {
-        case 0x0: {
-            if      (codedInstruction == 0x00E0) return CLS;   // 00E0
-            else if (codedInstruction == 0x00EE) return RET;   // 00EE
-            else                                 return SYS;   // 0NNN
-        }
+// displays a grid pattern on the screen
+void testScreen();
 
-        case 0x1:  return JPADR;  // 1nnn
-        case 0x2:  return CALL;   // 2nnn
-        case 0x3:  return SEIMM;  // 3xkk
-        case 0x4:  return SNE;    // 4xkk
-
-        case 0x5: return lo4 == 0 ? SEREG : ILLEGAL; // 5xy0
-
-        case 0x6: return LDIMM; //6xkk
-        case 0x7: return ADDIMM; //7xkk
-
-        case 0x8: {
-            switch (lo4) {
-                case 0:    return LDI;      // 8xy0
-                case 1:    return OR;       // 8xy1
-                case 2:    return AND;      // 8xy2
-                case 3:    return XOR;      // 8xy3
-                case 4:    return ADDREG;   // 8xy4
-                case 5:    return SUB;      // 8xy5
-                case 6:    return SHR;      // 8xy6
-                case 7:    return SUBN;     // 8xy7
-                case 0xE:  return SHL;      // 8xyE
-                default:   return ILLEGAL;
-            }
-        }
 
-        case 0x9:  return lo4 == 0 ? SNEREG : ILLEGAL;
 
-        case 0xA:  return LD;       // Annn
-        case 0xB:  return JPREG;    // Bnnn
-        case 0xC:  return RND;      // Cxkk
-        case 0xD:  return DRW;      // Dxyn
+// ######################################
+// ########## FUNCTION BODIES ###########
+// ######################################
+int main(int argc, char *argv[]) {
 
-        case 0xE: {
-            if      (lo8 == 0x9E) return SKP;       // Ex9E
-            else if (lo8 == 0xA1) return SKNP;      // ExA1
-            else                  return ILLEGAL;
-        }
+    SetTraceLogLevel(LOG_NONE);
 
-        //THIS ONE TOO
-        case 0xF: {
-            unsigned short byte2 = (codedInstruction & 0x00FF);
-            switch (byte2) {
-                case 0x07:  return LDREGDT;     // Fx07
-                case 0x0A:  return LDK;         // Fx0A
-                case 0x15:  return LDDTVX;      // Fx15
-                case 0x18:  return LDSTVX;      // Fx18
-                case 0x1E:  return ADDIVX;      // Fx1E
-                case 0x29:  return LDFVX;       // Fx29
-                case 0x33:  return LDBVX;       // Fx33
-                case 0x55:  return LDIVX;       // Fx55
-                case 0x65:  return LDVXI;       // Fx65
-                default:    return ILLEGAL;
+    // command line: [--headless] [--cycles N] [--frames N] [--core switch|threaded|jit|aot|all] [--wrap]
+    //               [--rewind-mb N] [--load-state FILE] [--save-state FILE] [--seed N] [--record FILE] [--replay FILE]
+    //               [--profile FILE] [--cpu-hz N] [--no-idle-skip] [--no-fuse] [--quirks clip8|vip|chip48|schip|xochip]
+    //               [--shm NAME] [--capture FILE [--capture-scale N]] [--debug] [--trace FILE [--trace-records N]]
+    //               [--turbo 1|2|8|max] [--mute] [--audio-buffer N] [--batch [--threads T] [--instances K] [--lockstep]] [rom...]
+    int headless = 0, allCores = 0, batch = 0, lockstep = 0, threads = 0, instances = 1, wrapSprites = 0;
+    int rewindMb = -1; // default: on with a window, off headless
+    char *loadStatePath = NULL, *saveStatePath = NULL, *recordPath = NULL, *replayPath = NULL, *shmName = NULL;
+    char *capturePath = NULL, *tracePath = NULL;
+    uint32_t traceRecords = TRACE_DEFAULT_RECORDS;
+    int captureScale = CAPTURE_DEFAULT_SCALE;
+    uint64_t seed = 0;
+    int profiling = 0;
+    uint32_t cpuHz = DEFAULT_CPU_HZ;
+    int skipIdle = 1, fuse = 1, debugging = 0;
+    uint32_t turbo = 1;
+    int mute = 0, audioBuffer = AUDIO_DEFAULT_BUFFER;
+    quirks_t quirks = QUIRKS_CLIP8;
+    uint64_t maxCycles = 0, maxFrames = 0;
+#if defined(CLIP8_AOT)
+    core_t core = CORE_AOT; // and the rom runs the way it was translated, unless told otherwise
+    quirks = aotProgram.quirks;
+    wrapSprites = aotProgram.wrapSprites;
+#elif defined(HAVE_THREADED_CORE)
+    core_t core = CORE_THREADED;
+#else
+    core_t core = CORE_SWITCH;
+#endif
+    char *roms[BATCH_MAX_ROMS];
+    int romCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if      (strcmp(argv[i], "--headless") == 0)            headless = 1;
+        else if (strcmp(argv[i], "--batch") == 0)               batch = headless = 1;
+        else if (strcmp(argv[i], "--lockstep") == 0)            lockstep = batch = headless = 1;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)   threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) instances = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) maxCycles = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) maxFrames = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--wrap") == 0)                wrapSprites = 1;
+        else if (strcmp(argv[i], "--rewind-mb") == 0 && i + 1 < argc)  rewindMb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc) loadStatePath = argv[++i];
+        else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc) saveStatePath = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)       seed = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)     recordPath = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)     replayPath = argv[++i], headless = 1;
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)    profilePath = argv[++i], profiling = 1;
+        else if (strcmp(argv[i], "--cpu-hz") == 0 && i + 1 < argc)     cpuHz = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc)        shmName = argv[++i];
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)    capturePath = argv[++i];
+        else if (strcmp(argv[i], "--capture-scale") == 0 && i + 1 < argc) captureScale = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-idle-skip") == 0)        skipIdle = 0;
+        else if (strcmp(argv[i], "--no-fuse") == 0)             fuse = 0;
+        else if (strcmp(argv[i], "--debug") == 0)               debugging = 1;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)      tracePath = argv[++i];
+        else if (strcmp(argv[i], "--trace-records") == 0 && i + 1 < argc) traceRecords = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--mute") == 0)                mute = 1;
+        else if (strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc) audioBuffer = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--turbo") == 0 && i + 1 < argc) {
+            int parsed = parseTurbo(argv[++i]);
+            if (parsed < 0) { printf("--turbo is 1, 2, 8 or max, not %s\n", argv[i]); return 1; }
+            turbo = parsed;
+        }
+        else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            int parsed = parseQuirks(argv[++i]);
+            if (parsed < 0) { printf("Unknown quirks %s\n", argv[i]); return 1; }
+            quirks = parsed;
+        }
+        else if (strcmp(argv[i], "--core") == 0 && i + 1 < argc) {
+            i++;
+            if      (strcmp(argv[i], "all") == 0)      allCores = 1;
+            else if (strcmp(argv[i], "switch") == 0)   core = CORE_SWITCH;
+            else if (strcmp(argv[i], "threaded") == 0) core = CORE_THREADED;
+            else if (strcmp(argv[i], "jit") == 0)      core = CORE_JIT;
+            else if (strcmp(argv[i], "aot") == 0)      core = CORE_AOT;
+            else { printf("Unknown core %s\n", argv[i]); return 1; }
+            if (!allCores && !coreAvailable(core)) {
+                printf("Core %s is not available in this build\n", argv[i]);
+                return 1;
+            }
+#ifndef CLIP8_AOT
+            if (!allCores && core == CORE_AOT) {
+                printf("Core aot only runs roms translated with clip8-aot, see clip8_add_rom() in CMakeLists.txt\n");
+                return 1;
             }
+#endif
+        }
+        else if (argv[i][0] != '-' && romCount < BATCH_MAX_ROMS) roms[romCount++] = argv[i];
+        else {
+            printf("Unknown option %s\n"
+                   "usage: %s [--headless] [--cycles N] [--frames N] [--core switch|threaded|jit|aot|all] [--wrap]\n"
+                   "          [--rewind-mb N] [--load-state FILE] [--save-state FILE] [--seed N] [--record FILE] [--replay FILE]\n"
+                   "          [--profile FILE] [--cpu-hz N] [--no-idle-skip] [--no-fuse] [--quirks clip8|vip|chip48|schip|xochip]\n"
+                   "          [--shm NAME] [--capture FILE [--capture-scale N]] [--debug] [--trace FILE [--trace-records N]]\n"
+                   "          [--turbo 1|2|8|max] [--mute] [--audio-buffer N] [--batch [--threads T] [--instances K] [--lockstep]] [rom...]\n",
+                   argv[i], argv[0]);
+            return 1;
         }
-
-        default:
-            return ILLEGAL;
     }
-}
-
-int runInstruction(opcode_t opcode, uint16_t instruction) {
-    switch (opcode) {
-        case ROM_END: printf("ROM END READ\n");         return -1;
-        case ILLEGAL: printf("Illegal instruction\n");  return -1;
-        case SYS:     printf("Syscall (illegal)\n");    return -1;
-
-        case CLS: {  for (int i = 0; i < SCREEN_WIDTH; i++) {
-                     for (int j = 0; j < SCREEN_HEIGHT; j++) {
-                     frameBuffer[i][j] = 0; } }          break;}
-
-        case RET:    PC = stack[SP]; SP--;               break;
-
-        case JPADR:  PC = (instruction & 0x0FFF) - 2;    break;
-
-        case CALL:   SP++; stack[SP] = PC; PC = (instruction & 0x0FFF) - 2;  break;
-
-        case SEIMM:  if (v[(instruction & 0x0F00) >> 8] ==
-                       (instruction & 0x00FF)) PC += 2;  break;
-
-        case SNE:    if (v[(instruction & 0x0F00) >> 8] !=
-                       (instruction & 0x00FF)) PC += 2;       break;
 
-        case SEREG:  if (v[(instruction & 0x0F00) >> 8] ==
-                     v[(instruction & 0x00F0) >> 4]) PC += 2; break;
-
-        case LDIMM:  v[(instruction & 0x0F00) >> 8] = instruction & 0x00FF;  break;
-
-        case ADDIMM: v[(instruction & 0x0F00) >> 8] += instruction & 0x00FF; break;
-
-        case LDI:    v[(instruction & 0x0F00) >> 8] = v[(instruction & 0x00F0) >> 4];  break;
-
-        case OR:     v[(instruction & 0x0F00) >> 8] |= v[(instruction & 0x00F0) >> 4]; break;
-
-        case AND:    v[(instruction & 0x0F00) >> 8] &= v[(instruction & 0x00F0) >> 4]; break;
+    if ((shmName != NULL || capturePath != NULL || debugging || tracePath != NULL) && (batch || allCores)) {
+        printf("--shm, --capture, --debug and --trace follow a single machine, not --batch or --core all\n");
+        return 1;
+    }
+    if (tracePath != NULL && profiling) { // both take over runCycles() for every instruction
+        printf("--trace and --profile can't run together\n");
+        return 1;
+    }
 
-        case XOR:    v[(instruction & 0x0F00) >> 8] ^= v[(instruction & 0x00F0) >> 4]; break;
+    if (batch) {
+        if (romCount == 0 || instances < 1 || allCores) {
+            printf("--batch needs at least one rom, at least one instance and a single core\n");
+            return 1;
+        }
+        if (maxCycles == 0 && maxFrames == 0) maxCycles = HEADLESS_DEFAULT_CYCLES;
+        batch_config_t config = {
+            .threads = threads, .core = core, .quirks = quirks, .wrapSprites = wrapSprites, .seed = seed, .skipIdle = skipIdle,
+            .maxCycles = maxCycles, .maxFrames = maxFrames
+        };
+        if (lockstep) return runLockstepRoms(roms, romCount, instances, &config);
+        return runBatchRoms(roms, romCount, instances, &config);
+    }
 
-        case ADDREG: uint32_t res1 = v[(instruction & 0x0F00) >> 8] + v[(instruction & 0x00F0) >> 4];
-                     v[(instruction & 0x0F00) >> 8] = res1 & 0x00FF;
-                     v[0xF] = (res1 & 0xFF00) != 0 ? 1 : 0;    break;
+    // rom loading
+    char romFilepath[255];
+    if (romCount > 0) {
+        snprintf(romFilepath, sizeof(romFilepath), "%s", roms[0]);
+    } else {
+#ifdef CLIP8_AOT
+        snprintf(romFilepath, sizeof(romFilepath), "%s", aotProgram.name); // the one it was built with
+#else
+        printf("Enter a rom name\n");
+        fscanf(stdin,"%254s", romFilepath);
+#endif
+    }
 
-        case SUB:    uint32_t res2 = v[(instruction & 0x0F00) >> 8] - v[(instruction & 0x00F0) >> 4];
-                     v[(instruction & 0x0F00) >> 8] = res2 & 0x00FF;
-                     v[0xF] = (res2 & 0xFF00) == 0 ? 1 : 0;    break;
+    // a recording only plays back the same from power-on
+    if ((recordPath || replayPath) && loadStatePath) {
+        printf("--record and --replay can't start from a saved state\n");
+        return 1;
+    }
 
-        case SHR:    byte f1 = v[(instruction & 0x0F00) >> 8] & 0x01;
-                     v[(instruction & 0x0F00) >> 8] >>= 1; v[0xF] = f1;  break;
+    machine_t *m = createMachine(allCores ? CORE_SWITCH : core);
+    if (m == NULL) return 1;
+#ifdef CLIP8_AOT
+    setAotProgram(m, &aotProgram);
+    if (!allCores) setCore(m, core); // createMachine() couldn't pick CORE_AOT before there was a program
+#endif
+    if (profiling && !allCores) {
+        if ((profile = createProfile()) == NULL) { destroyMachine(m); return 1; }
+        m->profile = profile;
+    }
+#ifdef SIGUSR1
+    signal(SIGUSR1, requestProfileDump);
+#endif
+    setQuirks(m, quirks, wrapSprites);
+    m->skipIdle = skipIdle;
+    setFusion(m, fuse);
+    m->seed = seed;
+    resetMachine(m);
+
+    if (loadGame(m, romFilepath)) {
+        destroyMachine(m);
+        if (headless) return 1; // nobody is there to press a key
+        printf("###    ROM with that name not found!    ###\n"
+               "Make sure the rom is in the same folder as the .exe\n"
+               "and that you included the extension (.ch8) in the name\n\n"
+               "press any key and enter to exit!");
+        scanf("%254s", romFilepath);
+        return 1;
+    }
+    printf("ROM LOADED SUCCESSFULLY!!!\n");
 
-        case SUBN:   v[(instruction & 0x0F00) >> 8] = v[(instruction & 0x00F0) >> 4]
-                     - v[(instruction & 0x0F00) >> 8];
-                     v[0xF] = v[(instruction & 0x00F0) >> 4] > v[(instruction & 0x0F00) >> 8]; break;
+    if (loadStatePath != NULL && loadState(m, loadStatePath)) {
+        destroyMachine(m);
+        return 1;
+    }
 
-        case SHL:    byte f2 = (v[(instruction & 0x0F00) >> 8] & 0x80) == 0 ? 0 : 1;
-                     v[(instruction & 0x0F00) >> 8] <<= 1; v[0xF] = f2;  break;
+    input_log_t *replay = NULL, *recording = NULL;
+    if (replayPath != NULL && !allCores && (replay = startReplay(m, replayPath, romFilepath)) == NULL) {
+        destroyMachine(m);
+        return 1;
+    }
+    if (recordPath != NULL) {
+        if (headless) {
+            printf("--record needs the window, there's no input to record without it\n");
+            destroyMachine(m);
+            return 1;
+        }
+        if (cpuHz % TIMER_HZ != 0) { // a replay runs the same number of instructions every frame
+            printf("--record needs a --cpu-hz that's a multiple of %d\n", TIMER_HZ);
+            destroyMachine(m);
+            return 1;
+        }
+        if ((recording = startRecording(recordPath, m, cpuHz / TIMER_HZ)) == NULL) {
+            destroyMachine(m);
+            return 1;
+        }
+        rewindMb = 0; // going back would make the log useless
+    }
 
-        case SNEREG: PC += v[(instruction & 0x0F00) >> 8] !=
-                     v[(instruction & 0x00F0) >> 4] ? 2 : 0;   break;
+    if (rewindMb < 0) rewindMb = headless ? 0 : REWIND_DEFAULT_MB;
+    rewind_t *history = NULL;
+    if (rewindMb > 0 && !allCores) {
+        history = createRewind((size_t)rewindMb << 20, REWIND_MAX_FRAMES);
+        if (history == NULL) printf("Not enough memory for %d MB of rewind, running without it\n", rewindMb);
+    }
 
-        case LD:     I = instruction & 0x0FFF;                 break;
+    if ((shmName != NULL && (shmExport = createShmExport(shmName)) == NULL)
+        || (capturePath != NULL && (capture = startCapture(capturePath, captureScale, headless)) == NULL)
+        || (tracePath != NULL && (trace = createTrace(tracePath, traceRecords, m)) == NULL)
+        || (debugging && (debugger = createDebugger(stdin, stdout)) == NULL)) {
+        destroyShmExport(shmExport);
+        stopCapture(capture);
+        closeTrace(trace);
+        closeInputLog(replay);
+        closeInputLog(recording);
+        destroyRewind(history);
+        destroyMachine(m);
+        return 1;
+    }
+    m->trace = trace;
 
-        case JPREG:  PC = (instruction & 0x0FFF) + v[0x0] - 2; break;
+    if (debugger != NULL) {
+        signal(SIGINT, requestDebugBreak);
+        printf("debugger: Ctrl-C stops the rom, h lists the commands\n");
+        debugBreak(m, debugger);
+    }
 
-        case RND:    v[(instruction & 0x0F00) >> 8] = rand() % 0x100
-                     & (instruction & 0x00FF);                 break;
+    if (headless) {
+        if (maxCycles == 0 && maxFrames == 0 && replayPath == NULL) maxCycles = HEADLESS_DEFAULT_CYCLES;
+        if (!allCores) {
+            runHeadless(m, maxCycles, maxFrames, history, replay);
+            destroyShmExport(shmExport);
+            stopCapture(capture);
+            destroyDebugger(debugger);
+            closeTrace(trace);
+            int status = saveStatePath != NULL && saveState(m, saveStatePath);
+            dumpProfile(1);
+            destroyProfile(profile);
+            closeInputLog(replay);
+            destroyRewind(history);
+            destroyMachine(m);
+            return status;
+        }
 
-        case DRW:    drawSpriteToFramebuffer(instruction);     break;
+        // same rom from power-on on every core, then compare them
+        double speed[CORE_COUNT] = {0};
+        for (core_t c = 0; c < CORE_COUNT; c++) {
+            if (!coreAvailable(c) || setCore(m, c)) continue;
+            resetMachine(m);
+            if (loadGame(m, romFilepath)) { destroyMachine(m); return 1; }
+            if (replayPath != NULL && (replay = startReplay(m, replayPath, romFilepath)) == NULL) {
+                destroyMachine(m);
+                return 1;
+            }
+            speed[c] = runHeadless(m, maxCycles, maxFrames, NULL, replay);
+            closeInputLog(replay);
+            printf("\n");
+        }
+        for (core_t c = 0; c < CORE_COUNT; c++) {
+            if (speed[c] == 0) continue;
+            printf("%-10s %8.2f M instructions/s  (%.2fx switch)\n", coreName(c),
+                   speed[c] / 1e6, speed[CORE_SWITCH] ? speed[c] / speed[CORE_SWITCH] : 0);
+        }
+        destroyMachine(m);
+        return 0;
+    }
 
-        case SKP:    if (obtainKey() == v[(instruction & 0x0F00) >> 8]) PC += 2;  break;
+    if (allCores) setCore(m, coreAvailable(CORE_THREADED) ? CORE_THREADED : CORE_SWITCH);
 
-        case SKNP:   if (obtainKey() != v[(instruction & 0x0F00) >> 8]) PC += 2;  break;
+    // F5/F9 use the --save-state file, or one next to the rom
+    char statePath[270];
+    snprintf(statePath, sizeof(statePath), "%s", saveStatePath ? saveStatePath : romFilepath);
+    if (saveStatePath == NULL) strcat(statePath, ".state");
 
-        case LDREGDT:v[(instruction & 0x0F00) >> 8] = DT;      break;
+    if (cpuHz == 0) cpuHz = DEFAULT_CPU_HZ;
+    initializeDisplay(m);
+    if (!mute) startAudio(audioBuffer > 0 ? audioBuffer : AUDIO_DEFAULT_BUFFER);
 
-        case LDK:    v[((instruction & 0x0F00) >> 8)] = obtainKey();              break;
+    static scheduler_t scheduler;
+    session_t session = { .history = history, .recording = recording, .statePath = statePath, .scheduler = &scheduler };
+    if (startScheduler(&scheduler, m, cpuHz, onTick, &session) == 0) {
+        mainLoop(&scheduler, &session, turbo);
+        stopScheduler(&scheduler);
+        printSchedulerStats(&scheduler);
+    }
+    printRenderStats();
+    stopAudio();
+    destroyShmExport(shmExport);
+    stopCapture(capture);
+    destroyDebugger(debugger);
+    closeTrace(trace);
+    closeInputLog(recording);
+    if (history != NULL) printRewindStats(history);
+    destroyRewind(history);
+    dumpProfile(1);
+    destroyProfile(profile);
+
+    UnloadTexture(screenTexture);
+    CloseWindow();
+    CloseAudioDevice();
+    destroyMachine(m);
+    return 0;
+}
 
-        case LDDTVX: DT = v[(instruction & 0x0F00) >> 8];      break;
+void initializeDisplay(machine_t *m) {
+    InitWindow(SCREEN_WIDTH * SCREEN_SIZE_MULTIPLIER, SCREEN_HEIGHT * SCREEN_SIZE_MULTIPLIER, "Chip8");
+    SetTargetFPS(TARGET_FPS);
+    ClearBackground(BLACK);
+    InitAudioDevice();
 
-        case LDSTVX: ST = v[(instruction & 0x0F00) >> 8];      break;
+    Image screen = {
+        .data = screenPixels, .width = HIRES_WIDTH, .height = HIRES_HEIGHT,
+        .mipmaps = 1, .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+    };
+    screenTexture = LoadTextureFromImage(screen); // default filter is point, so pixels stay sharp
+    m->screenDirty = 1;
+}
 
-        case ADDIVX: I += v[(instruction & 0x0F00) >> 8];      break;
+uint64_t drawScreen(const frame_buffer_t *screen, int changed, const char *overlay) {
+    uint64_t start = nanoTime();
+
+    if (changed) { // one byte per pixel: off, plane 1, plane 2, both
+        static const uint8_t shades[4] = { 0x00, 0xFF, 0x80, 0xC0 };
+        int scale = screen->hires ? 1 : 2;
+        for (int j = 0; j < HIRES_HEIGHT; j++) {
+            for (int i = 0; i < HIRES_WIDTH; i++) {
+                int x = i / scale, y = j / scale, w = x >> 6, bit = 63 - (x & 63);
+                int pixel = (screen->rows[0][y][w] >> bit & 1) | (screen->rows[1][y][w] >> bit & 1) << 1;
+                screenPixels[j * HIRES_WIDTH + i] = shades[pixel];
+            }
+        }
+        UpdateTexture(screenTexture, screenPixels);
+        renderUploads++;
+    }
 
-        case LDFVX:  I = v[((instruction & 0x0F00) >> 8)] * 5 ;    break;
+    BeginDrawing();
+    DrawTextureEx(screenTexture, (Vector2){ 0, 0 }, 0.0f, SCREEN_SIZE_MULTIPLIER * SCREEN_WIDTH / HIRES_WIDTH, WHITE);
+    if (overlay != NULL) {
+        DrawRectangle(0, 0, 10 + MeasureText(overlay, 20), 30, BLACK);
+        DrawText(overlay, 5, 5, 20, RED);
+    }
 
-        case LDBVX:  uint8_t value = v[((instruction & 0x0F00) >> 8)];
-                     ram[I]   = value / 100;
-                     ram[I+1] = (value / 10) % 10;
-                     ram[I+2] = value % 10;                 break;
+    // EndDrawing() also waits for the next frame, so it isn't counted
+    uint64_t elapsed = nanoTime() - start;
+    renderFrames++;
+    renderTotalNs += elapsed;
+    if (elapsed > renderMaxNs) renderMaxNs = elapsed;
 
-        case LDIVX: {for (int i = 0; i <= (instruction & 0x0F00) >> 8; i++) {
-                     ram[(I & 0xFFF) + i] = v[i]; }         break; }
+    EndDrawing();
+    return elapsed;
+}
 
-        case LDVXI: {for (int i = 0; i <= (instruction & 0x0F00) >> 8; i++) {
-                     v[i] = ram[(I & 0x0FFF) + i]; }        break; }
+void printRenderStats() {
+    if (renderFrames == 0) return;
+    printf("render: %llu frames, %llu texture uploads, %.1f us average, %.1f us worst\n",
+           (unsigned long long)renderFrames, (unsigned long long)renderUploads,
+           renderTotalNs / 1e3 / renderFrames, renderMaxNs / 1e3);
+}
 
-        default:      printf("OPCODE UNDEFINED\n");      return -1;
+// the keyboard is read once per display frame, and setSchedulerKeypad() times key latency from there
+uint16_t sampleKeypad() {
+    // keyboard key for each chip-8 key, 0x0 to 0xF
+    static const int keymap[16] = {
+        KEY_X,   KEY_ONE, KEY_TWO, KEY_THREE,
+        KEY_Q,   KEY_W,   KEY_E,   KEY_A,
+        KEY_S,   KEY_D,   KEY_Z,   KEY_C,
+        KEY_FOUR, KEY_R,  KEY_F,   KEY_V,
+    };
+    uint16_t keypad = 0;
+    for (int k = 0; k < 16; k++) {
+        if (IsKeyDown(keymap[k])) keypad |= 1 << k;
     }
-    return 0;
-
+    return keypad;
 }
 
-void clockCycle() {
-    uint16_t instruction = ram[PC] << 8 | ram[PC + 1];
-    opcode_t opcode = decodeInstruction(instruction);
-    runInstruction(opcode, instruction);
-    PC += 2;
+void startAudio(int bufferFrames) {
+    if (!IsAudioDeviceReady()) {
+        printf("No audio device, running without sound\n");
+        return;
+    }
+    if ((beeper = createBeeper(AUDIO_SAMPLE_RATE, bufferFrames)) == NULL) return;
+    SetAudioStreamBufferSizeDefault(bufferFrames);
+    audioStream = LoadAudioStream(AUDIO_SAMPLE_RATE, 16, 1);
+    SetAudioStreamCallback(audioStream, audioCallback);
+    PlayAudioStream(audioStream);
 }
 
-void initializeDisplay() {
-    InitWindow(SCREEN_WIDTH * SCREEN_SIZE_MULTIPLIER, SCREEN_HEIGHT * SCREEN_SIZE_MULTIPLIER, "Chip8");
-    SetTargetFPS(TARGET_FPS);
-    ClearBackground(BLACK);
-    InitAudioDevice();
+void audioCallback(void *buffer, unsigned int frames) {
+    beeperFill(beeper, buffer, frames);
 }
 
-void drawScreen() {
-    // plot each pixel as a square. A texture is more efficient, but this is simple
-    Color sqr;
-    BeginDrawing();
-    for (int i = 0; i < (SCREEN_WIDTH); i++) {
-        for (int j = 0; j < (SCREEN_HEIGHT); j++) {
-
-            if (frameBuffer[i][j] != 0) {
-                sqr = WHITE;
-            } else {
-                sqr = BLACK;
-            }
-            DrawRectangle(i * SCREEN_SIZE_MULTIPLIER, j * SCREEN_SIZE_MULTIPLIER,
-                    SCREEN_SIZE_MULTIPLIER, SCREEN_SIZE_MULTIPLIER, sqr);
-
+void stopAudio() {
+    if (beeper == NULL) return;
+    StopAudioStream(audioStream);
+    UnloadAudioStream(audioStream); // the audio thread is done with the beeper after this
+    printBeeperStats(beeper);
+    destroyBeeper(beeper);
+    beeper = NULL;
+}
 
-        }
-    }
-    EndDrawing();
+int parseTurbo(const char *text) {
+    if (strcmp(text, "max") == 0) return SCHEDULER_UNLIMITED;
+    if (strcmp(text, "1") == 0 || strcmp(text, "2") == 0 || strcmp(text, "8") == 0) return atoi(text);
+    return -1;
 }
 
-void mainLoop() {
-    while (!WindowShouldClose()) {
-        for (int i = 0; i < INSTRUCTIONS_PER_FRAME; i++) {
-            clockCycle();
+void mainLoop(scheduler_t *scheduler, session_t *session, uint32_t turbo) {
+    static const uint32_t speeds[TURBO_STEPS] = { 1, 2, 8, SCHEDULER_UNLIMITED };
+    int profiling = profile != NULL;
+    int step = 0;
+    while (step < TURBO_STEPS - 1 && speeds[step] != turbo) step++;
+    setSchedulerSpeed(scheduler, speeds[step]);
+
+    // the speed it really runs at, in emulated frames per TIMER_HZ, measured every TURBO_METER_NS
+    uint64_t meterStart = nanoTime(), meterTicks = atomic_load(&scheduler->ticks);
+    double measured = 1.0;
+    char overlay[64];
+
+    while (!WindowShouldClose() && !(debugger != NULL && atomic_load(&debugger->quit))) {
+        if (IsKeyPressed(KEY_TAB)) {
+            step = (step + 1) % TURBO_STEPS;
+            setSchedulerSpeed(scheduler, speeds[step]);
+        }
+        if (IsKeyPressed(KEY_F5)) atomic_store(&session->saveRequested, 1);
+        if (IsKeyPressed(KEY_F9)) atomic_store(&session->loadRequested, 1);
+        if (IsKeyPressed(KEY_F2) && (profile != NULL || (profile = createProfile()) != NULL)) {
+            profiling = !profiling;
+            atomic_store(&session->profileToggled, 1);
         }
+        atomic_store(&session->rewinding, IsKeyDown(KEY_BACKSPACE));
+        setSchedulerKeypad(scheduler, shmExport != NULL ? shmKeypad(shmExport) : sampleKeypad());
+
+        // whatever the CPU thread finished last, it never waits for this
+        int changed;
+        const frame_t *frame = readFrame(&scheduler->display, &changed);
 
         #ifdef DEBUG_SCREEN
             testScreen();
         #endif
 
         #ifndef DEBUG_SCREEN
-            drawScreen();
+            uint64_t now = nanoTime(), ticks = atomic_load_explicit(&scheduler->ticks, memory_order_relaxed);
+            if (now - meterStart >= TURBO_METER_NS) {
+                measured = (double)(ticks - meterTicks) * 1e9 / TIMER_HZ / (now - meterStart);
+                meterStart = now;
+                meterTicks = ticks;
+            }
+            if (speeds[step] != 1) {
+                snprintf(overlay, sizeof(overlay), "%s %.1fx  %llu skipped", speeds[step] ? ">>" : ">>|", measured,
+                         (unsigned long long)atomic_load_explicit(&scheduler->skippedFrames, memory_order_relaxed));
+            }
+            uint64_t renderNs = drawScreen(&frame->screen, changed, speeds[step] != 1 ? overlay : NULL);
+            if (profiling) profileTime(&profile->render, renderNs);
 
         #endif
-        DT -= DT == 0 ? 0 : 1;
-        ST -= ST == 0 ? 0 : 1;
-
     }
 }
 
-void drawSpriteToFramebuffer(uint16_t instruction) {
-    uint8_t height = instruction & 0x000F;
-    byte sprite[height];
+int onTick(machine_t *m, void *context) {
+    session_t *session = context;
+    if (shmExport != NULL) publishShmFrame(shmExport, m, session->scheduler->instructions); // what the last tick left
+    if (capture != NULL) captureFrame(capture, &m->frameBuffer);
+    if (beeper != NULL) beeperTick(beeper, m);
 
-    for (int i = 0; i < height; i++) {
-        sprite[i] = ram[I + i]; //copy sprite from ram
+    if (atomic_exchange(&session->saveRequested, 0) && saveState(m, session->statePath) == 0) {
+        printf("state saved to %s\n", session->statePath);
+    }
+    if (atomic_exchange(&session->loadRequested, 0) && session->recording == NULL
+        && loadState(m, session->statePath) == 0) {
+        printf("state loaded from %s\n", session->statePath);
+    }
+    if (atomic_exchange(&session->profileToggled, 0)) {
+        m->profile = m->profile ? NULL : profile;
+        printf("profiling %s\n", m->profile ? "on" : "off");
+    }
+    dumpProfile(0);
+    if (debugBreakRequested && debugger != NULL) {
+        debugBreakRequested = 0;
+        debugBreak(m, debugger);
     }
 
-    v[0xF] = 0; //init collision reg
-    uint8_t x = v[((instruction & 0x0F00) >> 8)];
-    uint8_t y = v[((instruction & 0x00F0) >> 4)];
-
-    for (int i = 0; i < height; i++) { // i = row, j = bit
-        for (int j = 0; j < 8; j++) { // 8 bits in a byte
+    if (session->history != NULL && atomic_load(&session->rewinding)) {
+        rewindPop(session->history, m); // a tick back every tick, stays on the oldest one when it runs out
+        return 1;
+    }
+    if (session->recording != NULL) recordFrame(session->recording, m->keypad);
+    if (session->history != NULL) rewindPush(session->history, m); // the state the last tick left
+    return 0;
+}
 
-            if (x + j >= SCREEN_WIDTH  ||  y + i >= SCREEN_HEIGHT) continue;
+void printSchedulerStats(const scheduler_t *scheduler) {
+    if (scheduler->ticks == 0) return;
+    printf("cpu: %llu ticks, %llu instructions at %u Hz, %llu ticks late (worst %.2f ms), %llu dropped\n",
+           (unsigned long long)scheduler->ticks, (unsigned long long)scheduler->instructions, scheduler->cpuHz,
+           (unsigned long long)scheduler->lateTicks, scheduler->worstLateNs / 1e6,
+           (unsigned long long)scheduler->droppedTicks);
+    if (scheduler->skippedFrames) {
+        printf("turbo: %llu frames skipped\n", (unsigned long long)scheduler->skippedFrames);
+    }
+    if (scheduler->m->idleCycles) {
+        printf("idle: %llu instructions fast-forwarded (%.1f%%)\n", (unsigned long long)scheduler->m->idleCycles,
+               scheduler->m->idleCycles * 100.0 / scheduler->instructions);
+    }
+    const machine_t *m = scheduler->m;
+    if (m->keyLatencies) {
+        printf("keys: %llu changes seen, %.2f ms average from the keyboard to the rom, %.2f ms worst\n",
+               (unsigned long long)m->keyLatencies, m->keyLatencyTotalNs / 1e6 / m->keyLatencies, m->keyLatencyWorstNs / 1e6);
+    }
+    if (scheduler->parkedTicks) {
+        printf("fx0a: %llu ticks parked waiting for a key, %llu woken early by one\n",
+               (unsigned long long)scheduler->parkedTicks, (unsigned long long)scheduler->keyWakeups);
+    }
+}
 
-            if (((sprite[i] >> (7-j) & 0x0001) && frameBuffer[x+j][y+i])) {
-                v[0xF] = 1;
+double runHeadless(machine_t *m, uint64_t maxCycles, uint64_t maxFrames, rewind_t *history, input_log_t *replay) {
+    uint64_t cycles = 0, frames = 0;
+    int halted = 0;
+
+    // same pacing as mainLoop (timers tick every INSTRUCTIONS_PER_FRAME cycles), just no waiting
+    uint64_t start = nanoTime();
+    if (history == NULL && replay == NULL && m->profile == NULL && shmExport == NULL && capture == NULL
+        && debugger == NULL) {
+        halted = runUnpaced(m, maxCycles, maxFrames, &cycles, &frames) != 0;
+    } else { // a frame at a time, with input before and a snapshot (and the --shm frame) after each
+        uint64_t perFrame = replay != NULL ? replay->instructionsPerFrame : INSTRUCTIONS_PER_FRAME;
+        while (!halted && (maxCycles == 0 || cycles < maxCycles) && (maxFrames == 0 || frames < maxFrames)) {
+            uint64_t inputStart = nanoTime();
+            if (replay != NULL && replayFrame(replay, &m->keypad)) break;
+            if (replay == NULL && shmExport != NULL) m->keypad = shmKeypad(shmExport);
+            dumpProfile(0);
+            if (debugBreakRequested && debugger != NULL) {
+                debugBreakRequested = 0;
+                debugBreak(m, debugger);
             }
 
-            frameBuffer[x+j][y+i] ^= (sprite[i] >> (7-j)) & 0x0001;
-
+            uint64_t cpuStart = nanoTime();
+            uint64_t count = maxCycles == 0 || maxCycles - cycles > perFrame ? perFrame : maxCycles - cycles;
+            uint64_t ran = runCycles(m, (int)count);
+            cycles += ran;
+            if (debugger != NULL && atomic_load(&debugger->quit)) break;
+            halted = ran < count || m->stopped;
+            if (ran == perFrame) {
+                tickTimers(m);
+                frames++;
+            }
+            if (m->profile != NULL) profileFrame(m->profile, nanoTime() - cpuStart, 0, cpuStart - inputStart);
+            if (history != NULL) rewindPush(history, m);
+            if (shmExport != NULL) publishShmFrame(shmExport, m, cycles);
+            if (capture != NULL && (ran == perFrame || halted)) captureFrame(capture, &m->frameBuffer);
         }
     }
+    uint64_t elapsed = nanoTime() - start;
+    if (elapsed == 0) elapsed = 1;
+
+    if (halted) printf("rom stopped at PC = 0x%03x\n", (m->PC - 2) & m->memoryEnd);
+    printf("core:         %s (%s quirks)\n", coreName(m->core), quirksName(m->quirks));
+    printf("cycles:       %llu (%llu frames)\n", (unsigned long long)cycles, (unsigned long long)frames);
+    printf("time:         %.6f s\n", elapsed / 1e9);
+    printf("speed:        %.2f M instructions/s\n", cycles * 1e3 / elapsed);
+    printf("              %.2f ns/instruction\n", (double)elapsed / (cycles ? cycles : 1));
+    printf("frame hash:   0x%016llx\n", (unsigned long long)hashFrameBuffer(m));
+    if (m->idleCycles) {
+        printf("idle:         %llu instructions fast-forwarded (%.1f%%)\n", (unsigned long long)m->idleCycles,
+               cycles ? m->idleCycles * 100.0 / cycles : 0);
+    }
+    if (m->core == CORE_THREADED && m->fuse) {
+        // every instruction that ran needs a dispatch, except the ones inside a superinstruction
+        uint64_t ran = cycles - m->idleCycles;
+        printf("dispatches:   %llu for %llu instructions, %.1f%% saved by superinstructions\n",
+               (unsigned long long)(ran - m->fusedInstructions), (unsigned long long)ran,
+               ran ? m->fusedInstructions * 100.0 / ran : 0);
+    }
+    if (m->core == CORE_AOT) {
+        printf("aot:          %.1f%% of instructions native\n", cycles ? m->aotNativeInstructions * 100.0 / cycles : 0);
+    }
+#ifdef HAVE_JIT
+    if (m->core == CORE_JIT) {
+        printf("jit:          %llu blocks compiled, %llu flushes, %.1f%% of instructions native\n",
+               (unsigned long long)m->jitBlocksCompiled, (unsigned long long)m->jitFlushes,
+               cycles ? m->jitNativeInstructions * 100.0 / cycles : 0);
+    }
+#endif
+    if (replay != NULL)  printf("replay:       %llu frames of input (seed %llu)\n",
+                                (unsigned long long)replay->frames, (unsigned long long)replay->seed);
+    if (history != NULL) printRewindStats(history);
+    return cycles * 1e9 / elapsed;
 }
 
-void addHex() {
-    //character '0'
-    ram[0] = 0b11110000;
-    ram[1] = 0b10010000;
-    ram[2] = 0b10010000;
-    ram[3] = 0b10010000;
-    ram[4] = 0b11110000;
-
-    //character '1'
-    ram[5] = 0b00100000;
-    ram[6] = 0b01100000;
-    ram[7] = 0b00100000;
-    ram[8] = 0b00100000;
-    ram[9] = 0b01110000;
-
-    //character '2'
-    ram[10] = 0b11110000;
-    ram[11] = 0b00010000;
-    ram[12] = 0b11110000;
-    ram[13] = 0b10000000;
-    ram[14] = 0b11110000;
-
-    //character '3'
-    ram[15] = 0b11110000;
-    ram[16] = 0b00010000;
-    ram[17] = 0b11110000;
-    ram[18] = 0b00010000;
-    ram[19] = 0b11110000;
-
-    //character '4'
-    ram[20] = 0b10010000;
-    ram[21] = 0b10010000;
-    ram[22] = 0b11110000;
-    ram[23] = 0b00010000;
-    ram[24] = 0b00010000;
-
-    //character '5'
-    ram[25] = 0b11110000;
-    ram[26] = 0b10000000;
-    ram[27] = 0b11110000;
-    ram[28] = 0b00010000;
-    ram[29] = 0b11110000;
-
-    //character '6'
-    ram[30] = 0b11110000;
-    ram[31] = 0b10000000;
-    ram[32] = 0b11110000;
-    ram[33] = 0b10010000;
-    ram[34] = 0b11110000;
-
-    //character '7'
-    ram[35] = 0b11110000;
-    ram[36] = 0b00010000;
-    ram[37] = 0b00100000;
-    ram[38] = 0b01000000;
-    ram[39] = 0b01000000;
-
-    //character '8'
-    ram[40] = 0b11110000;
-    ram[41] = 0b10010000;
-    ram[42] = 0b11110000;
-    ram[43] = 0b10010000;
-    ram[44] = 0b11110000;
-
-    //character '9'
-    ram[45] = 0b11110000;
-    ram[46] = 0b10010000;
-    ram[47] = 0b11110000;
-    ram[48] = 0b00010000;
-    ram[49] = 0b00010000;
-
-    //character 'A'
-    ram[50] = 0b11110000;
-    ram[51] = 0b10010000;
-    ram[52] = 0b11110000;
-    ram[53] = 0b10010000;
-    ram[54] = 0b10010000;
-
-    //character 'B'
-    ram[55] = 0b11100000;
-    ram[56] = 0b10010000;
-    ram[57] = 0b11100000;
-    ram[58] = 0b10010000;
-    ram[59] = 0b11100000;
-
-    //character 'C'
-    ram[60] = 0b11110000;
-    ram[61] = 0b10000000;
-    ram[62] = 0b11110000;
-    ram[63] = 0b10000000;
-    ram[64] = 0b11110000;
-
-    //character 'D'
-    ram[65] = 0b11100000;
-    ram[66] = 0b10010000;
-    ram[67] = 0b10010000;
-    ram[68] = 0b10010000;
-    ram[69] = 0b11100000;
-
-    //character 'E'
-    ram[70] = 0b11110000;
-    ram[71] = 0b10000000;
-    ram[72] = 0b11110000;
-    ram[73] = 0b10000000;
-    ram[74] = 0b11110000;
-
-    //character 'F'
-    ram[75] = 0b11110000;
-    ram[76] = 0b10000000;
-    ram[77] = 0b11110000;
-    ram[78] = 0b10000000;
-    ram[79] = 0b10000000;
+int loadGame(machine_t *m, const char *path) {
+#ifdef CLIP8_AOT
+    if (strcmp(path, aotProgram.name) == 0) return loadRomImage(m, aotProgram.rom, aotProgram.romSize);
+#endif
+    return loadRom(m, path);
 }
 
-byte obtainKey() {
-    if (IsKeyDown(KEY_ONE))   return 0x1;
-    if (IsKeyDown(KEY_TWO))   return 0x2;
-    if (IsKeyDown(KEY_THREE)) return 0x3;
-    if (IsKeyDown(KEY_FOUR))  return 0xC;
+input_log_t *startReplay(machine_t *m, const char *path, const char *romPath) {
+    input_log_t *replay = openReplay(path);
+    if (replay == NULL) return NULL;
+
+    m->seed = replay->seed;
+    setQuirks(m, replay->quirks, replay->wrapSprites);
+    resetMachine(m);
+    if (loadGame(m, romPath) || !replayMatches(replay, m)) {
+        printf("%s was recorded with a different rom\n", path);
+        closeInputLog(replay);
+        return NULL;
+    }
+    return replay;
+}
 
-    if (IsKeyDown(KEY_Q))     return 0x4;
-    if (IsKeyDown(KEY_W))     return 0x5;
-    if (IsKeyDown(KEY_E))     return 0x6;
-    if (IsKeyDown(KEY_R))     return 0xD;
+void requestDebugBreak(int signal) {
+    (void)signal;
+    debugBreakRequested = 1;
+}
 
-    if (IsKeyDown(KEY_A))     return 0x7;
-    if (IsKeyDown(KEY_S))     return 0x8;
-    if (IsKeyDown(KEY_D))     return 0x9;
-    if (IsKeyDown(KEY_F))     return 0xE;
+void requestProfileDump(int signal) {
+    (void)signal;
+    profileDumpRequested = 1;
+}
 
-    if (IsKeyDown(KEY_Z))     return 0xA;
-    if (IsKeyDown(KEY_X))     return 0x0;
-    if (IsKeyDown(KEY_C))     return 0xB;
-    if (IsKeyDown(KEY_V))     return 0xF;
+void dumpProfile(int force) {
+    if (profile == NULL || !(force || profileDumpRequested)) return;
+    profileDumpRequested = 0;
+    if (writeProfileJson(profile, profilePath) == 0) printf("profile written to %s\n", profilePath);
+}
 
-    return 0xFF; // No key pressed
+void printRewindStats(const rewind_t *history) {
+    if (history->pushes == 0) return;
+    printf("rewind:       %d frames held in %.2f MB, %.1f bytes/frame average, %.2f us per snapshot\n",
+           rewindFrames(history), rewindBytes(history) / 1048576.0,
+           (double)history->bytesPushed / history->pushes, history->pushNs / 1e3 / history->pushes);
 }
 
+int runBatchRoms(char *roms[], int romCount, int instances, const batch_config_t *config) {
+    // every rom is read once and shared by all of its instances
+    uint8_t *images[BATCH_MAX_ROMS];
+    size_t sizes[BATCH_MAX_ROMS];
+    for (int r = 0; r < romCount; r++) {
+        images[r] = readRomFile(roms[r], &sizes[r]);
+        if (images[r] == NULL) {
+            while (r--) free(images[r]);
+            return 1;
+        }
+    }
 
-//######## DEBUGGING FUNCTIONS #######
-void printRam() {
-    for (int i = 0; i < RAM_SIZE; i++) {
-        printf("%c", ram[i]);
+    int jobCount = romCount * instances;
+    batch_job_t *jobs = calloc(jobCount, sizeof(batch_job_t));
+    if (jobs == NULL) return 1;
+    for (int j = 0; j < jobCount; j++) {
+        jobs[j].name     = roms[j / instances];
+        jobs[j].rom      = images[j / instances];
+        jobs[j].romSize  = sizes[j / instances];
+        jobs[j].instance = j % instances;
     }
-}
 
-void printDecoded() {
-    for (int i = 0; i < RAM_SIZE; i += 2) {
-        uint16_t instruction = ram[i] << 8 | ram[i + 1];
-        if (i == PROGRAM_START) {
-            printf("PROM_START: ");
+    batch_stats_t stats;
+    int result = runBatch(jobs, jobCount, config, &stats);
+    if (result == 0) {
+        printf("job    inst  hash                cycles        status   rom\n");
+        for (int j = 0; j < jobCount; j++) {
+            printf("%-6d %-5d 0x%016llx  %-12llu  %-7s  %s\n", j, jobs[j].instance,
+                   (unsigned long long)jobs[j].hash, (unsigned long long)jobs[j].cycles,
+                   jobs[j].failed ? "failed" : jobs[j].halted ? "stopped" : "ok", jobs[j].name);
+            if (jobs[j].failed) result = 1;
         }
-        printf("%d  ", decodeInstruction(instruction));
+        uint64_t elapsed = stats.elapsedNs ? stats.elapsedNs : 1;
+        printf("\ncore:         %s (%s quirks)\n", coreName(config->core), quirksName(config->quirks));
+        printf("jobs:         %d on %d threads, %llu steals\n", jobCount, stats.threads,
+               (unsigned long long)stats.steals);
+        printf("time:         %.6f s\n", elapsed / 1e9);
+        printf("throughput:   %.2f M instructions/s total\n", stats.totalCycles * 1e3 / elapsed);
     }
+
+    free(jobs);
+    for (int r = 0; r < romCount; r++) free(images[r]);
+    return result != 0;
 }
 
-void printCPU() {
-    for (int i = 0; i < 0x10; i++) {
-        printf("Register v[%d] = 0x%x\n", i, v[i]);
+int runLockstepRoms(char *roms[], int romCount, int instances, const batch_config_t *config) {
+    machine_t *m = createMachine(config->core);
+    uint64_t *hashes = malloc(sizeof(uint64_t) * instances);
+    uint64_t *cycles = malloc(sizeof(uint64_t) * instances);
+    uint8_t  *halted = malloc(instances);
+    if (m == NULL || hashes == NULL || cycles == NULL || halted == NULL) {
+        destroyMachine(m); free(hashes); free(cycles); free(halted);
+        return 1;
     }
-    printf("PC = 0x%x\n", PC);
-    printf("I = 0x%x\n", I);
-    printf("SP = 0x%x\n", SP);
-    printf("DT = 0x%x\n", DT);
-    printf("ST = 0x%x\n", ST);
+    setQuirks(m, config->quirks, config->wrapSprites);
+    m->skipIdle = config->skipIdle;
+
+    int result = 0;
+    printf("rom                   inst  mismatches  lockstep M/s  scalar M/s  speedup  vector   split    splits\n");
+    for (int r = 0; r < romCount && result == 0; r++) {
+        size_t size;
+        uint8_t *rom = readRomFile(roms[r], &size);
+        if (rom == NULL) { result = 1; break; }
+
+        // lockstep, LOCKSTEP_LANES instances at a time
+        uint64_t laneCycles = 0, vector = 0, lane = 0, split = 0, splits = 0;
+        uint64_t start = nanoTime();
+        for (int first = 0; first < instances && result == 0; first += LOCKSTEP_LANES) {
+            int lanes = instances - first < LOCKSTEP_LANES ? instances - first : LOCKSTEP_LANES;
+            lockstep_t *g = createLockstep(rom, size, lanes, config->quirks, config->wrapSprites);
+            if (g == NULL) { result = 1; break; }
+            for (int l = 0; l < lanes; l++) setLaneSeed(g, l, config->seed + first + l);
+            runLockstep(g, config->maxCycles, config->maxFrames);
+            for (int l = 0; l < lanes; l++) {
+                hashes[first + l] = laneHash(g, l);
+                cycles[first + l] = g->cycles[l];
+                halted[first + l] = laneStopped(g, l);
+                laneCycles += g->cycles[l];
+            }
+            vector += g->vectorInstructions;
+            lane   += g->laneInstructions;
+            split  += g->splitInstructions;
+            splits += g->splits;
+            destroyLockstep(g);
+        }
+        uint64_t lockstepNs = nanoTime() - start;
+
+        // the same instances on their own machines
+        int mismatches = 0;
+        uint64_t scalarCycles = 0;
+        start = nanoTime();
+        for (int k = 0; k < instances && result == 0; k++) {
+            uint64_t ran, frames;
+            m->seed = config->seed + k;
+            resetMachine(m);
+            if (loadRomImage(m, rom, size)) { result = 1; break; }
+            int stopped = runUnpaced(m, config->maxCycles, config->maxFrames, &ran, &frames) != 0;
+            scalarCycles += ran;
+            if (ran != cycles[k] || stopped != halted[k] || hashFrameBuffer(m) != hashes[k]) mismatches++;
+        }
+        uint64_t scalarNs = nanoTime() - start;
+        free(rom);
+        if (result) break;
+        if (mismatches) result = 1;
+
+        double lockstepRate = laneCycles * 1e3 / (lockstepNs ? lockstepNs : 1);
+        double scalarRate = scalarCycles * 1e3 / (scalarNs ? scalarNs : 1);
+        uint64_t total = vector + lane ? vector + lane : 1;
+        printf("%-20.20s  %-4d  %-10d  %-12.2f  %-10.2f  %-7.2f  %5.1f%%  %5.1f%%   %llu\n", roms[r], instances, mismatches,
+               lockstepRate, scalarRate, scalarRate > 0 ? lockstepRate / scalarRate : 0,
+               vector * 100.0 / total, split * 100.0 / total, (unsigned long long)splits);
+    }
+    printf("\nlockstep:     %d lanes a group, %s vectors\n", LOCKSTEP_LANES, lockstepVectorName());
+    printf("scalar:       %s core (%s quirks)%s\n", coreName(m->core), quirksName(config->quirks),
+           config->skipIdle ? ", idle loops fast-forwarded" : "");
+
+    destroyMachine(m);
+    free(hashes); free(cycles); free(halted);
+    return result;
 }
 
+//######## DEBUGGING FUNCTIONS #######
 void testScreen() {
     Color sqr;
     BeginDrawing();
@@ -625,9 +936,3 @@ void testScreen() {
     }
     EndDrawing();
 }
-
-void printStack() {
-    for (int i = 0; i < STACK_SIZE / 2; i++) {
-        printf("stack[%d] : %x \n", i, stack[i]);
-    }
-}
\ No newline at end of file
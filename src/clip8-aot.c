@@ -0,0 +1,366 @@
+#include "chip8.h"
+
+// clip8-aot: translates a rom to C ahead of time. The output defines the aot_program_t that aot.c runs,
+// see aot.h for how it fits together
+//
+// usage: clip8-aot game.ch8 [-o game.c] [--quirks clip8|vip|chip48|schip|xochip] [--wrap]
+
+// ##########  ANALYSIS  ##########
+// what can be reached from 0x200 by following every jump, call, return site and skip. RET and Bnnn go
+// where the stack or a register says, so their targets are only translated if something else reaches them
+
+typedef struct {
+    uint8_t   ram[RAM_SIZE];
+    size_t    romSize;
+    decoded_t code[RAM_SIZE / 2];
+    uint8_t   reachable[RAM_SIZE / 2];
+    uint8_t   leader[RAM_SIZE / 2];     // something jumps, calls, returns or skips here
+    uint16_t  block[RAM_SIZE / 2];      // the block every translated instruction is in
+    unsigned  quirks;                   // QUIRK_ bits the code is for
+    uint16_t  memoryEnd;                // MEMORY_MASK() of them
+} translation_t;
+
+// instructions that never get translated: they stop the rom, write RAM (which may be code), wait for a key
+// or are 4 bytes long (F000 nnnn, a rewrite of its second word wouldn't make its block stale)
+static int interpreterOnly(opcode_t op) {
+    return op == ROM_END || op == ILLEGAL || op == SYS || op == EXIT || op == LDIVX || op == LDBVX || op == SAVE
+        || op == LDK || op == LDILONG;
+}
+
+// instructions that end a block, leaving the next PC for the dispatcher
+static int endsBlock(opcode_t op) {
+    switch (op) {
+        case RET: case JPADR: case CALL: case JPREG:
+        case SEIMM: case SNE: case SEREG: case SNEREG: case SKP: case SKNP:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int inRom(const translation_t *t, int address) {
+    return address >= PROGRAM_START && (size_t)(address - PROGRAM_START) < t->romSize;
+}
+
+static int translated(const translation_t *t, int address) {
+    return inRom(t, address) && !(address & 1) && t->reachable[address >> 1]
+           && !interpreterOnly(t->code[address >> 1].opcode);
+}
+
+static void findReachable(translation_t *t) {
+    static uint16_t pending[RAM_SIZE * 2];
+    int top = 0;
+    pending[top++] = PROGRAM_START;
+    t->leader[PROGRAM_START >> 1] = 1;
+
+    while (top > 0) {
+        int address = pending[--top];
+        if ((address & 1) || !inRom(t, address) || t->reachable[address >> 1]) continue;
+        t->reachable[address >> 1] = 1;
+
+        const decoded_t *d = &t->code[address >> 1];
+        int next[3] = { -1, -1, -1 }, targets = 0; // targets start blocks, plain fallthrough doesn't
+        switch (d->opcode) {
+            case ROM_END: case ILLEGAL: case SYS: case EXIT: case RET: case JPREG:
+                break;
+            case JPADR:
+                next[0] = d->nnn; targets = 1;
+                break;
+            case CALL:
+                next[0] = d->nnn; next[1] = address + 2; targets = 2;
+                break;
+            case SEIMM: case SNE: case SEREG: case SNEREG: case SKP: case SKNP:
+                next[0] = address + 2; next[1] = address + 4; targets = 2;
+                if (t->quirks & QUIRK_LONG_SKIP) next[targets++] = address + 6; // over an F000 nnnn
+                break;
+            case LDIVX: case LDBVX: case SAVE: case LDK: // back from the interpreter here
+                next[0] = address + 2; targets = 1;
+                break;
+            case LDILONG:
+                next[0] = address + 4; targets = 1;
+                break;
+            default:
+                next[0] = address + 2;
+                break;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (next[k] < 0 || next[k] >= RAM_SIZE) continue;
+            if (k < targets && !(next[k] & 1)) t->leader[next[k] >> 1] = 1;
+            if (top < (int)(sizeof(pending) / sizeof(pending[0]))) pending[top++] = next[k];
+        }
+    }
+}
+
+// splits the translated instructions into blocks: each one starts at a leader or after anything that
+// isn't translated, and runs up to an instruction that ends it. Returns how many there are
+static int findBlocks(translation_t *t) {
+    int blocks = 0, start = -1;
+    for (int a = PROGRAM_START; a < RAM_SIZE; a += 2) {
+        if (!translated(t, a)) {
+            start = -1;
+            continue;
+        }
+        if (start < 0 || t->leader[a >> 1]) {
+            start = a;
+            blocks++;
+        }
+        t->block[a >> 1] = start;
+        if (endsBlock(t->code[a >> 1].opcode)) start = -1;
+    }
+    return blocks;
+}
+
+
+// ##########  CODE GENERATION  ##########
+
+// V registers an instruction reads or writes, as a bitmask
+static unsigned registersUsed(const translation_t *t, const decoded_t *d) {
+    unsigned x = 1u << d->x, y = 1u << d->y, vf = 1u << 0xF;
+    switch (d->opcode) {
+        case SEIMM: case SNE: case LDIMM: case ADDIMM: case RND: case SKP: case SKNP:
+        case LDREGDT: case LDDTVX: case LDSTVX: case ADDIVX: case LDFVX: case LDHF: case PITCH:
+            return x;
+        case SEREG: case SNEREG: case LDI:
+            return x | y;
+        case OR: case AND: case XOR:
+            return x | y | (t->quirks & QUIRK_VF_RESET ? vf : 0);
+        case ADDREG: case SUB: case SHR: case SUBN: case SHL: case DRW:
+            return x | y | vf;
+        case JPREG:
+            return t->quirks & QUIRK_JUMP_VX ? x : 1u;
+        case LDVXI: case LDRVX: case LDVXR:
+            return (2u << d->x) - 1;
+        case LOAD: // Vx to Vy, either way round
+            return d->x <= d->y ? (2u << d->y) - (1u << d->x) : (2u << d->x) - (1u << d->y);
+        default:
+            return 0;
+    }
+}
+
+static int usesI(opcode_t op) {
+    return op == LD || op == ADDIVX || op == LDFVX || op == DRW || op == LDVXI || op == LDHF || op == LOAD
+        || op == AUDIO;
+}
+
+// the C for one instruction at address. Control transfers set pc
+static void emitInstruction(FILE *out, const translation_t *t, const decoded_t *d, int address) {
+    int x = d->x, y = d->y, kk = d->kk, nnn = d->nnn;
+    int shifted = t->quirks & QUIRK_SHIFT_VY ? y : x;
+    const char *vfReset = t->quirks & QUIRK_VF_RESET ? " vF = 0;" : "";
+
+    // where a skip goes when it's taken: with QUIRK_LONG_SKIP that depends on the word it skips, which is found
+    // with all the quirks (QUIRK_RAM_64K says where it wraps)
+    char taken[64];
+    if (t->quirks & QUIRK_LONG_SKIP) snprintf(taken, sizeof(taken), "0x%03X + skipLength(m->ram, 0x%03X, 0x%X)", address, address, t->quirks);
+    else                             snprintf(taken, sizeof(taken), "0x%03X", address + 4);
+
+    switch (d->opcode) {
+        case CLS:    fprintf(out, "clearFrameBuffer(m);"); break;
+        case RET:    fprintf(out, "pc = m->stack[m->SP & (STACK_SIZE - 1)] + 2; m->SP--;"); break;
+        case JPADR:  fprintf(out, "pc = 0x%03X;", nnn); break;
+        case CALL:   fprintf(out, "m->SP++; m->stack[m->SP & (STACK_SIZE - 1)] = 0x%03X; pc = 0x%03X;", address, nnn); break;
+        case SEIMM:  fprintf(out, "pc = v%X == 0x%02X ? %s : 0x%03X;", x, kk, taken, address + 2); break;
+        case SNE:    fprintf(out, "pc = v%X != 0x%02X ? %s : 0x%03X;", x, kk, taken, address + 2); break;
+        case SEREG:  fprintf(out, "pc = v%X == v%X ? %s : 0x%03X;", x, y, taken, address + 2); break;
+        case SNEREG: fprintf(out, "pc = v%X != v%X ? %s : 0x%03X;", x, y, taken, address + 2); break;
+        case LDIMM:  fprintf(out, "v%X = 0x%02X;", x, kk); break;
+        case ADDIMM: fprintf(out, "v%X += 0x%02X;", x, kk); break;
+        case LDI:    fprintf(out, "v%X = v%X;", x, y); break;
+        case OR:     fprintf(out, "v%X |= v%X;%s", x, y, vfReset); break;
+        case AND:    fprintf(out, "v%X &= v%X;%s", x, y, vfReset); break;
+        case XOR:    fprintf(out, "v%X ^= v%X;%s", x, y, vfReset); break;
+        case ADDREG: fprintf(out, "{ unsigned r = v%X + v%X; v%X = r; vF = r > 0xFF; }", x, y, x); break;
+        case SUB:    fprintf(out, "{ unsigned r = v%X - v%X; v%X = r; vF = (r & 0xFF00) == 0; }", x, y, x); break;
+        case SHR:    fprintf(out, "{ uint8_t f = v%X; v%X = f >> 1; vF = f & 0x01; }", shifted, x); break;
+        case SUBN:   fprintf(out, "v%X = v%X - v%X; vF = v%X > v%X;", x, y, x, y, x); break;
+        case SHL:    fprintf(out, "{ uint8_t f = v%X; v%X = f << 1; vF = f >> 7; }", shifted, x); break;
+        case LD:     fprintf(out, "I = 0x%03X;", nnn); break;
+        case JPREG:  fprintf(out, "pc = 0x%03X + v%X;", nnn, t->quirks & QUIRK_JUMP_VX ? x : 0); break;
+        case RND:    fprintf(out, "v%X = randomByte(m) & 0x%02X;", x, kk); break;
+        case DRW:    // drawSpriteToFramebuffer() takes its operands from the machine
+                     fprintf(out, "m->v[0x%X] = v%X; m->v[0x%X] = v%X; m->I = I; "
+                                  "drawSpriteToFramebuffer(m, &m->decodeCache[0x%03X >> 1]); vF = m->v[0xF];",
+                             x, x, y, y, address);
+                     break;
+        case SKP:    fprintf(out, "pc = readKeypad(m) >> (v%X & 0xF) & 1 ? %s : 0x%03X;", x, taken, address + 2); break;
+        case SKNP:   fprintf(out, "pc = readKeypad(m) >> (v%X & 0xF) & 1 ? 0x%03X : %s;", x, address + 2, taken); break;
+        case LDREGDT:fprintf(out, "v%X = m->DT;", x); break;
+        case LDDTVX: fprintf(out, "m->DT = v%X;", x); break;
+        case LDSTVX: fprintf(out, "m->ST = v%X;", x); break;
+        case ADDIVX: fprintf(out, "I += v%X;", x); break;
+        case LDFVX:  fprintf(out, "I = v%X * 5;", x); break;
+        case LDVXI:  for (int i = 0; i <= x; i++) fprintf(out, "v%X = m->ram[(I + %d) & 0x%X]; ", i, i, t->memoryEnd);
+                     if (t->quirks & QUIRK_LOAD_I)   fprintf(out, "I += %d;", x + 1);
+                     if (t->quirks & QUIRK_LOAD_I_X) fprintf(out, "I += %d;", x);
+                     break;
+        case SCD:    fprintf(out, "scrollDown(&m->frameBuffer, %d); m->screenDirty = 1;", d->n); break;
+        case SCU:    fprintf(out, "scrollUp(&m->frameBuffer, %d); m->screenDirty = 1;", d->n); break;
+        case SCR:    fprintf(out, "scrollRight(&m->frameBuffer); m->screenDirty = 1;"); break;
+        case SCL:    fprintf(out, "scrollLeft(&m->frameBuffer); m->screenDirty = 1;"); break;
+        case LOW:    fprintf(out, "setResolution(&m->frameBuffer, 0); m->screenDirty = 1;"); break;
+        case HIGH:   fprintf(out, "setResolution(&m->frameBuffer, 1); m->screenDirty = 1;"); break;
+        case PLANE:  fprintf(out, "m->frameBuffer.planes = %d;", x & 3); break;
+        case AUDIO:  fprintf(out, "for (int i = 0; i < AUDIO_PATTERN_SIZE; i++) m->audioPattern[i] = m->ram[(I + i) & 0x%X];", t->memoryEnd);
+                     break;
+        case PITCH:  fprintf(out, "m->pitch = v%X;", x); break;
+        case LDHF:   fprintf(out, "I = BIG_FONT_START + (v%X & 0xF) * 10;", x); break;
+        case LDRVX:  for (int i = 0; i <= x; i++) fprintf(out, "m->rpl[%d] = v%X; ", i, i); break;
+        case LDVXR:  for (int i = 0; i <= x; i++) fprintf(out, "v%X = m->rpl[%d]; ", i, i); break;
+        case LOAD:   for (int i = 0, step = x <= y ? 1 : -1; i <= (x <= y ? y - x : x - y); i++) {
+                         fprintf(out, "v%X = m->ram[(I + %d) & 0x%X]; ", x + i * step, i, t->memoryEnd);
+                     }
+                     break;
+        default:     break; // interpreterOnly(), never part of a block
+    }
+}
+
+// one C function per block. It can be entered at any of its instructions, so a run that ran out of
+// budget in the middle of it picks up again in native code
+static void emitBlock(FILE *out, const translation_t *t, int start) {
+    int end = start;
+    unsigned registers = 0;
+    int needsI = 0;
+    while (end < RAM_SIZE && translated(t, end) && t->block[end >> 1] == start) {
+        registers |= registersUsed(t, &t->code[end >> 1]);
+        needsI |= usesI(t->code[end >> 1].opcode);
+        end += 2;
+    }
+
+    fprintf(out, "// 0x%03X - 0x%03X\n", start, end - 2);
+    fprintf(out, "static uint16_t block_%03X(machine_t *m, uint16_t pc, int *budget) {\n", start);
+    for (int r = 0; r < 0x10; r++) {
+        if (registers & (1u << r)) fprintf(out, "    uint8_t v%X = m->v[0x%X];\n", r, r);
+    }
+    if (needsI) fprintf(out, "    uint16_t I = m->I;\n");
+    fprintf(out, "    int n = *budget;\n\n");
+
+    fprintf(out, "    switch (pc) {\n");
+    for (int a = start; a < end; a += 2) fprintf(out, "        case 0x%03X: goto a%03X;\n", a, a);
+    fprintf(out, "        default: return pc; // not in this block\n    }\n\n");
+
+    for (int a = start; a < end; a += 2) {
+        const decoded_t *d = &t->code[a >> 1];
+        fprintf(out, "a%03X: /* %04X %-7s */ ", a, d->instruction, opcodeName(d->opcode));
+        emitInstruction(out, t, d, a);
+        if (endsBlock(d->opcode))  fprintf(out, "\n      n--; goto out;\n");
+        else if (a + 2 == end)     fprintf(out, "\n      pc = 0x%03X; n--; goto out;\n", a + 2);
+        else                       fprintf(out, "\n      if (--n == 0) { pc = 0x%03X; goto out; }\n", a + 2);
+    }
+
+    fprintf(out, "\nout:\n");
+    for (int r = 0; r < 0x10; r++) {
+        if (registers & (1u << r)) fprintf(out, "    m->v[0x%X] = v%X;\n", r, r);
+    }
+    if (needsI) fprintf(out, "    m->I = I;\n");
+    fprintf(out, "    *budget = n;\n    return pc;\n}\n\n");
+}
+
+static void emitProgram(FILE *out, const translation_t *t, const char *name, quirks_t quirks, int wrapSprites) {
+    fprintf(out, "// generated by clip8-aot from %s, don't edit\n"
+                 "#include \"aot.h\"\n\n", name);
+
+    fprintf(out, "static const uint8_t rom[%zu] = {", t->romSize);
+    for (size_t i = 0; i < t->romSize; i++) {
+        fprintf(out, "%s0x%02X,", i % 16 == 0 ? "\n    " : " ", t->ram[PROGRAM_START + i]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    for (int a = PROGRAM_START; a < RAM_SIZE; a += 2) {
+        if (translated(t, a) && t->block[a >> 1] == a) emitBlock(out, t, a);
+    }
+
+    fprintf(out, "static const aot_entry_t entries[RAM_SIZE / 2] = {\n");
+    for (int a = PROGRAM_START; a < RAM_SIZE; a += 2) {
+        if (translated(t, a)) fprintf(out, "    [0x%03X >> 1] = { block_%03X, 0x%03X },\n", a, t->block[a >> 1], t->block[a >> 1]);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "const aot_program_t aotProgram = {\n"
+                 "    .name = \"%s\",\n"
+                 "    .rom = rom,\n"
+                 "    .romSize = sizeof(rom),\n"
+                 "    .quirks = %d, // %s\n"
+                 "    .wrapSprites = %d,\n"
+                 "    .entries = entries,\n"
+                 "};\n", name, quirks, quirksName(quirks), wrapSprites);
+}
+
+
+// ######################################
+// ########## FUNCTION BODIES ###########
+// ######################################
+int main(int argc, char *argv[]) {
+    const char *romPath = NULL, *outPath = NULL;
+    quirks_t quirks = QUIRKS_CLIP8;
+    int wrapSprites = 0;
+    for (int i = 1; i < argc; i++) {
+        if      (strcmp(argv[i], "-o") == 0 && i + 1 < argc)  outPath = argv[++i];
+        else if (strcmp(argv[i], "--wrap") == 0)              wrapSprites = 1;
+        else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            int parsed = parseQuirks(argv[++i]);
+            if (parsed < 0) { fprintf(stderr, "Unknown quirks %s\n", argv[i]); return 1; }
+            quirks = parsed;
+        }
+        else if (argv[i][0] != '-' && romPath == NULL)        romPath = argv[i];
+        else {
+            fprintf(stderr, "usage: %s game.ch8 [-o game.c] [--quirks clip8|vip|chip48|schip|xochip] [--wrap]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (romPath == NULL) {
+        fprintf(stderr, "usage: %s game.ch8 [-o game.c] [--quirks clip8|vip|chip48|schip|xochip] [--wrap]\n", argv[0]);
+        return 1;
+    }
+
+    static translation_t t;
+    machine_t *m = createMachine(CORE_SWITCH); // only to ask which QUIRK_ bits the profile has
+    if (m == NULL) return 1;
+    setQuirks(m, quirks, wrapSprites);
+    t.quirks = m->quirkBits;
+    t.memoryEnd = m->memoryEnd;
+    destroyMachine(m);
+
+    uint8_t *rom = readRomFile(romPath, &t.romSize);
+    if (rom == NULL) return 1;
+    if (t.romSize == 0 || t.romSize > t.memoryEnd + 1u - PROGRAM_START) {
+        fprintf(stderr, "%s is not a rom that fits in memory\n", romPath);
+        free(rom);
+        return 1;
+    }
+    memcpy(&t.ram[PROGRAM_START], rom, t.romSize);
+    free(rom);
+    for (int a = 0; a < RAM_SIZE; a += 2) {
+        t.code[a >> 1] = decodeWord(t.ram[a] << 8 | t.ram[(a + 1) & MEMORY_END]);
+    }
+
+    findReachable(&t);
+    int blocks = findBlocks(&t);
+
+    // the rom's file name, safe to put in a C string
+    const char *base = strrchr(romPath, '/');
+    base = base ? base + 1 : romPath;
+    char name[256];
+    snprintf(name, sizeof(name), "%s", base);
+    for (char *c = name; *c; c++) {
+        if (*c == '"' || *c == '\\' || *c < ' ') *c = '_';
+    }
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (out == NULL) {
+        perror("Error opening output");
+        return 1;
+    }
+    emitProgram(out, &t, name, quirks, wrapSprites);
+    if (out != stdout && fclose(out) != 0) {
+        perror("Error writing output");
+        return 1;
+    }
+
+    int reachable = 0, native = 0;
+    for (int a = PROGRAM_START; a < RAM_SIZE; a += 2) {
+        reachable += inRom(&t, a) && t.reachable[a >> 1];
+        native += translated(&t, a);
+    }
+    fprintf(stderr, "%s: %d blocks, %d of %d reachable instructions translated\n", name, blocks, native, reachable);
+    return 0;
+}
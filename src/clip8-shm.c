@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <time.h>
+#include "shm.h"
+
+// ##########  SHARED MEMORY READER  ##########
+// reads what `Clip-8 --shm NAME` publishes, to try the export out or to drive a rom from a script:
+//   clip8-shm NAME                      prints the newest frame, registers and screen
+//   clip8-shm NAME --follow [--frames N] a line per frame as they come, then how many reads had to be retried
+//   clip8-shm NAME --keypad 0x0020      holds key 5 down (0 lets go), alone or with the others
+// Everything is read in place from the mapping and thrown away if the seqlock says a frame was written meanwhile
+
+#define POLL_NS 500000  // between looks at the sequence while following
+
+static void sleepNs(long ns) {
+    struct timespec t = { 0, ns };
+    nanosleep(&t, NULL);
+}
+
+// the screen as text, # for plane 1, o for plane 2, @ for both. Hi-res is halved vertically to fit a terminal
+static size_t renderScreen(const frame_buffer_t *f, char *out) {
+    static const char shades[4] = { ' ', '#', 'o', '@' };
+    int width = f->hires ? HIRES_WIDTH : SCREEN_WIDTH, height = f->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    size_t n = 0;
+    for (int y = 0; y < height; y += f->hires ? 2 : 1) {
+        for (int x = 0; x < width; x++) {
+            int w = x >> 6, bit = 63 - (x & 63), pixel = 0;
+            for (int row = y; row < y + (f->hires ? 2 : 1); row++) {
+                pixel |= (f->rows[0][row][w] >> bit & 1) | (f->rows[1][row][w] >> bit & 1) << 1;
+            }
+            out[n++] = shades[pixel];
+        }
+        out[n++] = '\n';
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = NULL;
+    int follow = 0, setKeypad = 0;
+    uint64_t maxFrames = 0;
+    unsigned long keypad = 0;
+    for (int i = 1; i < argc; i++) {
+        if      (strcmp(argv[i], "--follow") == 0)                    follow = 1;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)    maxFrames = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--keypad") == 0 && i + 1 < argc)    keypad = strtoul(argv[++i], NULL, 0), setKeypad = 1;
+        else if (argv[i][0] != '-' && name == NULL)                   name = argv[i];
+        else {
+            printf("usage: %s NAME [--follow [--frames N]] [--keypad BITS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (name == NULL) {
+        printf("usage: %s NAME [--follow [--frames N]] [--keypad BITS]\n", argv[0]);
+        return 1;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0) {
+        printf("No shared memory segment %s, is Clip-8 running with --shm %s?\n", path, name);
+        return 1;
+    }
+    void *mapping = mmap(NULL, sizeof(shm_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("Couldn't map %s\n", path);
+        return 1;
+    }
+    shm_segment_t *s = mapping;
+    if (s->magic != SHM_MAGIC || s->version != SHM_VERSION || s->size != sizeof(shm_segment_t)) {
+        printf("%s isn't a Clip-8 export this reader understands (version %u, %u bytes)\n", path, s->version, s->size);
+        return 1;
+    }
+
+    if (setKeypad) {
+        atomic_store_explicit(&s->keypad, (uint16_t)keypad, memory_order_relaxed);
+        printf("keypad set to 0x%04lx\n", keypad & 0xFFFF);
+        if (!follow) return 0;
+    }
+
+    if (!follow) {
+        static char screen[(HIRES_WIDTH + 1) * HIRES_HEIGHT + 1];
+        char registers[512];
+        uint32_t sequence;
+        int retries = -1;
+        do {
+            retries++;
+            sequence = shmReadBegin(s);
+            int n = snprintf(registers, sizeof(registers),
+                             "frame %llu, %llu instructions, %s quirks%s%s\n"
+                             "PC %03X  I %03X  SP %X  DT %02X  ST %02X  hash 0x%016llx\n",
+                             (unsigned long long)s->frame, (unsigned long long)s->instructions,
+                             quirksName((quirks_t)s->quirks), s->stopped ? ", stopped" : "",
+                             s->waitingForKey ? ", waiting for a key" : "",
+                             s->PC, s->I, s->SP, s->DT, s->ST, (unsigned long long)hashFrame(&s->screen));
+            for (int r = 0; r < 0x10; r++) {
+                n += snprintf(registers + n, sizeof(registers) - n, "V%X %02X%s", r, s->v[r], r % 8 == 7 ? "\n" : "  ");
+            }
+            screen[renderScreen(&s->screen, screen)] = '\0';
+        } while (shmReadRetry(s, sequence));
+        printf("%s%s", registers, screen);
+        if (retries) printf("(%d reads retried)\n", retries);
+        return 0;
+    }
+
+    // a line per frame. The writer never waits, so a slow terminal misses frames rather than holding anything up
+    uint64_t frames = 0, retries = 0, missed = 0, lastFrame = 0;
+    int gone = 0;
+    uint32_t seen = atomic_load_explicit(&s->sequence, memory_order_acquire) & ~1u;
+    while (maxFrames == 0 || frames < maxFrames) {
+        if (atomic_load_explicit(&s->sequence, memory_order_acquire) == seen) {
+            if (!atomic_load_explicit(&s->running, memory_order_relaxed)) break;
+            if (kill((pid_t)s->writerPid, 0) != 0 && errno == ESRCH) { gone = 1; break; } // killed before it could say so
+            sleepNs(POLL_NS);
+            continue;
+        }
+
+        uint64_t frame, instructions, hash;
+        uint16_t pc, I;
+        uint8_t dt, st;
+        uint32_t sequence;
+        for (;;) {
+            sequence = shmReadBegin(s);
+            frame = s->frame;
+            instructions = s->instructions;
+            pc = s->PC;
+            I = s->I;
+            dt = s->DT;
+            st = s->ST;
+            hash = hashFrame(&s->screen);
+            if (!shmReadRetry(s, sequence)) break;
+            retries++;
+        }
+        seen = sequence;
+        if (lastFrame && frame > lastFrame + 1) missed += frame - lastFrame - 1;
+        lastFrame = frame;
+        frames++;
+        printf("frame %8llu  %10llu instructions  PC %03X  I %03X  DT %02X  ST %02X  hash 0x%016llx\n",
+               (unsigned long long)frame, (unsigned long long)instructions, pc, I, dt, st, (unsigned long long)hash);
+    }
+    printf("%llu frames read, %llu missed, %llu reads retried%s\n", (unsigned long long)frames,
+           (unsigned long long)missed, (unsigned long long)retries,
+           gone ? ", the emulator is gone" : atomic_load(&s->running) ? "" : ", the emulator closed the export");
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+#include "debugger.h"
+
+// ##########  TRACE READER  ##########
+// answers questions about what `Clip-8 --trace FILE` recorded, straight from the mapped file (it can still be running):
+//   clip8-trace FILE                           how much it holds, and the last 20 instructions
+//   clip8-trace FILE --last N [--before ADDR]  the last N instructions, or the N leading up to the last time PC was ADDR
+//   clip8-trace FILE --reg V0-VF|I [--last N]  every change of a register, the last N of them (50)
+//   clip8-trace FILE --loops [N]               the N loops that went round the most (10), by backward jumps taken
+// Instructions are numbered from the start of the trace, addresses are hex
+
+#define LOOP_SLOTS 65536   // distinct backward jumps the loop count keeps track of
+
+typedef struct {
+    const trace_header_t *header;
+    const trace_record_t *records;
+    uint64_t first, end;            // the instructions still in the ring, [first, end)
+} trace_file_t;
+
+typedef struct {
+    uint16_t from, to;              // the jump back, to <= from
+    uint64_t taken;
+    uint64_t instructions;          // run from each landing on to until the jump back, over all iterations
+} loop_t;
+
+static const trace_record_t *recordAt(const trace_file_t *f, uint64_t k) {
+    return &f->records[k & (f->header->capacity - 1)];
+}
+
+static void printRecord(const trace_file_t *f, uint64_t k) {
+    const trace_record_t *r = recordAt(f, k);
+    uint8_t bytes[4] = { r->instruction >> 8, r->instruction & 0xFF, r->I >> 8, r->I & 0xFF }; // F000's nnnn is I
+    char text[32], wrote[16] = "";
+    disassemble(bytes, MEMORY_END, 0, text, sizeof(text));
+    if (r->reg != TRACE_NO_REGISTER) snprintf(wrote, sizeof(wrote), "V%X=%02X", r->reg & 0xF, r->value);
+    printf("%12llu  0x%04X  %04X  %-20s I %04X  %s\n", (unsigned long long)k, r->pc, r->instruction, text, r->I, wrote);
+}
+
+// the last n instructions, up to and including the last one fetched from before (or the newest one if it's -1)
+static int printLast(const trace_file_t *f, uint64_t n, long before) {
+    uint64_t end = f->end;
+    if (before >= 0) {
+        while (end > f->first && recordAt(f, end - 1)->pc != before) end--;
+        if (end == f->first) {
+            printf("PC never was 0x%04lX in the %llu instructions held\n", before,
+                   (unsigned long long)(f->end - f->first));
+            return 1;
+        }
+    }
+    uint64_t start = end - f->first > n ? end - n : f->first;
+    for (uint64_t k = start; k < end; k++) printRecord(f, k);
+    return 0;
+}
+
+// whether record k changes the register (0-15 for V0-VF, 16 for I) from what it was, the first time it's seen counts
+static int changes(const trace_file_t *f, uint64_t k, int reg, int *have, int *value) {
+    const trace_record_t *r = recordAt(f, k);
+    if (reg != 16 && r->reg != reg) return 0;
+    int now = reg == 16 ? r->I : r->value, changed = !*have || now != *value;
+    *have = 1;
+    *value = now;
+    return changed;
+}
+
+// twice through: once to count the changes, then to print the last n of them
+static int printRegister(const trace_file_t *f, int reg, uint64_t n) {
+    uint64_t total = 0, seen = 0;
+    int have = 0, value = 0;
+    for (uint64_t k = f->first; k < f->end; k++) total += changes(f, k, reg, &have, &value);
+    have = 0;
+    for (uint64_t k = f->first; k < f->end; k++) {
+        if (changes(f, k, reg, &have, &value) && seen++ >= (total > n ? total - n : 0)) printRecord(f, k);
+    }
+    if (total == 0) printf("nothing wrote V%X in the %llu instructions held\n", reg & 0xF, (unsigned long long)(f->end - f->first));
+    return 0;
+}
+
+static int byTaken(const void *a, const void *b) {
+    const loop_t *x = a, *y = b;
+    return x->taken < y->taken ? 1 : x->taken > y->taken ? -1 : 0;
+}
+
+static int printLoops(const trace_file_t *f, int n) {
+    static loop_t loops[LOOP_SLOTS];
+    static uint64_t lastLanding[LOOP_SLOTS]; // by slot, the instruction after the previous time it was taken
+    uint64_t dropped = 0;
+    for (uint64_t k = f->first; k + 1 < f->end; k++) {
+        const trace_record_t *r = recordAt(f, k), *next = recordAt(f, k + 1);
+        uint16_t op = r->instruction;
+        if (next->pc > r->pc || op == 0x00EE || (op & 0xF000) == 0x2000) continue; // forward, a return or a call
+
+        uint32_t slot = (r->pc * 2654435761u ^ next->pc) & (LOOP_SLOTS - 1);
+        int probes = 0;
+        while (loops[slot].taken && (loops[slot].from != r->pc || loops[slot].to != next->pc) && probes < LOOP_SLOTS) {
+            slot = (slot + 1) & (LOOP_SLOTS - 1);
+            probes++;
+        }
+        if (probes == LOOP_SLOTS) { dropped++; continue; }
+        loop_t *l = &loops[slot];
+        if (l->taken) l->instructions += k + 1 - lastLanding[slot];
+        l->from = r->pc;
+        l->to = next->pc;
+        l->taken++;
+        lastLanding[slot] = k + 1;
+    }
+
+    qsort(loops, LOOP_SLOTS, sizeof(loop_t), byTaken);
+    uint64_t held = f->end - f->first;
+    for (int i = 0; i < n && loops[i].taken; i++) {
+        const loop_t *l = &loops[i];
+        double perIteration = l->taken > 1 ? (double)l->instructions / (l->taken - 1) : 0.0;
+        printf("0x%04X-0x%04X  taken %10llu times, %6.1f instructions a time, %5.1f%% of the trace\n", l->to, l->from,
+               (unsigned long long)l->taken, perIteration, held ? 100.0 * l->instructions / held : 0.0);
+    }
+    if (loops[0].taken == 0) printf("no backward jumps in the %llu instructions held\n", (unsigned long long)held);
+    if (dropped) printf("(%llu jumps back didn't fit in the table)\n", (unsigned long long)dropped);
+    return 0;
+}
+
+static int usage(const char *name) {
+    printf("usage: %s FILE [--last N [--before ADDR]] [--reg V0-VF|I [--last N]] [--loops [N]]\n", name);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL, *reg = NULL;
+    uint64_t last = 0;
+    long before = -1;
+    int loops = 0;
+    for (int i = 1; i < argc; i++) {
+        if      (strcmp(argv[i], "--last") == 0 && i + 1 < argc)   last = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--before") == 0 && i + 1 < argc) before = strtol(argv[++i], NULL, 16) & MEMORY_END;
+        else if (strcmp(argv[i], "--reg") == 0 && i + 1 < argc)    reg = argv[++i];
+        else if (strcmp(argv[i], "--loops") == 0) {
+            loops = i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) ? atoi(argv[++i]) : 10;
+        }
+        else if (argv[i][0] != '-' && path == NULL)                path = argv[i];
+        else return usage(argv[0]);
+    }
+    if (path == NULL) return usage(argv[0]);
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(trace_header_t)) {
+        printf("Couldn't open the trace %s\n", path);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("Couldn't map %s\n", path);
+        return 1;
+    }
+
+    trace_file_t f = { .header = mapping, .records = (const trace_record_t *)((const trace_header_t *)mapping + 1) };
+    const trace_header_t *h = f.header;
+    if (h->magic != TRACE_MAGIC || h->version != TRACE_VERSION || h->recordSize != sizeof(trace_record_t)
+        || h->capacity == 0 || (h->capacity & (h->capacity - 1))
+        || (size_t)st.st_size < sizeof(trace_header_t) + (size_t)h->capacity * sizeof(trace_record_t)) {
+        printf("%s isn't a Clip-8 trace this reader understands (version %u)\n", path, h->version);
+        return 1;
+    }
+    f.end = h->written; // a snapshot, the emulator may be adding to it
+    f.first = f.end > h->capacity ? f.end - h->capacity : 0;
+    if (before >= 0 && h->quirks != QUIRKS_XOCHIP) before &= CHIP8_RAM_SIZE - 1; // where the machine's PC wraps
+
+    if (reg != NULL) {
+        int r = -1;
+        if ((reg[0] == 'V' || reg[0] == 'v') && isxdigit((unsigned char)reg[1]) && reg[2] == '\0') {
+            r = (int)strtol(reg + 1, NULL, 16);
+        } else if (strcmp(reg, "I") == 0 || strcmp(reg, "i") == 0) r = 16;
+        if (r < 0) return usage(argv[0]);
+        return printRegister(&f, r, last ? last : 50);
+    }
+    if (loops) return printLoops(&f, loops);
+    if (last || before >= 0) return printLast(&f, last ? last : 20, before);
+
+    printf("%llu instructions traced, the last %llu held (room for %u), %s quirks, seed %llu\n",
+           (unsigned long long)h->written, (unsigned long long)(f.end - f.first), h->capacity,
+           quirksName((quirks_t)h->quirks), (unsigned long long)h->seed);
+    return printLast(&f, 20, -1);
+}
@@ -0,0 +1,363 @@
+#include <ctype.h>
+#include "debugger.h"
+
+// ##########  DEBUGGER  ##########
+// see debugger.h. Addresses and values typed into the console are hex (0x optional), counts are decimal
+
+debugger_t *createDebugger(FILE *in, FILE *out) {
+    debugger_t *d = calloc(1, sizeof(debugger_t));
+    if (d == NULL) return NULL;
+    d->in = in;
+    d->out = out;
+    return d;
+}
+
+void destroyDebugger(debugger_t *d) {
+    free(d);
+}
+
+void armDebugger(machine_t *m, debugger_t *d) {
+    int armed = !d->detached && (d->breakpointCount || d->watchCount || d->pauseNext || d->stepsLeft || d->stepOver);
+    m->debug = armed ? d : NULL;
+}
+
+void debugBreak(machine_t *m, debugger_t *d) {
+    if (d->detached) return;
+    d->pauseNext = 1;
+    armDebugger(m, d);
+}
+
+void setBreakpoint(debugger_t *d, uint16_t address, int on) {
+    uint8_t bit = 1 << (address & 7), *bits = &d->breakpoints[address >> 3];
+    if (on && !(*bits & bit)) d->breakpointCount++;
+    if (!on && (*bits & bit)) d->breakpointCount--;
+    *bits = on ? *bits | bit : *bits & ~bit;
+}
+
+void setWatchpoint(const machine_t *m, debugger_t *d, uint16_t address, int length, int watch) {
+    for (int i = 0; i < length; i++) {
+        uint8_t *w = &d->watches[(address + i) & m->memoryEnd];
+        d->watchCount += (watch != 0) - (*w != 0);
+        *w = (uint8_t)watch;
+    }
+}
+
+
+// ##########  DISASSEMBLER  ##########
+
+int disassemble(const uint8_t *ram, uint16_t memoryEnd, uint16_t address, char *out, size_t size) {
+    uint16_t word = ram[address & memoryEnd] << 8 | ram[(address + 1) & memoryEnd];
+    decoded_t d = decodeWord(word);
+    int x = d.x, y = d.y, kk = d.kk, nnn = d.nnn;
+    switch (d.opcode) {
+        case ROM_END:
+        case ILLEGAL: snprintf(out, size, ".word 0x%04X", word);                   break;
+        case SYS:     snprintf(out, size, "SYS 0x%03X", nnn);                      break;
+        case CLS:     snprintf(out, size, "CLS");                                  break;
+        case RET:     snprintf(out, size, "RET");                                  break;
+        case JPADR:   snprintf(out, size, "JP 0x%03X", nnn);                       break;
+        case CALL:    snprintf(out, size, "CALL 0x%03X", nnn);                     break;
+        case SEIMM:   snprintf(out, size, "SE V%X, 0x%02X", x, kk);                break;
+        case SNE:     snprintf(out, size, "SNE V%X, 0x%02X", x, kk);               break;
+        case SEREG:   snprintf(out, size, "SE V%X, V%X", x, y);                    break;
+        case LDIMM:   snprintf(out, size, "LD V%X, 0x%02X", x, kk);                break;
+        case ADDIMM:  snprintf(out, size, "ADD V%X, 0x%02X", x, kk);               break;
+        case LDI:     snprintf(out, size, "LD V%X, V%X", x, y);                    break;
+        case OR:      snprintf(out, size, "OR V%X, V%X", x, y);                    break;
+        case AND:     snprintf(out, size, "AND V%X, V%X", x, y);                   break;
+        case XOR:     snprintf(out, size, "XOR V%X, V%X", x, y);                   break;
+        case ADDREG:  snprintf(out, size, "ADD V%X, V%X", x, y);                   break;
+        case SUB:     snprintf(out, size, "SUB V%X, V%X", x, y);                   break;
+        case SHR:     snprintf(out, size, "SHR V%X, V%X", x, y);                   break;
+        case SUBN:    snprintf(out, size, "SUBN V%X, V%X", x, y);                  break;
+        case SHL:     snprintf(out, size, "SHL V%X, V%X", x, y);                   break;
+        case SNEREG:  snprintf(out, size, "SNE V%X, V%X", x, y);                   break;
+        case LD:      snprintf(out, size, "LD I, 0x%03X", nnn);                    break;
+        case JPREG:   snprintf(out, size, "JP V0, 0x%03X", nnn);                   break;
+        case RND:     snprintf(out, size, "RND V%X, 0x%02X", x, kk);               break;
+        case DRW:     snprintf(out, size, "DRW V%X, V%X, %d", x, y, d.n);          break;
+        case SKP:     snprintf(out, size, "SKP V%X", x);                           break;
+        case SKNP:    snprintf(out, size, "SKNP V%X", x);                          break;
+        case LDREGDT: snprintf(out, size, "LD V%X, DT", x);                        break;
+        case LDK:     snprintf(out, size, "LD V%X, K", x);                         break;
+        case LDDTVX:  snprintf(out, size, "LD DT, V%X", x);                        break;
+        case LDSTVX:  snprintf(out, size, "LD ST, V%X", x);                        break;
+        case ADDIVX:  snprintf(out, size, "ADD I, V%X", x);                        break;
+        case LDFVX:   snprintf(out, size, "LD F, V%X", x);                         break;
+        case LDBVX:   snprintf(out, size, "LD B, V%X", x);                         break;
+        case LDIVX:   snprintf(out, size, "LD [I], V%X", x);                       break;
+        case LDVXI:   snprintf(out, size, "LD V%X, [I]", x);                       break;
+        case SCD:     snprintf(out, size, "SCD %d", d.n);                          break;
+        case SCR:     snprintf(out, size, "SCR");                                  break;
+        case SCL:     snprintf(out, size, "SCL");                                  break;
+        case EXIT:    snprintf(out, size, "EXIT");                                 break;
+        case LOW:     snprintf(out, size, "LOW");                                  break;
+        case HIGH:    snprintf(out, size, "HIGH");                                 break;
+        case LDHF:    snprintf(out, size, "LD HF, V%X", x);                        break;
+        case LDRVX:   snprintf(out, size, "LD R, V%X", x);                         break;
+        case LDVXR:   snprintf(out, size, "LD V%X, R", x);                         break;
+        case SCU:     snprintf(out, size, "SCU %d", d.n);                          break;
+        case SAVE:    snprintf(out, size, "SAVE V%X - V%X", x, y);                 break;
+        case LOAD:    snprintf(out, size, "LOAD V%X - V%X", x, y);                 break;
+        case LDILONG: snprintf(out, size, "LD I, 0x%04X",
+                               ram[(address + 2) & memoryEnd] << 8 | ram[(address + 3) & memoryEnd]);
+                      return 4;
+        case PLANE:   snprintf(out, size, "PLANE %d", x);                          break;
+        case AUDIO:   snprintf(out, size, "AUDIO");                                break;
+        case PITCH:   snprintf(out, size, "PITCH V%X", x);                         break;
+    }
+    return 2;
+}
+
+
+// ##########  CONSOLE  ##########
+
+static void printInstruction(const machine_t *m, const debugger_t *d, uint16_t address) {
+    char text[32];
+    disassemble(m->ram, m->memoryEnd, address, text, sizeof(text));
+    fprintf(d->out, "%c%c 0x%04X  %02X%02X  %s\n", address == (m->PC & m->memoryEnd) ? '>' : ' ',
+            d->breakpoints[address >> 3] >> (address & 7) & 1 ? '*' : ' ', address,
+            m->ram[address], m->ram[(address + 1) & m->memoryEnd], text);
+}
+
+static void printRegisters(const machine_t *m, const debugger_t *d) {
+    for (int r = 0; r < 0x10; r++) fprintf(d->out, "V%X %02X%s", r, m->v[r], r % 8 == 7 ? "\n" : "  ");
+    fprintf(d->out, "I %04X  PC %04X  SP %X  DT %02X  ST %02X  stack", m->I, m->PC & m->memoryEnd, m->SP, m->DT, m->ST);
+    for (int i = 1; i <= m->SP && i < STACK_SIZE; i++) fprintf(d->out, " %04X", m->stack[i]);
+    fprintf(d->out, "\n");
+}
+
+static void printHelp(const debugger_t *d) {
+    fprintf(d->out,
+            "c, continue               run until a breakpoint or watchpoint stops it\n"
+            "s, step [N]               run N instructions (1)\n"
+            "n, next                   one instruction, a CALL runs until it returns\n"
+            "b, break [ADDR]           breakpoint at ADDR, or list them\n"
+            "d, delete ADDR            remove the breakpoint at ADDR\n"
+            "w, watch ADDR [N] [r|w]   stop after an instruction reads or writes N bytes at ADDR (1, both)\n"
+            "u, unwatch ADDR [N]       remove a watchpoint\n"
+            "r, regs                   registers, timers and stack\n"
+            "x ADDR [N]                N bytes of RAM (64)\n"
+            "l, list [ADDR] [N]        disassemble N instructions from ADDR (PC, 10)\n"
+            "set V0-VF|I|PC|DT|ST VAL  change a register\n"
+            "detach                    remove everything and run at full speed\n"
+            "q, quit                   exit the emulator\n"
+            "addresses and values are hex, counts decimal. An empty line repeats the last command\n");
+}
+
+static int parseHex(const char *text, unsigned long *value) {
+    char *end;
+    if (text == NULL) return 0;
+    *value = strtoul(text, &end, 16);
+    return end != text && *end == '\0';
+}
+
+// runs one command. Returns nonzero if it lets the machine run again
+static int runCommand(machine_t *m, debugger_t *d, char *line) {
+    char *words[4] = { NULL };
+    int count = 0;
+    for (char *word = strtok(line, " \t\r\n"); word != NULL && count < 4; word = strtok(NULL, " \t\r\n")) {
+        words[count++] = word;
+    }
+    if (count == 0) return 0;
+    const char *command = words[0];
+    unsigned long address, value;
+    uint16_t pc = m->PC & m->memoryEnd;
+
+    if (!strcmp(command, "c") || !strcmp(command, "continue")) return 1;
+
+    if (!strcmp(command, "s") || !strcmp(command, "step")) {
+        long steps = words[1] ? strtol(words[1], NULL, 10) : 1;
+        d->stepsLeft = steps > 0 ? (uint32_t)steps : 1;
+        return 1;
+    }
+    if (!strcmp(command, "n") || !strcmp(command, "next")) {
+        if (decodeInstruction(m->ram[pc] << 8 | m->ram[(pc + 1) & m->memoryEnd]) == CALL) {
+            d->stepOver = 1;
+            d->returnPc = (pc + 2) & m->memoryEnd;
+            d->returnSp = m->SP;
+        } else {
+            d->stepsLeft = 1;
+        }
+        return 1;
+    }
+    if (!strcmp(command, "b") || !strcmp(command, "break")) {
+        if (count == 1) {
+            if (d->breakpointCount == 0) fprintf(d->out, "no breakpoints\n");
+            for (int a = 0; a <= m->memoryEnd; a++) {
+                if (d->breakpoints[a >> 3] >> (a & 7) & 1) printInstruction(m, d, (uint16_t)a);
+            }
+        } else if (parseHex(words[1], &address)) {
+            setBreakpoint(d, address & m->memoryEnd, 1);
+        } else fprintf(d->out, "break needs a hex address\n");
+        return 0;
+    }
+    if (!strcmp(command, "d") || !strcmp(command, "delete")) {
+        if (parseHex(words[1], &address)) setBreakpoint(d, address & m->memoryEnd, 0);
+        else fprintf(d->out, "delete needs a hex address\n");
+        return 0;
+    }
+    if (!strcmp(command, "w") || !strcmp(command, "watch") || !strcmp(command, "u") || !strcmp(command, "unwatch")) {
+        int on = command[0] == 'w';
+        if (!parseHex(words[1], &address)) {
+            fprintf(d->out, "%s needs a hex address\n", command);
+            return 0;
+        }
+        int length = words[2] && isdigit((unsigned char)words[2][0]) ? atoi(words[2]) : 1;
+        const char *kind = words[2] && !isdigit((unsigned char)words[2][0]) ? words[2] : words[3];
+        int watch = kind == NULL ? DEBUG_WATCH_READ | DEBUG_WATCH_WRITE
+                  : (strchr(kind, 'r') ? DEBUG_WATCH_READ : 0) | (strchr(kind, 'w') ? DEBUG_WATCH_WRITE : 0);
+        setWatchpoint(m, d, address & m->memoryEnd, length < 1 ? 1 : length, on ? watch : 0);
+        return 0;
+    }
+    if (!strcmp(command, "r") || !strcmp(command, "regs")) {
+        printRegisters(m, d);
+        return 0;
+    }
+    if (!strcmp(command, "x")) {
+        if (!parseHex(words[1], &address)) {
+            fprintf(d->out, "x needs a hex address\n");
+            return 0;
+        }
+        int length = words[2] ? atoi(words[2]) : 64;
+        for (int i = 0; i < length; i++) {
+            if (i % 16 == 0) fprintf(d->out, "%s0x%04lX ", i ? "\n" : "", (address + i) & m->memoryEnd);
+            fprintf(d->out, " %02X", m->ram[(address + i) & m->memoryEnd]);
+        }
+        fprintf(d->out, "\n");
+        return 0;
+    }
+    if (!strcmp(command, "l") || !strcmp(command, "list")) {
+        int from = parseHex(words[1], &address);
+        uint16_t a = from ? address & m->memoryEnd : pc;
+        int lines = words[from ? 2 : 1] ? atoi(words[from ? 2 : 1]) : 10;
+        for (int i = 0; i < lines; i++) {
+            char text[32];
+            printInstruction(m, d, a);
+            a = (a + disassemble(m->ram, m->memoryEnd, a, text, sizeof(text))) & m->memoryEnd;
+        }
+        return 0;
+    }
+    if (!strcmp(command, "set")) {
+        const char *r = words[1];
+        if (r == NULL || !parseHex(words[2], &value)) {
+            fprintf(d->out, "set needs a register and a hex value\n");
+            return 0;
+        }
+        if ((r[0] == 'V' || r[0] == 'v') && isxdigit((unsigned char)r[1]) && r[2] == '\0') {
+            m->v[strtol(r + 1, NULL, 16)] = (uint8_t)value;
+        } else if (!strcmp(r, "I"))  m->I = (uint16_t)value;
+        else if (!strcmp(r, "PC"))   m->PC = value & m->memoryEnd;
+        else if (!strcmp(r, "DT"))   m->DT = (uint8_t)value;
+        else if (!strcmp(r, "ST"))   m->ST = (uint8_t)value;
+        else fprintf(d->out, "no register %s\n", r);
+        return 0;
+    }
+    if (!strcmp(command, "detach")) {
+        memset(d->breakpoints, 0, sizeof(d->breakpoints));
+        memset(d->watches, 0, sizeof(d->watches));
+        d->breakpointCount = d->watchCount = 0;
+        return 1;
+    }
+    if (!strcmp(command, "q") || !strcmp(command, "quit")) {
+        d->detached = 1; // so it runs out its slice without stopping again
+        atomic_store(&d->quit, 1);
+        return 1;
+    }
+
+    if (strcmp(command, "h") && strcmp(command, "help")) fprintf(d->out, "unknown command %s\n", command);
+    printHelp(d);
+    return 0;
+}
+
+void debuggerConsole(machine_t *m, debugger_t *d, const char *reason) {
+    d->pauseNext = 0;
+    d->stepsLeft = 0;
+    d->stepOver = 0;
+    if (reason != NULL && reason[0] != '\0') fprintf(d->out, "%s\n", reason);
+    printInstruction(m, d, m->PC & m->memoryEnd);
+
+    char line[DEBUG_CONSOLE_LINE];
+    for (;;) {
+        fprintf(d->out, "(clip8) ");
+        fflush(d->out);
+        if (fgets(line, sizeof(line), d->in) == NULL) { // nobody left to type, so nothing may stop it again
+            fprintf(d->out, "\nconsole closed, running on\n");
+            d->detached = 1;
+            break;
+        }
+        if (strspn(line, " \t\r\n") == strlen(line)) memcpy(line, d->lastCommand, sizeof(line));
+        else memcpy(d->lastCommand, line, sizeof(line));
+        if (runCommand(m, d, line)) break;
+    }
+    armDebugger(m, d);
+}
+
+
+// ##########  DEBUGGED CORE  ##########
+
+// the RAM an instruction is about to read or write: LDIVX, LDVXI, LDBVX and DRW (and XO-CHIP's SAVE, LOAD and AUDIO).
+// Returns DEBUG_WATCH_READ or DEBUG_WATCH_WRITE with the range, 0 for everything else
+static int memoryAccess(const machine_t *m, decoded_t d, uint16_t *start, int *length) {
+    *start = m->I & m->memoryEnd;
+    switch (d.opcode) {
+        case LDIVX: *length = d.x + 1; return DEBUG_WATCH_WRITE;
+        case LDVXI: *length = d.x + 1; return DEBUG_WATCH_READ;
+        case LDBVX: *length = 3;       return DEBUG_WATCH_WRITE;
+        case SAVE:  *length = (d.x <= d.y ? d.y - d.x : d.x - d.y) + 1; return DEBUG_WATCH_WRITE;
+        case LOAD:  *length = (d.x <= d.y ? d.y - d.x : d.x - d.y) + 1; return DEBUG_WATCH_READ;
+        case AUDIO: *length = AUDIO_PATTERN_SIZE; return DEBUG_WATCH_READ;
+        case DRW: { // a sprite per selected plane, one after the other
+            int planes = (m->frameBuffer.planes & 1) + (m->frameBuffer.planes >> 1 & 1);
+            *length = (d.n ? d.n : 32) * planes;
+            return *length ? DEBUG_WATCH_READ : 0;
+        }
+        default:    return 0;
+    }
+}
+
+// same as runCyclesSwitch(), stopping in the console wherever the debugger says
+int runCyclesDebug(machine_t *m, int count) {
+    int ran = 0, resumed = 0;
+    char reason[96];
+    while (ran < count) {
+        debugger_t *d = m->debug;
+        if (d == NULL) return ran + runCycles(m, count - ran); // disarmed, the rest on the machine's own core
+        uint16_t pc = m->PC & m->memoryEnd;
+
+        if (!resumed && (d->pauseNext || (d->breakpoints[pc >> 3] >> (pc & 7) & 1))) {
+            if (d->breakpoints[pc >> 3] >> (pc & 7) & 1) snprintf(reason, sizeof(reason), "breakpoint at 0x%04X", pc);
+            else reason[0] = '\0';
+            debuggerConsole(m, d, reason);
+            if (atomic_load(&d->quit)) return ran;
+            resumed = 1; // whatever PC is now runs before anything can stop it again
+            continue;
+        }
+        resumed = 0;
+
+        decoded_t instruction = decodeWord(m->ram[pc] << 8 | m->ram[(pc + 1) & m->memoryEnd]);
+        uint16_t start = 0;
+        int length = 0, access = d->watchCount ? memoryAccess(m, instruction, &start, &length) : 0;
+        int status = clockCycle(m);
+        ran++;
+        d->instructions++;
+        if (status) return ran;
+
+        int watched = 0;
+        for (int i = 0; i < length && access; i++) watched |= d->watches[(start + i) & m->memoryEnd] & access;
+        if (watched) {
+            snprintf(reason, sizeof(reason), "watchpoint: %s at 0x%04X %s 0x%04X-0x%04X", opcodeName(instruction.opcode),
+                     pc, access == DEBUG_WATCH_WRITE ? "wrote" : "read", start, (start + length - 1) & m->memoryEnd);
+            debuggerConsole(m, d, reason);
+            if (atomic_load(&d->quit)) return ran;
+            resumed = 1;
+            continue;
+        }
+        if (d->stepsLeft && --d->stepsLeft == 0) d->pauseNext = 1;
+        if (d->stepOver && (m->PC & m->memoryEnd) == d->returnPc && m->SP == d->returnSp) {
+            d->stepOver = 0;
+            d->pauseNext = 1;
+        }
+    }
+    return ran;
+}
@@ -0,0 +1,60 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdatomic.h>
+#include "chip8.h"
+
+// ##########  DEBUGGER  ##########
+// PC breakpoints, read/write watchpoints on RAM, single-step and step-over, with a console on stdin. The machine
+// only points at the debugger (m->debug) while something is armed: a breakpoint, a watchpoint, a step or a pause
+// that was asked for. Until then runCycles() runs the machine's core untouched, the cost is one branch per call,
+// and with the debugger armed everything goes through runCyclesDebug() instead, one instruction at a time on the
+// switch core, so breakpoints hit the same on every core (superinstructions, JIT and AOT blocks included).
+// The console runs on whichever thread runs the machine, right where it stopped, so while it waits for a command
+// nothing else touches the machine and the timers don't tick
+
+#define DEBUG_WATCH_READ  1
+#define DEBUG_WATCH_WRITE 2
+#define DEBUG_CONSOLE_LINE 128
+
+typedef struct debugger {
+    uint8_t  breakpoints[RAM_SIZE / 8];     // a bit per address, bit (pc & 7) of byte pc >> 3
+    uint8_t  watches[RAM_SIZE];             // DEBUG_WATCH_ bits per address
+    int      breakpointCount, watchCount;
+
+    int      pauseNext;                     // stop before the next instruction
+    uint32_t stepsLeft;                     // instructions to run before stopping, 0 if not stepping
+    int      stepOver;                      // stop when PC gets back to returnPc with the stack where it was
+    uint16_t returnPc;
+    uint8_t  returnSp;
+
+    FILE    *in, *out;                      // the console
+    int      detached;                      // the console's input ran out, nothing will stop the machine again
+    atomic_int quit;                        // "quit" was typed, whoever runs the machine winds down and exits
+    char     lastCommand[DEBUG_CONSOLE_LINE]; // what an empty line repeats
+    uint64_t instructions;                  // run while armed
+} debugger_t;
+
+// a debugger with nothing set, talking over in and out. NULL if it can't be allocated
+debugger_t *createDebugger(FILE *in, FILE *out);
+void destroyDebugger(debugger_t *d);
+
+// points m->debug at d if anything is armed, back to NULL (full speed) if nothing is
+void armDebugger(machine_t *m, debugger_t *d);
+
+// stops the machine before its next instruction and opens the console there
+void debugBreak(machine_t *m, debugger_t *d);
+
+// breakpoints and watchpoints, watch being DEBUG_WATCH_ bits (0 removes them). They take effect on the next run.
+// A watched range wraps around the end of m's RAM the way its stores do
+void setBreakpoint(debugger_t *d, uint16_t address, int on);
+void setWatchpoint(const machine_t *m, debugger_t *d, uint16_t address, int length, int watch);
+
+// the console: prints why it stopped and where, then runs commands until one lets the machine go on
+void debuggerConsole(machine_t *m, debugger_t *d, const char *reason);
+
+// the instruction at address as assembly, in the usual CHIP-8 syntax (LD V1, 0x20), ram wrapping after memoryEnd.
+// Returns its length in bytes, 4 for XO-CHIP's F000 nnnn
+int disassemble(const uint8_t *ram, uint16_t memoryEnd, uint16_t address, char *out, size_t size);
+
+#endif
@@ -0,0 +1,365 @@
+#include "chip8.h"
+
+#ifdef HAVE_JIT
+#include <sys/mman.h>
+
+// ##########  JIT  ##########
+// straight line ALU code (6xkk, 7xkk, 8xyN, Annn, Fx1E, Fx29) plus an optional 1nnn or skip at the end
+// is translated into one native function. The V registers a block uses are loaded into host registers
+// on entry and written back on exit, I is updated in place. Whatever a block can't hold ends it, and
+// the dispatcher runs that instruction with clockCycle() before looking for the next block. When a block is longer
+// than what's left of a runCycles() call, a second copy of it that stops after that many instructions runs instead.
+
+// host registers. rax is scratch, rdi points to V0-VF and rsi to I, the rest hold V registers
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+       R8 = 8, R9, R10, R11, R12, R13, R14, R15 };
+static const uint8_t jitPool[] = { RCX, RDX, R8, R9, R10, R11, RBX, RBP, R12, R13, R14, R15 };
+#define JIT_POOL_SIZE ((int)sizeof(jitPool))
+#define IS_CALLEE_SAVED(r) ((r) == RBX || (r) == RBP || (r) >= R12)
+
+// x86 ALU opcodes in their "op r/m32, r32" form, and the /digit of the 0x81 immediate group
+enum { X86_ADD = 0x01, X86_OR = 0x09, X86_AND = 0x21, X86_SUB = 0x29, X86_XOR = 0x31,
+       X86_CMP = 0x39, X86_MOV = 0x89 };
+enum { IMM_ADD = 0, IMM_AND = 4, IMM_CMP = 7 };
+enum { CC_E = 0x4, CC_NE = 0x5, CC_AE = 0x3, CC_A = 0x7 };
+
+// every emitter appends to *out and moves it forward
+static void emit8(uint8_t **out, uint8_t b)      { *(*out)++ = b; }
+static void emit16(uint8_t **out, uint16_t w)    { emit8(out, w & 0xFF); emit8(out, w >> 8); }
+static void emit32(uint8_t **out, uint32_t d)    { emit16(out, d & 0xFFFF); emit16(out, d >> 16); }
+
+static void emitRex(uint8_t **out, int reg, int base, int force) {
+    uint8_t rex = 0x40 | ((reg >= 8) << 2) | (base >= 8);
+    if (rex != 0x40 || force) emit8(out, rex);
+}
+static void emitRR(uint8_t **out, uint8_t op, int dst, int src) {    // op dst32, src32
+    emitRex(out, src, dst, 0);
+    emit8(out, op);
+    emit8(out, 0xC0 | (src & 7) << 3 | (dst & 7));
+}
+static void emitImm(uint8_t **out, int ext, int dst, uint32_t imm) { // add/and/cmp dst32, imm32
+    emitRex(out, 0, dst, 0);
+    emit8(out, 0x81);
+    emit8(out, 0xC0 | ext << 3 | (dst & 7));
+    emit32(out, imm);
+}
+static void emitMovImm(uint8_t **out, int dst, uint32_t imm) {       // mov dst32, imm32 (leaves the flags alone)
+    emitRex(out, 0, dst, 0);
+    emit8(out, 0xB8 + (dst & 7));
+    emit32(out, imm);
+}
+static void emitShift(uint8_t **out, int ext, int dst, uint8_t amount) { // shl (4) / shr (5) dst32, amount
+    emitRex(out, 0, dst, 0);
+    emit8(out, 0xC1);
+    emit8(out, 0xC0 | ext << 3 | (dst & 7));
+    emit8(out, amount);
+}
+static void emitSetccRax(uint8_t **out, int cc) {                    // setcc al, movzx eax, al
+    emit8(out, 0x0F); emit8(out, 0x90 | cc); emit8(out, 0xC0);
+    emit8(out, 0x0F); emit8(out, 0xB6); emit8(out, 0xC0);
+}
+static void emitLoadV(uint8_t **out, int dst, int index) {           // movzx dst32, byte [rdi + index]
+    emitRex(out, dst, 0, 0);
+    emit8(out, 0x0F); emit8(out, 0xB6);
+    emit8(out, 0x40 | (dst & 7) << 3 | RDI);
+    emit8(out, index);
+}
+static void emitStoreV(uint8_t **out, int src, int index) {          // mov byte [rdi + index], src8
+    emitRex(out, src, 0, 1); // the REX prefix picks bpl instead of ch
+    emit8(out, 0x88);
+    emit8(out, 0x40 | (src & 7) << 3 | RDI);
+    emit8(out, index);
+}
+static void emitPush(uint8_t **out, int r) { emitRex(out, 0, r, 0); emit8(out, 0x50 + (r & 7)); }
+static void emitPop(uint8_t **out, int r)  { emitRex(out, 0, r, 0); emit8(out, 0x58 + (r & 7)); }
+static uint8_t *emitJeBudget(uint8_t **out, uint8_t k) {             // cmp dword [rsp], k; je rel32
+    emit8(out, 0x83); emit8(out, 0x3C); emit8(out, 0x24); emit8(out, k);
+    emit8(out, 0x0F); emit8(out, 0x84);
+    uint8_t *rel = *out;
+    emit32(out, 0);                                                  // patched once the exit is emitted
+    return rel;
+}
+static void patchRel32(uint8_t *rel, const uint8_t *target) {
+    int32_t offset = (int32_t)(target - (rel + 4));
+    memcpy(rel, &offset, 4);
+}
+
+// what a block returns: the PC to go on from, and how many instructions it ran
+static uint32_t jitExit(int ran, int pc) { return (uint32_t)ran << 16 | (pc & 0xFFFF); }
+
+// can this instruction be inside a block (not counting the terminator)
+static int jitCanCompile(opcode_t op) {
+    switch (op) {
+        case LDIMM: case ADDIMM: case LDI: case OR: case AND: case XOR: case ADDREG:
+        case SUB: case SHR: case SUBN: case SHL: case LD: case ADDIVX: case LDFVX:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// instructions that end a block and are compiled as its exit. Skips that may step over an F000 nnnn are left
+// to the interpreter, the word after them can change without the block being thrown away
+static int jitIsTerminator(opcode_t op, unsigned quirks) {
+    if (op == JPADR) return 1;
+    return !(quirks & QUIRK_LONG_SKIP) && (op == SEIMM || op == SNE || op == SEREG || op == SNEREG);
+}
+
+static int jitReadsY(opcode_t op, unsigned quirks) {
+    if (op == SHR || op == SHL) return (quirks & QUIRK_SHIFT_VY) != 0;
+    return op == SEREG || op == SNEREG || (op >= LDI && op <= SHL);
+}
+
+static int jitWritesVF(opcode_t op, unsigned quirks) {
+    if (op == OR || op == AND || op == XOR) return (quirks & QUIRK_VF_RESET) != 0;
+    return op == ADDREG || op == SUB || op == SHR || op == SUBN || op == SHL;
+}
+
+int jitInit(machine_t *m) {
+    if (m->jitArena != NULL) return 0;
+    void *arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) return -1; // the OS doesn't allow writable + executable pages
+    m->jitArena = arena;
+    jitFlush(m);
+    return 0;
+}
+
+void jitFree(machine_t *m) {
+    if (m->jitArena != NULL) munmap(m->jitArena, JIT_ARENA_SIZE);
+    m->jitArena = NULL;
+}
+
+void jitFlush(machine_t *m) {
+    memset(m->jitBlocks, 0, sizeof(m->jitBlocks));
+    memset(m->jitCovered, 0, sizeof(m->jitCovered));
+    m->jitArenaUsed = 0;
+    m->jitFlushes++;
+}
+
+void jitInvalidate(machine_t *m, uint16_t address, int length) {
+    int end = address + length;
+    if (end > m->memoryEnd + 1) end = m->memoryEnd + 1;
+    for (int i = address & ~1; i < end; i += 2) {
+        if (!m->jitCovered[i >> 1]) continue;
+        // drop every block that starts at or spans this instruction. Their code stays in the arena until the next flush
+        int first = i - 2 * (JIT_MAX_BLOCK - 1);
+        for (int entry = first < 0 ? 0 : first; entry <= i; entry += 2) {
+            jit_block_t *block = &m->jitBlocks[entry >> 1];
+            if (block->tried && (entry == i || entry + 2 * block->length > i)) {
+                block->code = NULL;
+                block->counted = NULL;
+                block->tried = 0;
+                block->length = 0;
+            }
+        }
+    }
+}
+
+// the block at pc, or with counted its variant that checks the budget before every instruction after the first
+// and leaves early when it runs out
+static void compileBlock(machine_t *m, uint16_t pc, int counted) {
+    jit_block_t *block = &m->jitBlocks[pc >> 1];
+    block->tried = 1;
+    m->jitCovered[pc >> 1] = 1;
+
+    // pass 1: how far the block goes and which registers it needs
+    int8_t   hostReg[0x10];
+    uint16_t written = 0;
+    int      used = 0, length = 0, hasTerminator = 0;
+    memset(hostReg, -1, sizeof(hostReg));
+
+    for (int at = pc; at <= m->memoryEnd && length < JIT_MAX_BLOCK; at += 2) {
+        const decoded_t *d = &m->decodeCache[at >> 1];
+        int terminator = jitIsTerminator(d->opcode, m->quirkBits);
+        if (!terminator && !jitCanCompile(d->opcode)) break;
+
+        int needs[3] = { -1, -1, -1 }, extra = 0;
+        if (d->opcode != JPADR && d->opcode != LD) needs[0] = d->x;
+        if (jitReadsY(d->opcode, m->quirkBits))    needs[1] = d->y;
+        if (jitWritesVF(d->opcode, m->quirkBits))  needs[2] = 0xF;
+        for (int k = 0; k < 3; k++) {
+            if (needs[k] < 0 || hostReg[needs[k]] >= 0) continue;
+            int dup = 0;
+            for (int j = 0; j < k; j++) dup |= needs[j] == needs[k];
+            if (!dup) extra++;
+        }
+        if (used + extra > JIT_POOL_SIZE) break; // out of host registers
+        for (int k = 0; k < 3; k++) {
+            if (needs[k] >= 0 && hostReg[needs[k]] < 0) hostReg[needs[k]] = jitPool[used++];
+        }
+        if (d->opcode != JPADR && d->opcode != LD && d->opcode != ADDIVX && d->opcode != LDFVX &&
+            !terminator) written |= 1 << d->x;
+        if (jitWritesVF(d->opcode, m->quirkBits)) written |= 1 << 0xF;
+
+        length++;
+        m->jitCovered[at >> 1] = 1;
+        if (terminator) { hasTerminator = 1; break; }
+    }
+    if (length == 0) return; // the first instruction is for the interpreter
+
+    // worst case is well under 64 bytes per instruction (96 with the budget check and exit), plus prologue and epilogue
+    if (m->jitArena == NULL || m->jitArenaUsed + length * (counted ? 96 : 64) + 128 > JIT_ARENA_SIZE) {
+        if (m->jitArena == NULL) return;
+        jitFlush(m);
+        jitCompile(m, pc);
+        if (counted) compileBlock(m, pc, 1);
+        return;
+    }
+
+    // pass 2: emit
+    uint8_t *start = m->jitArena + m->jitArenaUsed;
+    uint8_t *cursor = start, **out = &cursor;
+    for (int k = 0; k < used; k++) {
+        if (IS_CALLEE_SAVED(jitPool[k])) emitPush(out, jitPool[k]);
+    }
+    if (counted) emitPush(out, RDX); // the budget, rdx may be holding a V register from here on
+    for (int r = 0; r < 0x10; r++) {
+        if (hostReg[r] >= 0) emitLoadV(out, hostReg[r], r);
+    }
+    uint8_t *exits[JIT_MAX_BLOCK] = { NULL };
+
+    // the block is compiled for the machine's quirks, setQuirks() throws it away if they change
+    const unsigned quirks = m->quirkBits;
+    uint16_t at = pc;
+    for (int k = 0; k < length; k++, at += 2) {
+        const decoded_t *d = &m->decodeCache[at >> 1];
+        int rx = hostReg[d->x], ry = hostReg[d->y], vf = hostReg[0xF];
+        int shifted = quirks & QUIRK_SHIFT_VY ? ry : rx; // what 8xy6/8xyE shift
+        if (counted && k > 0) exits[k] = emitJeBudget(out, (uint8_t)k); // the budget ran out before this one
+
+        switch (d->opcode) {
+            case LDIMM:  emitMovImm(out, rx, d->kk);                                    break;
+            case ADDIMM: emitImm(out, IMM_ADD, rx, d->kk); emitImm(out, IMM_AND, rx, 0xFF); break;
+            case LDI:    emitRR(out, X86_MOV, rx, ry);                                  break;
+            case OR:
+            case AND:
+            case XOR:    emitRR(out, d->opcode == OR ? X86_OR : d->opcode == AND ? X86_AND : X86_XOR, rx, ry);
+                         if (quirks & QUIRK_VF_RESET) emitMovImm(out, vf, 0);           break;
+
+            case ADDREG: emitRR(out, X86_ADD, rx, ry);       // carry ends up in bit 8
+                         emitRR(out, X86_MOV, RAX, rx);
+                         emitShift(out, 5, RAX, 8);
+                         emitImm(out, IMM_AND, rx, 0xFF);
+                         emitRR(out, X86_MOV, vf, RAX);                                 break;
+
+            case SUB:    emitRR(out, X86_CMP, rx, ry);       // VF = no borrow
+                         emitSetccRax(out, CC_AE);
+                         emitRR(out, X86_SUB, rx, ry);
+                         emitImm(out, IMM_AND, rx, 0xFF);
+                         emitRR(out, X86_MOV, vf, RAX);                                 break;
+
+            case SHR:    emitRR(out, X86_MOV, RAX, shifted);
+                         emitImm(out, IMM_AND, RAX, 0x01);
+                         if (shifted != rx) emitRR(out, X86_MOV, rx, shifted);
+                         emitShift(out, 5, rx, 1);
+                         emitRR(out, X86_MOV, vf, RAX);                                 break;
+
+            case SUBN:   emitRR(out, X86_MOV, RAX, ry);      // same as runInstruction: VF compares against the new Vx
+                         emitRR(out, X86_SUB, RAX, rx);
+                         emitImm(out, IMM_AND, RAX, 0xFF);
+                         emitRR(out, X86_MOV, rx, RAX);
+                         emitRR(out, X86_CMP, ry, rx);
+                         emitSetccRax(out, CC_A);
+                         emitRR(out, X86_MOV, vf, RAX);                                 break;
+
+            case SHL:    emitRR(out, X86_MOV, RAX, shifted);
+                         emitShift(out, 5, RAX, 7);
+                         if (shifted != rx) emitRR(out, X86_MOV, rx, shifted);
+                         emitShift(out, 4, rx, 1);
+                         emitImm(out, IMM_AND, rx, 0xFF);
+                         emitRR(out, X86_MOV, vf, RAX);                                 break;
+
+            case LD:     emit8(out, 0x66); emit8(out, 0xC7); emit8(out, 0x06);           // mov word [rsi], nnn
+                         emit16(out, d->nnn);                                           break;
+
+            case ADDIVX: emit8(out, 0x66); emitRex(out, rx, 0, 0);                      // add word [rsi], rx16
+                         emit8(out, 0x01); emit8(out, (rx & 7) << 3 | RSI);             break;
+
+            case LDFVX:  if (rx >= 8) emit8(out, 0x43);                                 // lea eax, [rx + rx*4 + 0]
+                         emit8(out, 0x8D); emit8(out, 0x44);
+                         emit8(out, 0x80 | (rx & 7) << 3 | (rx & 7)); emit8(out, 0);
+                         emit8(out, 0x66); emit8(out, 0x89); emit8(out, 0x06);          break; // mov word [rsi], ax
+
+            case JPADR:  emitMovImm(out, RAX, jitExit(length, d->nnn));                 break;
+
+            case SEIMM:
+            case SNE:
+            case SEREG:
+            case SNEREG: if (d->opcode == SEIMM || d->opcode == SNE) emitImm(out, IMM_CMP, rx, d->kk);
+                         else                                         emitRR(out, X86_CMP, rx, ry);
+                         emitMovImm(out, RAX, jitExit(length, at + 2));
+                         // jump over the skip when its condition fails
+                         emit8(out, 0x70 | (d->opcode == SEIMM || d->opcode == SEREG ? CC_NE : CC_E));
+                         emit8(out, 5);
+                         emitMovImm(out, RAX, jitExit(length, at + 4));                 break;
+
+            default:                                                                    break;
+        }
+    }
+    if (!hasTerminator) emitMovImm(out, RAX, jitExit(length, at)); // fell off the end, continue after the last one
+
+    uint8_t *epilogue = cursor;
+    if (counted) { emit8(out, 0x48); emit8(out, 0x83); emit8(out, 0xC4); emit8(out, 8); } // add rsp, 8
+    for (int r = 0; r < 0x10; r++) {
+        if (written & (1 << r)) emitStoreV(out, hostReg[r], r);
+    }
+    for (int k = used - 1; k >= 0; k--) {
+        if (IS_CALLEE_SAVED(jitPool[k])) emitPop(out, jitPool[k]);
+    }
+    emit8(out, 0xC3); // ret
+
+    // the early exits. V registers the block hasn't written yet hold what was loaded, so storing them is harmless
+    for (int k = 1; k < length && counted; k++) {
+        patchRel32(exits[k], cursor);
+        emitMovImm(out, RAX, jitExit(k, pc + 2 * k));
+        emit8(out, 0xE9);                                            // jmp epilogue
+        emit32(out, (uint32_t)(epilogue - (cursor + 4)));
+    }
+
+    m->jitArenaUsed += *out - start;
+    if (counted) {
+        block->counted = (jit_fn_t)(void *)start;
+        return;
+    }
+    block->code = (jit_fn_t)(void *)start;
+    block->length = length;
+    m->jitBlocksCompiled++;
+}
+
+void jitCompile(machine_t *m, uint16_t pc) {
+    compileBlock(m, pc, 0);
+}
+
+int runCyclesJit(machine_t *m, int count) {
+    int executed = 0;
+    while (executed < count) {
+        m->PC &= m->memoryEnd;
+        if (!(m->PC & 1)) {
+            if (m->decodeCache[m->PC >> 1].idleLength) {
+                executed += idleFastForward(m, m->PC, count - executed);
+                if (executed == count) break;
+            }
+            jit_block_t *block = &m->jitBlocks[m->PC >> 1];
+            if (!block->tried) jitCompile(m, m->PC);
+            // a block longer than what's left of count runs its counted variant, which stops right on count,
+            // so frames keep exactly INSTRUCTIONS_PER_FRAME instructions
+            int budget = count - executed;
+            if (block->code != NULL && block->length > budget && block->counted == NULL) {
+                compileBlock(m, m->PC, 1);
+            }
+            jit_fn_t code = block->length <= budget ? block->code : block->counted;
+            if (code != NULL) {
+                uint32_t exit = code(m->v, &m->I, (uint32_t)budget);
+                m->PC = exit & 0xFFFF;
+                executed += exit >> 16;
+                m->jitNativeInstructions += exit >> 16;
+                continue;
+            }
+        }
+        executed++;
+        if (clockCycle(m)) return executed;
+    }
+    return executed;
+}
+#endif
@@ -0,0 +1,521 @@
+#include "lockstep.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// ##########  VECTORS  ##########
+// a row of LOCKSTEP_LANES bytes goes through in chunks of VEC_BYTES: one AVX2 register, two SSE2 ones, or
+// a byte at a time where there's neither. Comparisons give 0xFF/0x00 per lane, flags are turned into 1/0
+#if defined(__AVX2__)
+typedef __m256i vec_t;
+#define VEC_BYTES 32
+#define VEC_NAME  "avx2"
+static inline vec_t vLoad(const uint8_t *p)       { return _mm256_load_si256((const __m256i *)p); }
+static inline void  vStore(uint8_t *p, vec_t a)   { _mm256_store_si256((__m256i *)p, a); }
+static inline vec_t vSet(uint8_t k)               { return _mm256_set1_epi8((char)k); }
+static inline vec_t vAdd(vec_t a, vec_t b)        { return _mm256_add_epi8(a, b); }
+static inline vec_t vAddSat(vec_t a, vec_t b)     { return _mm256_adds_epu8(a, b); }
+static inline vec_t vSub(vec_t a, vec_t b)        { return _mm256_sub_epi8(a, b); }
+static inline vec_t vAnd(vec_t a, vec_t b)        { return _mm256_and_si256(a, b); }
+static inline vec_t vAndNot(vec_t a, vec_t b)     { return _mm256_andnot_si256(a, b); } // ~a & b
+static inline vec_t vOr(vec_t a, vec_t b)         { return _mm256_or_si256(a, b); }
+static inline vec_t vXor(vec_t a, vec_t b)        { return _mm256_xor_si256(a, b); }
+static inline vec_t vMax(vec_t a, vec_t b)        { return _mm256_max_epu8(a, b); }
+static inline vec_t vMin(vec_t a, vec_t b)        { return _mm256_min_epu8(a, b); }
+static inline vec_t vEq(vec_t a, vec_t b)         { return _mm256_cmpeq_epi8(a, b); }
+static inline vec_t vShr1(vec_t a)                { return vAnd(_mm256_srli_epi16(a, 1), vSet(0x7F)); }
+static inline vec_t vTop(vec_t a)                 { return vAnd(_mm256_srli_epi16(a, 7), vSet(1)); }
+static inline uint32_t vMask(vec_t a)             { return (uint32_t)_mm256_movemask_epi8(a); }
+#elif defined(__SSE2__)
+typedef __m128i vec_t;
+#define VEC_BYTES 16
+#define VEC_NAME  "sse2"
+static inline vec_t vLoad(const uint8_t *p)       { return _mm_load_si128((const __m128i *)p); }
+static inline void  vStore(uint8_t *p, vec_t a)   { _mm_store_si128((__m128i *)p, a); }
+static inline vec_t vSet(uint8_t k)               { return _mm_set1_epi8((char)k); }
+static inline vec_t vAdd(vec_t a, vec_t b)        { return _mm_add_epi8(a, b); }
+static inline vec_t vAddSat(vec_t a, vec_t b)     { return _mm_adds_epu8(a, b); }
+static inline vec_t vSub(vec_t a, vec_t b)        { return _mm_sub_epi8(a, b); }
+static inline vec_t vAnd(vec_t a, vec_t b)        { return _mm_and_si128(a, b); }
+static inline vec_t vAndNot(vec_t a, vec_t b)     { return _mm_andnot_si128(a, b); }
+static inline vec_t vOr(vec_t a, vec_t b)         { return _mm_or_si128(a, b); }
+static inline vec_t vXor(vec_t a, vec_t b)        { return _mm_xor_si128(a, b); }
+static inline vec_t vMax(vec_t a, vec_t b)        { return _mm_max_epu8(a, b); }
+static inline vec_t vMin(vec_t a, vec_t b)        { return _mm_min_epu8(a, b); }
+static inline vec_t vEq(vec_t a, vec_t b)         { return _mm_cmpeq_epi8(a, b); }
+static inline vec_t vShr1(vec_t a)                { return vAnd(_mm_srli_epi16(a, 1), vSet(0x7F)); }
+static inline vec_t vTop(vec_t a)                 { return vAnd(_mm_srli_epi16(a, 7), vSet(1)); }
+static inline uint32_t vMask(vec_t a)             { return (uint32_t)_mm_movemask_epi8(a); }
+#else
+typedef uint8_t vec_t;
+#define VEC_BYTES 1
+#define VEC_NAME  "none"
+static inline vec_t vLoad(const uint8_t *p)       { return *p; }
+static inline void  vStore(uint8_t *p, vec_t a)   { *p = a; }
+static inline vec_t vSet(uint8_t k)               { return k; }
+static inline vec_t vAdd(vec_t a, vec_t b)        { return a + b; }
+static inline vec_t vAddSat(vec_t a, vec_t b)     { return a + b > 0xFF ? 0xFF : a + b; }
+static inline vec_t vSub(vec_t a, vec_t b)        { return a - b; }
+static inline vec_t vAnd(vec_t a, vec_t b)        { return a & b; }
+static inline vec_t vAndNot(vec_t a, vec_t b)     { return ~a & b; }
+static inline vec_t vOr(vec_t a, vec_t b)         { return a | b; }
+static inline vec_t vXor(vec_t a, vec_t b)        { return a ^ b; }
+static inline vec_t vMax(vec_t a, vec_t b)        { return a > b ? a : b; }
+static inline vec_t vMin(vec_t a, vec_t b)        { return a < b ? a : b; }
+static inline vec_t vEq(vec_t a, vec_t b)         { return a == b ? 0xFF : 0x00; }
+static inline vec_t vShr1(vec_t a)                { return a >> 1; }
+static inline vec_t vTop(vec_t a)                 { return a >> 7; }
+static inline uint32_t vMask(vec_t a)             { return a >> 7; }
+#endif
+
+_Static_assert(LOCKSTEP_LANES % VEC_BYTES == 0 && LOCKSTEP_LANES <= 32, "rows are whole vectors, masks a uint32_t");
+
+#define FOR_CHUNKS(c) for (int c = 0; c < LOCKSTEP_LANES; c += VEC_BYTES)
+
+// bit n set where lane n of the row is kk
+static inline uint32_t rowEquals(const uint8_t *row, uint8_t kk) {
+    uint32_t bits = 0;
+    FOR_CHUNKS(c) bits |= vMask(vEq(vLoad(&row[c]), vSet(kk))) << c;
+    return bits;
+}
+
+// bit n set where lane n is the same in both rows
+static inline uint32_t rowsEqual(const uint8_t *a, const uint8_t *b) {
+    uint32_t bits = 0;
+    FOR_CHUNKS(c) bits |= vMask(vEq(vLoad(&a[c]), vLoad(&b[c]))) << c;
+    return bits;
+}
+
+static int countLanes(uint32_t lanes) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(lanes);
+#else
+    int n = 0;
+    for (; lanes; lanes &= lanes - 1) n++;
+    return n;
+#endif
+}
+
+
+// ##########  ONE LANE AT A TIME  ##########
+// what invalidateDecodeCache() does on a machine, for one lane
+static void laneWrote(lockstep_t *g, int l, uint16_t address, int length) {
+    int end = address + length;
+    if (end > g->memoryEnd + 1) { // wrapped around to 0
+        laneWrote(g, l, 0, end - (g->memoryEnd + 1));
+        end = g->memoryEnd + 1;
+    }
+    for (int i = address & ~1; i < end; i += 2) {
+        g->words[l][i >> 1] = g->ram[l][i] << 8 | g->ram[l][i + 1];
+        g->laneRewritten[l][i >> 7] |= 1ULL << (i >> 1 & 63);
+        g->rewritten[i >> 1] = 1;
+    }
+}
+
+// execute() for one lane. Same PC conventions, the caller adds 2 afterwards
+static int laneExecute(lockstep_t *g, int l, const decoded_t *d) {
+    const unsigned quirks = g->quirkBits;
+    uint8_t x = d->x, y = d->y, kk = d->kk;
+    uint16_t nnn = d->nnn;
+    uint16_t *pc = &g->PC[l], *I = &g->I[l];
+    uint8_t *sp = &g->SP[l], *ram = g->ram[l];
+    frame_buffer_t *screen = &g->frameBuffer[l];
+#define V(r) g->v[r][l]
+#define SKIP (skipLength(ram, *pc, quirks) - 2)
+
+    switch (d->opcode) {
+        case ROM_END: printf("ROM END READ\n");         return -1;
+        case ILLEGAL: printf("Illegal instruction\n");  return -1;
+        case SYS:     printf("Syscall (illegal)\n");    return -1;
+
+        case CLS:    clearPlanes(screen);                break;
+        case RET:    *pc = g->stack[*sp & (STACK_SIZE - 1)][l]; (*sp)--; break;
+        case JPADR:  *pc = nnn - 2;                      break;
+        case CALL:   (*sp)++; g->stack[*sp & (STACK_SIZE - 1)][l] = *pc; *pc = nnn - 2; break;
+        case SEIMM:  if (V(x) == kk) *pc += SKIP;        break;
+        case SNE:    if (V(x) != kk) *pc += SKIP;        break;
+        case SEREG:  if (V(x) == V(y)) *pc += SKIP;      break;
+        case LDIMM:  V(x) = kk;                          break;
+        case ADDIMM: V(x) += kk;                         break;
+        case LDI:    V(x) = V(y);                        break;
+        case OR:     V(x) |= V(y); if (quirks & QUIRK_VF_RESET) V(0xF) = 0; break;
+        case AND:    V(x) &= V(y); if (quirks & QUIRK_VF_RESET) V(0xF) = 0; break;
+        case XOR:    V(x) ^= V(y); if (quirks & QUIRK_VF_RESET) V(0xF) = 0; break;
+
+        case ADDREG: { uint32_t sum = V(x) + V(y);
+                       V(x) = sum & 0xFF; V(0xF) = (sum & 0xFF00) != 0; break; }
+        case SUB:    { uint32_t diff = V(x) - V(y);
+                       V(x) = diff & 0xFF; V(0xF) = (diff & 0xFF00) == 0; break; }
+        case SHR:    { uint8_t f = V(quirks & QUIRK_SHIFT_VY ? y : x);
+                       V(x) = f >> 1; V(0xF) = f & 0x01; break; }
+        case SUBN:   V(x) = V(y) - V(x); V(0xF) = V(y) > V(x); break;
+        case SHL:    { uint8_t f = V(quirks & QUIRK_SHIFT_VY ? y : x);
+                       V(x) = f << 1; V(0xF) = f >> 7; break; }
+
+        case SNEREG: *pc += V(x) != V(y) ? SKIP : 0;     break;
+        case LD:     *I = nnn;                           break;
+        case JPREG:  *pc = nnn + V(quirks & QUIRK_JUMP_VX ? x : 0x0) - 2; break;
+        case RND:    V(x) = nextRandomByte(&g->rngState[l]) & kk; break;
+        case DRW:    V(0xF) = drawSpriteOn(screen, ram, *I, V(x), V(y), d->n, quirks); break;
+        case SKP:    if (g->keypad[l] >> (V(x) & 0xF) & 1) *pc += SKIP; break;
+        case SKNP:   if (!(g->keypad[l] >> (V(x) & 0xF) & 1)) *pc += SKIP; break;
+        case LDREGDT:V(x) = g->DT[l];                    break;
+
+        case LDK:    // waitForKey()
+                     if (g->keyHeld[l] == KEY_NONE)              g->keyHeld[l] = keypadKey(g->keypad[l]);
+                     else if (!(g->keypad[l] >> g->keyHeld[l] & 1)) { V(x) = g->keyHeld[l]; g->keyHeld[l] = KEY_NONE; break; }
+                     *pc -= 2;                                   break;
+
+        case LDDTVX: g->DT[l] = V(x);                    break;
+        case LDSTVX: g->ST[l] = V(x);                    break;
+        case ADDIVX: *I += V(x);                         break;
+        case LDFVX:  *I = V(x) * 5;                      break;
+
+        case LDBVX:  { uint8_t value = V(x);
+                       ram[*I & g->memoryEnd]       = value / 100;
+                       ram[(*I + 1) & g->memoryEnd] = (value / 10) % 10;
+                       ram[(*I + 2) & g->memoryEnd] = value % 10;
+                       laneWrote(g, l, *I & g->memoryEnd, 3); break; }
+
+        case LDIVX:  for (int i = 0; i <= x; i++) ram[(*I + i) & g->memoryEnd] = V(i);
+                     laneWrote(g, l, *I & g->memoryEnd, x + 1);
+                     if (quirks & QUIRK_LOAD_I)   *I += x + 1;
+                     if (quirks & QUIRK_LOAD_I_X) *I += x;     break;
+
+        case LDVXI:  for (int i = 0; i <= x; i++) V(i) = ram[(*I + i) & g->memoryEnd];
+                     if (quirks & QUIRK_LOAD_I)   *I += x + 1;
+                     if (quirks & QUIRK_LOAD_I_X) *I += x;     break;
+
+        case SCD:    scrollDown(screen, d->n);           break;
+        case SCU:    scrollUp(screen, d->n);             break;
+        case SCR:    scrollRight(screen);                break;
+        case SCL:    scrollLeft(screen);                 break;
+        case EXIT:   printf("Exit (00FD)\n");            return -1;
+        case LOW:    setResolution(screen, 0);           break;
+        case HIGH:   setResolution(screen, 1);           break;
+        case LDHF:   *I = BIG_FONT_START + (V(x) & 0xF) * 10; break;
+        case LDRVX:  for (int i = 0; i <= x; i++) g->rpl[l][i] = V(i); break;
+        case LDVXR:  for (int i = 0; i <= x; i++) V(i) = g->rpl[l][i]; break;
+
+        case SAVE: { int step = x <= y ? 1 : -1, count = (x <= y ? y - x : x - y) + 1;
+                     for (int i = 0; i < count; i++) ram[(*I + i) & g->memoryEnd] = V(x + i * step);
+                     laneWrote(g, l, *I & g->memoryEnd, count); break; }
+
+        case LOAD: { int step = x <= y ? 1 : -1, count = (x <= y ? y - x : x - y) + 1;
+                     for (int i = 0; i < count; i++) V(x + i * step) = ram[(*I + i) & g->memoryEnd];
+                     break; }
+
+        case LDILONG:*I = ram[(*pc + 2) & g->memoryEnd] << 8 | ram[(*pc + 3) & g->memoryEnd];
+                     *pc += 2;                           break;
+        case PLANE:  screen->planes = x & 3;             break;
+        case AUDIO:                                      // nothing a lane computes depends on the sound, and
+        case PITCH:                                      break; // lockstep runs are headless
+
+        default:     printf("OPCODE UNDEFINED\n");       return -1;
+    }
+#undef V
+#undef SKIP
+    return 0;
+}
+
+// keeps what a lane had when its rom stopped, and takes it out of the group
+static void stopLane(lockstep_t *g, int l) {
+    lane_regs_t *regs = &g->stopped[l];
+    for (int r = 0; r < 0x10; r++) regs->v[r] = g->v[r][l];
+    regs->I  = g->I[l];
+    regs->PC = g->PC[l];
+    regs->DT = g->DT[l];
+    regs->ST = g->ST[l];
+    g->running &= ~(1u << l);
+}
+
+// one instruction on one lane, PC included. Returns the lane's bit if its rom stopped
+static uint32_t runLane(lockstep_t *g, int l, const decoded_t *d) {
+    int status = laneExecute(g, l, d);
+    g->PC[l] += 2;
+    if (status == 0) {
+        g->PC[l] &= g->memoryEnd; // jumps, returns and running off the end wrap like cycle() wraps them
+        return 0;
+    }
+    stopLane(g, l);
+    return 1u << l;
+}
+
+// after the lanes ran on their own: back to vector instructions if every running lane is at the same place
+static void regroup(lockstep_t *g) {
+    int first = -1;
+    for (int l = 0; l < g->lanes; l++) {
+        if (!(g->running >> l & 1)) continue;
+        if (first < 0) first = l;
+        else if (g->PC[l] != g->PC[first]) {
+            if (g->converged) g->splits++;
+            g->converged = 0;
+            return;
+        }
+    }
+    if (first < 0) return;
+    g->converged = 1;
+    g->pc = g->PC[first];
+}
+
+// every running lane fetches and runs its own next instruction
+static uint32_t splitStep(lockstep_t *g) {
+    uint32_t stopped = 0;
+    int ran = 0;
+    for (int l = 0; l < g->lanes; l++) {
+        if (!(g->running >> l & 1)) continue;
+        uint16_t pc = g->PC[l] &= g->memoryEnd;
+        decoded_t word;
+        const decoded_t *d = &g->code[pc >> 1];
+        if (pc & 1) {
+            word = decodeWord(g->ram[l][pc] << 8 | g->ram[l][(pc + 1) & g->memoryEnd]);
+            d = &word;
+        } else if (g->laneRewritten[l][pc >> 7] >> (pc >> 1 & 63) & 1) {
+            word = decodeWord(g->words[l][pc >> 1]);
+            d = &word;
+        }
+        stopped |= runLane(g, l, d);
+        ran++;
+    }
+    g->laneInstructions += ran;
+    g->splitInstructions += ran;
+    regroup(g);
+    return stopped;
+}
+
+// the lanes are together, but the instruction depends on what's in each of them (the stack, the keypad, RAM)
+static uint32_t laneByLane(lockstep_t *g, const decoded_t *d) {
+    uint32_t stopped = 0;
+    int ran = 0;
+    for (int l = 0; l < g->lanes; l++) {
+        if (!(g->running >> l & 1)) continue;
+        g->PC[l] = g->pc;
+        stopped |= runLane(g, l, d);
+        ran++;
+    }
+    g->laneInstructions += ran;
+    regroup(g);
+    return stopped;
+}
+
+
+// ##########  ALL LANES AT ONCE  ##########
+// runs d on every lane, all of them at g->pc. Rows are written whole, stopped lanes included: stopLane() kept
+// their registers, and RAM, the stack and the screen are only written lane by lane
+static uint32_t vectorStep(lockstep_t *g, const decoded_t *d) {
+    uint8_t (*v)[LOCKSTEP_LANES] = g->v;
+    const unsigned quirks = g->quirkBits;
+    const uint8_t x = d->x, y = d->y, kk = d->kk;
+    const vec_t one = vSet(1);
+    uint16_t next = (g->pc + 2) & g->memoryEnd;
+    uint32_t skipping;
+
+    switch (d->opcode) {
+        case JPADR:  next = d->nnn;                                                          break;
+        case LDIMM:  FOR_CHUNKS(c) vStore(&v[x][c], vSet(kk));                               break;
+        case ADDIMM: FOR_CHUNKS(c) vStore(&v[x][c], vAdd(vLoad(&v[x][c]), vSet(kk)));        break;
+        case LDI:    FOR_CHUNKS(c) vStore(&v[x][c], vLoad(&v[y][c]));                        break;
+
+        case OR:     FOR_CHUNKS(c) vStore(&v[x][c], vOr(vLoad(&v[x][c]), vLoad(&v[y][c])));
+                     if (quirks & QUIRK_VF_RESET) memset(v[0xF], 0, LOCKSTEP_LANES);          break;
+        case AND:    FOR_CHUNKS(c) vStore(&v[x][c], vAnd(vLoad(&v[x][c]), vLoad(&v[y][c])));
+                     if (quirks & QUIRK_VF_RESET) memset(v[0xF], 0, LOCKSTEP_LANES);          break;
+        case XOR:    FOR_CHUNKS(c) vStore(&v[x][c], vXor(vLoad(&v[x][c]), vLoad(&v[y][c])));
+                     if (quirks & QUIRK_VF_RESET) memset(v[0xF], 0, LOCKSTEP_LANES);          break;
+
+        // carry: the saturating sum stopped short of the wrapped one
+        case ADDREG: FOR_CHUNKS(c) { vec_t a = vLoad(&v[x][c]), b = vLoad(&v[y][c]), sum = vAdd(a, b);
+                                     vStore(&v[x][c], sum);
+                                     vStore(&v[0xF][c], vAndNot(vEq(vAddSat(a, b), sum), one)); } break;
+        // no borrow: a >= b
+        case SUB:    FOR_CHUNKS(c) { vec_t a = vLoad(&v[x][c]), b = vLoad(&v[y][c]);
+                                     vStore(&v[x][c], vSub(a, b));
+                                     vStore(&v[0xF][c], vAnd(vEq(vMax(a, b), a), one)); }     break;
+        // VF compares against the new Vx, and Vy read again after it was written, like execute() does
+        case SUBN:   FOR_CHUNKS(c) { vec_t diff = vSub(vLoad(&v[y][c]), vLoad(&v[x][c]));
+                                     vStore(&v[x][c], diff);
+                                     vec_t b = vLoad(&v[y][c]);
+                                     vStore(&v[0xF][c], vAndNot(vEq(vMin(b, diff), b), one)); } break;
+        case SHR:    FOR_CHUNKS(c) { vec_t f = vLoad(&v[quirks & QUIRK_SHIFT_VY ? y : x][c]);
+                                     vStore(&v[x][c], vShr1(f));
+                                     vStore(&v[0xF][c], vAnd(f, one)); }                      break;
+        case SHL:    FOR_CHUNKS(c) { vec_t f = vLoad(&v[quirks & QUIRK_SHIFT_VY ? y : x][c]);
+                                     vStore(&v[x][c], vAdd(f, f));
+                                     vStore(&v[0xF][c], vTop(f)); }                           break;
+
+        case SEIMM:  skipping =  rowEquals(v[x], kk);                                        goto skip;
+        case SNE:    skipping = ~rowEquals(v[x], kk);                                        goto skip;
+        case SEREG:  skipping =  rowsEqual(v[x], v[y]);                                      goto skip;
+        case SNEREG: skipping = ~rowsEqual(v[x], v[y]);                                      goto skip;
+
+        case LD:     for (int l = 0; l < LOCKSTEP_LANES; l++) g->I[l] = d->nnn;              break;
+        case ADDIVX: for (int l = 0; l < LOCKSTEP_LANES; l++) g->I[l] += v[x][l];            break;
+        case LDFVX:  for (int l = 0; l < LOCKSTEP_LANES; l++) g->I[l] = v[x][l] * 5;         break;
+        case LDREGDT:memcpy(v[x], g->DT, LOCKSTEP_LANES);                                    break;
+        case LDDTVX: memcpy(g->DT, v[x], LOCKSTEP_LANES);                                    break;
+        case LDSTVX: memcpy(g->ST, v[x], LOCKSTEP_LANES);                                    break;
+        case CLS:    for (int l = 0; l < g->lanes; l++) {
+                         if (g->running >> l & 1) clearPlanes(&g->frameBuffer[l]);
+                     }                                                                       break;
+
+        default:     return laneByLane(g, d);
+    }
+    g->pc = next;
+    g->vectorInstructions += countLanes(g->running);
+    return 0;
+
+skip:
+    // an F000 nnnn after it makes the skip longer, the same for every lane unless one of them wrote there
+    if ((quirks & QUIRK_LONG_SKIP) && g->rewritten[next >> 1]) return laneByLane(g, d);
+    int taken = quirks & QUIRK_LONG_SKIP && g->code[next >> 1].instruction == 0xF000 ? 6 : 4;
+
+    // all or none of the lanes skipping keeps them together
+    g->vectorInstructions += countLanes(g->running);
+    skipping &= g->running;
+    if (skipping == 0)               g->pc = next;
+    else if (skipping == g->running) g->pc = (g->pc + taken) & g->memoryEnd;
+    else {
+        for (int l = 0; l < g->lanes; l++) g->PC[l] = (g->pc + (skipping >> l & 1 ? taken : 2)) & g->memoryEnd;
+        g->converged = 0;
+        g->splits++;
+    }
+    return 0;
+}
+
+// one instruction on every running lane. Returns the lanes whose rom stopped
+static uint32_t step(lockstep_t *g) {
+    if (!g->converged) return splitStep(g);
+
+    uint16_t pc = g->pc &= g->memoryEnd;
+    if (!(pc & 1) && !g->rewritten[pc >> 1]) return vectorStep(g, &g->code[pc >> 1]);
+
+    // odd, or some lane wrote over it: each lane reads its own instruction here
+    for (int l = 0; l < g->lanes; l++) g->PC[l] = pc;
+    g->converged = 0;
+    return splitStep(g);
+}
+
+
+// ##########  THE GROUP  ##########
+lockstep_t *createLockstep(const uint8_t *rom, size_t size, int lanes, quirks_t quirks, int wrapSprites) {
+    if (lanes < 1 || lanes > LOCKSTEP_LANES) return NULL;
+
+    // every lane starts out as a freshly loaded machine, font and decode cache included
+    machine_t *m = createMachine(CORE_SWITCH);
+    if (m == NULL) return NULL;
+    setQuirks(m, quirks, wrapSprites);
+    if (loadRomImage(m, rom, size)) {
+        destroyMachine(m);
+        return NULL;
+    }
+
+    size_t ramSize = (size_t)m->memoryEnd + 1, header = (sizeof(lockstep_t) + 63) & ~(size_t)63;
+    size_t bytes = header + lanes * ramSize * 2; // each lane's RAM, then each lane's words (aligned_alloc() wants
+    lockstep_t *g = aligned_alloc(64, bytes);    // a multiple of 64, which 4 KB is)
+    if (g == NULL) {
+        destroyMachine(m);
+        return NULL;
+    }
+    memset(g, 0, sizeof(*g));
+    g->lanes = lanes;
+    g->quirkBits = m->quirkBits;
+    g->memoryEnd = m->memoryEnd;
+    g->running = lanes == 32 ? 0xFFFFFFFFu : (1u << lanes) - 1;
+    g->converged = 1;
+    g->pc = m->PC;
+    for (int l = 0; l < lanes; l++) {
+        g->ram[l] = (uint8_t *)g + header + l * ramSize;
+        g->words[l] = (uint16_t *)((uint8_t *)g + header + (lanes + l) * ramSize);
+        memcpy(g->ram[l], m->ram, ramSize);
+    }
+    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+        resetFrameBuffer(&g->frameBuffer[l]);
+        g->PC[l] = m->PC;
+        g->keyHeld[l] = KEY_NONE;
+    }
+    memcpy(g->code, m->decodeCache, sizeof(g->code));
+
+    destroyMachine(m);
+    return g;
+}
+
+void destroyLockstep(lockstep_t *g) {
+    free(g);
+}
+
+void setLaneSeed(lockstep_t *g, int lane, uint64_t seed) {
+    g->rngState[lane] = seed;
+}
+
+int runLockstep(lockstep_t *g, uint64_t maxCycles, uint64_t maxFrames) {
+    uint64_t cycles = 0, frames = 0;
+    while (g->running && (maxCycles == 0 || cycles < maxCycles) && (maxFrames == 0 || frames < maxFrames)) {
+        int count = INSTRUCTIONS_PER_FRAME;
+        if (maxCycles != 0 && maxCycles - cycles < (uint64_t)count) count = (int)(maxCycles - cycles);
+
+        for (int i = 0; i < count && g->running; i++) {
+            uint32_t stopped = step(g);
+            cycles++;
+            for (int l = 0; stopped; l++, stopped >>= 1) {
+                if (stopped & 1) { g->cycles[l] = cycles; g->frames[l] = frames; }
+            }
+        }
+        if (g->running && cycles % INSTRUCTIONS_PER_FRAME == 0) {
+            for (int l = 0; l < LOCKSTEP_LANES; l++) { // tickTimers() on every lane
+                g->DT[l] -= g->DT[l] == 0 ? 0 : 1;
+                g->ST[l] -= g->ST[l] == 0 ? 0 : 1;
+            }
+            frames++;
+        }
+    }
+    for (int l = 0; l < g->lanes; l++) {
+        if (g->running >> l & 1) { g->cycles[l] = cycles; g->frames[l] = frames; }
+    }
+    return g->running ? 0 : -1;
+}
+
+int laneStopped(const lockstep_t *g, int lane) {
+    return !(g->running >> lane & 1);
+}
+
+uint64_t laneHash(const lockstep_t *g, int lane) {
+    return hashFrame(&g->frameBuffer[lane]);
+}
+
+void copyLane(const lockstep_t *g, int lane, machine_t *m) {
+    memcpy(m->ram, g->ram[lane], (size_t)g->memoryEnd + 1);
+    m->frameBuffer = g->frameBuffer[lane];
+    memcpy(m->rpl, g->rpl[lane], RPL_FLAGS);
+    for (int s = 0; s < STACK_SIZE; s++) m->stack[s] = g->stack[s][lane];
+    m->SP = g->SP[lane];
+    m->rngState = g->rngState[lane];
+    m->keypad = g->keypad[lane];
+    m->keyHeld = g->keyHeld[lane];
+
+    if (laneStopped(g, lane)) {
+        const lane_regs_t *regs = &g->stopped[lane];
+        memcpy(m->v, regs->v, sizeof(m->v));
+        m->I  = regs->I;
+        m->PC = regs->PC;
+        m->DT = regs->DT;
+        m->ST = regs->ST;
+    } else {
+        for (int r = 0; r < 0x10; r++) m->v[r] = g->v[r][lane];
+        m->I  = g->I[lane];
+        m->PC = g->converged ? g->pc : g->PC[lane];
+        m->DT = g->DT[lane];
+        m->ST = g->ST[lane];
+    }
+    m->screenDirty = 1;
+    buildDecodeCache(m);
+#ifdef HAVE_JIT
+    jitFlush(m);
+#endif
+}
+
+const char *lockstepVectorName() {
+    return VEC_NAME;
+}
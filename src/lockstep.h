@@ -0,0 +1,85 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "chip8.h"
+
+// ##########  LOCKSTEP ENGINE  ##########
+// many copies of one rom, each with its own seed and keypad, run as lanes of a single machine. Everything
+// is stored structure-of-arrays (register x of every lane is one row), so while the lanes share a PC an ALU
+// instruction is a few SSE2/AVX2 operations for all of them. When they stop agreeing on where to go (a skip
+// taken by some lanes, a RET to different places) every lane runs on its own until they meet again.
+// Gives exactly the results each copy would get on its own machine_t with runUnpaced()
+
+#define LOCKSTEP_LANES 32   // one AVX2 register of bytes, so lane masks fit a uint32_t
+
+// a lane's registers when it stopped. The vector instructions keep writing every lane's row
+typedef struct {
+    uint8_t  v[0x10];
+    uint16_t I, PC;
+    uint8_t  DT, ST;
+} lane_regs_t;
+
+typedef struct lockstep {
+    _Alignas(32) uint8_t v[0x10][LOCKSTEP_LANES];  // v[x][lane]
+    _Alignas(32) uint8_t DT[LOCKSTEP_LANES];
+    _Alignas(32) uint8_t ST[LOCKSTEP_LANES];
+    uint8_t  SP[LOCKSTEP_LANES];
+    uint16_t I[LOCKSTEP_LANES];
+    uint16_t PC[LOCKSTEP_LANES];                    // only kept up to date while the lanes are split
+    uint16_t stack[STACK_SIZE][LOCKSTEP_LANES];
+    uint64_t rngState[LOCKSTEP_LANES];
+    uint16_t keypad[LOCKSTEP_LANES];                // set by whoever runs the group, like machine_t.keypad
+    uint8_t  keyHeld[LOCKSTEP_LANES];
+    uint8_t  rpl[LOCKSTEP_LANES][RPL_FLAGS];
+    frame_buffer_t frameBuffer[LOCKSTEP_LANES];
+    uint8_t  *ram[LOCKSTEP_LANES];                  // memoryEnd + 1 bytes per lane, allocated after the group
+
+    // decoded once from the rom for all lanes. A lane that writes over an instruction runs its own word from
+    // then on, and the entry can't run as a vector instruction any more
+    decoded_t code[RAM_SIZE / 2];
+    uint8_t  rewritten[RAM_SIZE / 2];                       // by some lane
+    uint64_t laneRewritten[LOCKSTEP_LANES][RAM_SIZE / 128]; // bitmap per lane, which of words[] to use
+    uint16_t *words[LOCKSTEP_LANES];                        // (memoryEnd + 1) / 2 per lane, after the RAM
+
+    int      lanes;
+    unsigned quirkBits;
+    uint16_t memoryEnd;         // MEMORY_MASK(quirkBits), so a CHIP-8 group only has 4 KB a lane
+    uint32_t running;           // lanes that haven't stopped, bit n = lane n
+    int      converged;         // every running lane is at pc
+    uint16_t pc;
+
+    lane_regs_t stopped[LOCKSTEP_LANES];
+    uint64_t cycles[LOCKSTEP_LANES], frames[LOCKSTEP_LANES];  // results of the last runLockstep(), per lane
+
+    uint64_t vectorInstructions;    // lane-instructions run as vector operations
+    uint64_t laneInstructions;      // run one lane at a time, with the lanes together or not
+    uint64_t splitInstructions;     // the part of those where each lane fetched its own instruction
+    uint64_t splits;
+} lockstep_t;
+
+// a group of lanes copies of a rom, in their power-on state. NULL if lanes is out of range, the rom doesn't
+// fit or there's no memory
+lockstep_t *createLockstep(const uint8_t *rom, size_t size, int lanes, quirks_t quirks, int wrapSprites);
+
+void destroyLockstep(lockstep_t *g);
+
+// restarts a lane's RND from seed, before the group runs. Every lane starts from seed 0
+void setLaneSeed(lockstep_t *g, int lane, uint64_t seed);
+
+// runs every lane like runUnpaced() would, until maxCycles instructions or maxFrames frames (0 = no limit).
+// Each lane's cycles and frames end up in g->cycles and g->frames. -1 if every lane stopped
+int runLockstep(lockstep_t *g, uint64_t maxCycles, uint64_t maxFrames);
+
+// whether a lane's rom stopped
+int laneStopped(const lockstep_t *g, int lane);
+
+// hashFrameBuffer() of a lane
+uint64_t laneHash(const lockstep_t *g, int lane);
+
+// puts a lane's state into a machine, to look at it or carry on running it there
+void copyLane(const lockstep_t *g, int lane, machine_t *m);
+
+// which vector instructions this build uses, for printing
+const char *lockstepVectorName();
+
+#endif
@@ -0,0 +1,112 @@
+#include "profile.h"
+
+profile_t *createProfile() {
+    profile_t *p = calloc(1, sizeof(profile_t));
+    if (p != NULL) p->memoryEnd = CHIP8_RAM_SIZE - 1; // grows to XO-CHIP's once it profiles one
+    return p;
+}
+
+void destroyProfile(profile_t *p) {
+    free(p);
+}
+
+// same as runCyclesSwitch(), counting every instruction on the way
+int runCyclesProfiled(machine_t *m, int count) {
+    profile_t *p = m->profile;
+    if (m->memoryEnd > p->memoryEnd) p->memoryEnd = m->memoryEnd;
+    for (int i = 0; i < count; i++) {
+        uint16_t pc = m->PC & m->memoryEnd;
+        opcode_t opcode = (pc & 1) ? decodeInstruction(m->ram[pc] << 8 | m->ram[(pc + 1) & m->memoryEnd])
+                                   : m->decodeCache[pc >> 1].opcode;
+        uint8_t depth = m->SP;
+
+        p->instructions++;
+        p->opcodeCounts[opcode - ROM_END]++;
+        p->pcHits[pc]++;
+
+        int status = clockCycle(m);
+
+        if (opcode == CALL) {
+            int reached = m->SP < STACK_SIZE ? m->SP : STACK_SIZE;
+            p->callDepth[reached]++;
+            if (reached > p->maxDepth) p->maxDepth = reached;
+        } else if (opcode == RET) {
+            p->returnDepth[depth < STACK_SIZE ? depth : STACK_SIZE]++;
+        }
+        if (status) return i + 1;
+    }
+    return count;
+}
+
+void profileTime(profile_timer_t *t, uint64_t ns) {
+    int bucket = 0;
+    while (bucket < PROFILE_TIME_BUCKETS - 1 && ns >> (bucket + 1)) bucket++;
+    t->histogram[bucket]++;
+    t->count++;
+    t->totalNs += ns;
+    if (ns > t->maxNs) t->maxNs = ns;
+}
+
+void profileFrame(profile_t *p, uint64_t cpuNs, uint64_t renderNs, uint64_t inputNs) {
+    p->frames++;
+    if (cpuNs)    profileTime(&p->cpu, cpuNs);
+    if (renderNs) profileTime(&p->render, renderNs);
+    if (inputNs)  profileTime(&p->input, inputNs);
+}
+
+static void writeCounts(FILE *f, const uint64_t *counts, int length, int perLine) {
+    fprintf(f, "[");
+    for (int i = 0; i < length; i++) {
+        if (i % perLine == 0 && length > perLine) fprintf(f, "\n      ");
+        fprintf(f, "%llu%s", (unsigned long long)counts[i], i + 1 < length ? ", " : "");
+    }
+    fprintf(f, length > perLine ? "\n    ]" : "]");
+}
+
+static void writeTimer(FILE *f, const char *name, const profile_timer_t *t, int last) {
+    fprintf(f, "    \"%s\": {\"count\": %llu, \"total_ns\": %llu, \"mean_ns\": %.1f, \"max_ns\": %llu, "
+            "\"log2_ns_histogram\": ", name, (unsigned long long)t->count, (unsigned long long)t->totalNs,
+            t->count ? (double)t->totalNs / t->count : 0.0, (unsigned long long)t->maxNs);
+    writeCounts(f, t->histogram, PROFILE_TIME_BUCKETS, PROFILE_TIME_BUCKETS);
+    fprintf(f, "}%s\n", last ? "" : ",");
+}
+
+int writeProfileJson(const profile_t *p, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("Error opening profile");
+        return -1;
+    }
+
+    fprintf(f, "{\n  \"instructions\": %llu,\n  \"opcodes\": {", (unsigned long long)p->instructions);
+    int first = 1;
+    for (int op = ROM_END; op <= OPCODE_LAST; op++) {
+        if (p->opcodeCounts[op - ROM_END] == 0) continue;
+        fprintf(f, "%s\n    \"%s\": %llu", first ? "" : ",", opcodeName(op),
+                (unsigned long long)p->opcodeCounts[op - ROM_END]);
+        first = 0;
+    }
+    fprintf(f, "\n  },\n");
+
+    fprintf(f, "  \"pc_heatmap\": ");
+    writeCounts(f, p->pcHits, p->memoryEnd + 1, 32);
+    fprintf(f, ",\n");
+
+    fprintf(f, "  \"call_depth\": {\n    \"max\": %d,\n    \"calls\": ", p->maxDepth);
+    writeCounts(f, p->callDepth, STACK_SIZE + 1, STACK_SIZE + 1);
+    fprintf(f, ",\n    \"returns\": ");
+    writeCounts(f, p->returnDepth, STACK_SIZE + 1, STACK_SIZE + 1);
+    fprintf(f, "\n  },\n");
+
+    fprintf(f, "  \"frames\": %llu,\n  \"frame_time\": {\n", (unsigned long long)p->frames);
+    writeTimer(f, "cpu", &p->cpu, 0);
+    writeTimer(f, "render", &p->render, 0);
+    writeTimer(f, "input", &p->input, 1);
+    fprintf(f, "  }\n}\n");
+
+    if (fclose(f) != 0) {
+        perror("Error writing profile");
+        return -1;
+    }
+    return 0;
+}
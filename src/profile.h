@@ -0,0 +1,46 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "chip8.h"
+
+// ##########  PROFILER  ##########
+// set m->profile to one of these to start counting, back to NULL to stop. While it's NULL the
+// only cost is one branch per runCycles() call. Instruction counts come from runCyclesProfiled(),
+// frame times from whoever runs the frames
+
+#define PROFILE_TIME_BUCKETS 32     // log2 of nanoseconds, 1 ns up to ~4 s
+
+// how long one part of a frame took, over all frames
+typedef struct {
+    uint64_t count, totalNs, maxNs;
+    uint64_t histogram[PROFILE_TIME_BUCKETS];   // frames by floor(log2(ns))
+} profile_timer_t;
+
+typedef struct profile {
+    uint64_t instructions;
+    uint64_t opcodeCounts[OPCODE_COUNT];        // by [opcode - ROM_END]
+    uint64_t pcHits[RAM_SIZE];                  // instructions fetched from every address
+    uint16_t memoryEnd;                         // the machine's, the heatmap only goes that far (4 KB of CHIP-8)
+    uint64_t callDepth[STACK_SIZE + 1];         // CALLs by the depth they reached, the last one is overflow
+    uint64_t returnDepth[STACK_SIZE + 1];       // RETs by the depth they returned from
+    int      maxDepth;
+
+    uint64_t frames;
+    profile_timer_t cpu, render, input;
+} profile_t;
+
+// a zeroed profile. NULL if it can't be allocated
+profile_t *createProfile();
+void destroyProfile(profile_t *p);
+
+// adds a frame's times. Any of them can be 0 if that part didn't run
+void profileFrame(profile_t *p, uint64_t cpuNs, uint64_t renderNs, uint64_t inputNs);
+
+// adds one measurement to a single timer, for when the parts of a frame run on different threads
+// (each timer must only be fed from one of them)
+void profileTime(profile_timer_t *t, uint64_t ns);
+
+// writes everything as JSON. -1 if the file can't be written
+int writeProfileJson(const profile_t *p, const char *path);
+
+#endif
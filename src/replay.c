@@ -0,0 +1,115 @@
+#include "replay.h"
+
+// FNV-1a of everything from the start of the program to the end of the machine's RAM, so the rom size isn't needed
+static uint64_t hashProgram(const machine_t *m) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = PROGRAM_START; i <= m->memoryEnd; i++) {
+        hash ^= m->ram[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void put64(uint8_t *p, uint64_t value) {
+    for (int b = 0; b < 8; b++) p[b] = (uint8_t)(value >> (b * 8));
+}
+
+static uint64_t get64(const uint8_t *p) {
+    uint64_t value = 0;
+    for (int b = 7; b >= 0; b--) value = value << 8 | p[b];
+    return value;
+}
+
+input_log_t *startRecording(const char *path, const machine_t *m, int instructionsPerFrame) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("Error opening recording");
+        return NULL;
+    }
+    input_log_t *log = calloc(1, sizeof(input_log_t));
+    if (log == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    log->file = file;
+    log->recording = 1;
+    log->seed = m->seed;
+    log->quirks = m->quirks;
+    log->wrapSprites = m->wrapSprites;
+    log->instructionsPerFrame = instructionsPerFrame;
+    log->programHash = hashProgram(m);
+
+    uint8_t header[REPLAY_HEADER_SIZE] = { 'C', '8', 'I', 'N', REPLAY_FILE_VERSION,
+                                           (uint8_t)(log->quirks << 1 | (log->wrapSprites ? 1 : 0)),
+                                           (uint8_t)instructionsPerFrame, (uint8_t)(instructionsPerFrame >> 8) };
+    put64(&header[8], log->seed);
+    put64(&header[16], log->programHash);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        perror("Error writing recording");
+        closeInputLog(log);
+        return NULL;
+    }
+    return log;
+}
+
+int recordFrame(input_log_t *log, uint16_t keypad) {
+    uint8_t frame[2] = { (uint8_t)keypad, (uint8_t)(keypad >> 8) };
+    if (fwrite(frame, 1, 2, log->file) != 2) return -1;
+    log->frames++;
+    return 0;
+}
+
+input_log_t *openReplay(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("Error opening recording");
+        return NULL;
+    }
+    uint8_t header[REPLAY_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, REPLAY_FILE_MAGIC, 4) != 0) {
+        printf("%s is not an input recording\n", path);
+        fclose(file);
+        return NULL;
+    }
+    if (header[4] != REPLAY_FILE_VERSION) {
+        printf("%s was recorded by a different version\n", path);
+        fclose(file);
+        return NULL;
+    }
+    input_log_t *log = calloc(1, sizeof(input_log_t));
+    if (log == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    log->file = file;
+    log->wrapSprites = header[5] & 1;
+    log->quirks = header[5] >> 1 & 7; // 0 in recordings from before there were quirks
+    if (log->quirks >= QUIRKS_COUNT) {
+        printf("%s was recorded with quirks this version doesn't have\n", path);
+        closeInputLog(log);
+        return NULL;
+    }
+    log->instructionsPerFrame = header[6] | header[7] << 8;
+    if (log->instructionsPerFrame == 0) log->instructionsPerFrame = INSTRUCTIONS_PER_FRAME;
+    log->seed = get64(&header[8]);
+    log->programHash = get64(&header[16]);
+    return log;
+}
+
+int replayFrame(input_log_t *log, uint16_t *keypad) {
+    uint8_t frame[2];
+    if (fread(frame, 1, 2, log->file) != 2) return -1;
+    *keypad = frame[0] | frame[1] << 8;
+    log->frames++;
+    return 0;
+}
+
+int replayMatches(const input_log_t *log, const machine_t *m) {
+    return log->programHash == hashProgram(m);
+}
+
+void closeInputLog(input_log_t *log) {
+    if (log == NULL) return;
+    if (fclose(log->file) != 0 && log->recording) perror("Error writing recording");
+    free(log);
+}
@@ -0,0 +1,49 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "chip8.h"
+
+// ##########  INPUT RECORDING AND REPLAY  ##########
+// the keypad is the only input a rom has (RND comes from the seed), so logging it once a frame
+// is enough to play a run back bit for bit. The file is a header, then the keypad of every frame
+// as a 16 bit little endian word
+
+#define REPLAY_FILE_MAGIC   "C8IN"
+#define REPLAY_FILE_VERSION 4   // 1 was before Ex9E/ExA1 tested the key in Vx and Fx0A waited for one,
+                                // 2 before RAM grew to 64 KB, 3 while the program hash covered all 64 KB
+                                // whatever the quirks (now only the RAM they give the machine)
+#define REPLAY_HEADER_SIZE  24  // magic, version, flags, instructions per frame, seed, program hash
+
+typedef struct {
+    FILE    *file;
+    int      recording;         // or playing back
+    uint64_t frames;            // written or read so far
+
+    // from the header, what the machine has to be set up with
+    uint64_t seed;
+    quirks_t quirks;
+    int      wrapSprites;
+    int      instructionsPerFrame;  // the CPU speed it was recorded at
+    uint64_t programHash;
+} input_log_t;
+
+// starts recording a machine that has just loaded its rom, and runs instructionsPerFrame
+// between two keypad samples. NULL if the file can't be created
+input_log_t *startRecording(const char *path, const machine_t *m, int instructionsPerFrame);
+
+// logs the keypad for one frame. -1 if it can't be written
+int recordFrame(input_log_t *log, uint16_t keypad);
+
+// opens a recording for playback. NULL if it isn't one
+input_log_t *openReplay(const char *path);
+
+// the keypad for the next frame. -1 when the recording is over
+int replayFrame(input_log_t *log, uint16_t *keypad);
+
+// whether the machine has the same program loaded as the one that was recorded
+int replayMatches(const input_log_t *log, const machine_t *m);
+
+// closes the file, flushing a recording
+void closeInputLog(input_log_t *log);
+
+#endif
@@ -0,0 +1,194 @@
+#include <time.h>
+#include <errno.h>
+#include "scheduler.h"
+#include "profile.h"
+
+void initTripleBuffer(triple_buffer_t *t) {
+    memset(t->slots, 0, sizeof(t->slots));
+    t->back = 0;
+    atomic_store(&t->middle, 1);
+    t->front = 2;
+}
+
+frame_t *backFrame(triple_buffer_t *t) {
+    return &t->slots[t->back];
+}
+
+void publishFrame(triple_buffer_t *t) {
+    unsigned previous = atomic_exchange_explicit(&t->middle, t->back | FRAME_FRESH, memory_order_acq_rel);
+    t->back = previous & ~FRAME_FRESH;
+}
+
+const frame_t *readFrame(triple_buffer_t *t, int *fresh) {
+    *fresh = 0;
+    if (atomic_load_explicit(&t->middle, memory_order_relaxed) & FRAME_FRESH) {
+        unsigned previous = atomic_exchange_explicit(&t->middle, t->front, memory_order_acq_rel);
+        t->front = previous & ~FRAME_FRESH;
+        *fresh = 1;
+    }
+    return &t->slots[t->front];
+}
+
+static void sleepUntil(uint64_t deadline) {
+#if defined(__linux__) || defined(__FreeBSD__)
+    struct timespec ts = { (time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {} // again if a signal woke it up
+#else
+    uint64_t now = nanoTime();
+    if (now >= deadline) return;
+    struct timespec ts = { (time_t)((deadline - now) / 1000000000ULL), (long)((deadline - now) % 1000000000ULL) };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+// the condition variable can only wait against CLOCK_MONOTONIC deadlines where it can be told to use that clock
+#if defined(__linux__) || defined(__FreeBSD__)
+#define PARK_ON_CONDITION
+#endif
+
+// sleepUntil(), but woken up by a keypad that isn't the one it parked with. Returns nonzero if it was
+static int parkUntil(scheduler_t *s, uint64_t deadline, uint16_t keypad) {
+#ifdef PARK_ON_CONDITION
+    struct timespec ts = { (time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL) };
+    int changed = 0;
+    pthread_mutex_lock(&s->parkLock);
+    while (!(changed = atomic_load(&s->keypad) != keypad) && !atomic_load(&s->stop)) {
+        if (pthread_cond_timedwait(&s->keypadChanged, &s->parkLock, &ts) == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&s->parkLock);
+    return changed;
+#else
+    (void)s; (void)keypad;
+    sleepUntil(deadline);
+    return 0;
+#endif
+}
+
+static void *cpuThread(void *arg) {
+    scheduler_t *s = arg;
+    machine_t *m = s->m;
+    const uint64_t period = 1000000000ULL / TIMER_HZ;
+    uint64_t deadline = nanoTime();
+    uint32_t remainder = 0; // cpuHz / TIMER_HZ rarely divides, the leftover carries to the next tick
+    uint64_t lastPublish = 0;
+
+    while (!atomic_load_explicit(&s->stop, memory_order_relaxed)) {
+        uint32_t speed = atomic_load_explicit(&s->speed, memory_order_relaxed);
+        uint64_t start = nanoTime();
+        uint16_t keypad = atomic_load_explicit(&s->keypad, memory_order_acquire);
+        if (keypad != m->keypad) m->keyEventNs = atomic_load_explicit(&s->keypadNs, memory_order_relaxed);
+        m->keypad = keypad;
+        int skip = s->hook != NULL && s->hook(m, s->hookContext);
+        uint64_t cpuStart = nanoTime();
+
+        if (!skip) {
+            uint32_t count = (s->cpuHz + remainder) / TIMER_HZ;
+            remainder = (s->cpuHz + remainder) % TIMER_HZ;
+            s->instructions += runCycles(m, (int)count);
+            tickTimers(m);
+        }
+        if (m->profile != NULL) {
+            profileTime(&m->profile->input, cpuStart - start);
+            profileTime(&m->profile->cpu, nanoTime() - cpuStart);
+            m->profile->frames++;
+        }
+        uint64_t ticks = atomic_fetch_add_explicit(&s->ticks, 1, memory_order_relaxed) + 1;
+
+        // fast-forwarding, a frame at most every 1/TIMER_HZ s. A skipped one stays dirty for the next tick
+        if (m->screenDirty && speed != 1 && start - lastPublish < period) {
+            atomic_fetch_add_explicit(&s->skippedFrames, 1, memory_order_relaxed);
+        } else if (m->screenDirty) {
+            frame_t *frame = backFrame(&s->display);
+            frame->screen = m->frameBuffer;
+            frame->tick = ticks;
+            publishFrame(&s->display);
+            m->screenDirty = 0;
+            lastPublish = start;
+        }
+
+        // next slice. Behind schedule it runs again straight away, unless it's so far behind
+        // (stopped in a debugger, suspended laptop) that catching up would just mean a fast-forward.
+        // Unlimited, it's never ahead or behind, and only a rom waiting on a key stops it
+        uint64_t now = nanoTime();
+        if (speed == SCHEDULER_UNLIMITED) deadline = waitingForKey(m) ? now + period : now;
+        else deadline += period / speed;
+        if (now < deadline && waitingForKey(m)) {
+            // nothing happens until a key does, and then the sooner the better
+            s->parkedTicks++;
+            if (parkUntil(s, deadline, m->keypad)) {
+                s->keyWakeups++;
+                deadline = nanoTime();
+            }
+        } else if (now < deadline) {
+            sleepUntil(deadline);
+        } else if (speed != SCHEDULER_UNLIMITED) {
+            s->lateTicks++;
+            if (now - deadline > s->worstLateNs) s->worstLateNs = now - deadline;
+            if (now - deadline > SCHEDULER_MAX_CATCH_UP * period) {
+                s->droppedTicks += (now - deadline) / period;
+                deadline = now;
+            }
+        }
+    }
+    return NULL;
+}
+
+int startScheduler(scheduler_t *s, machine_t *m, uint32_t cpuHz, tick_hook_t hook, void *hookContext) {
+    s->m = m;
+    s->cpuHz = cpuHz;
+    s->hook = hook;
+    s->hookContext = hookContext;
+    s->instructions = s->lateTicks = s->droppedTicks = s->worstLateNs = 0;
+    atomic_store(&s->ticks, 0);
+    atomic_store(&s->skippedFrames, 0);
+    atomic_store(&s->speed, 1);
+    s->parkedTicks = s->keyWakeups = 0;
+    initTripleBuffer(&s->display);
+    atomic_store(&s->keypad, m->keypad);
+    atomic_store(&s->keypadNs, 0);
+    atomic_store(&s->stop, 0);
+
+    pthread_mutex_init(&s->parkLock, NULL);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+#ifdef PARK_ON_CONDITION
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC); // the same clock as the deadlines
+#endif
+    pthread_cond_init(&s->keypadChanged, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    m->screenDirty = 1; // so the first tick publishes a frame
+    if (pthread_create(&s->thread, NULL, cpuThread, s) != 0) {
+        perror("Error starting the CPU thread");
+        pthread_cond_destroy(&s->keypadChanged);
+        pthread_mutex_destroy(&s->parkLock);
+        return -1;
+    }
+    return 0;
+}
+
+// wakes the CPU thread if it's parked
+static void unpark(scheduler_t *s) {
+    pthread_mutex_lock(&s->parkLock);
+    pthread_cond_signal(&s->keypadChanged);
+    pthread_mutex_unlock(&s->parkLock);
+}
+
+void stopScheduler(scheduler_t *s) {
+    atomic_store(&s->stop, 1);
+    unpark(s);
+    pthread_join(s->thread, NULL);
+    pthread_cond_destroy(&s->keypadChanged);
+    pthread_mutex_destroy(&s->parkLock);
+}
+
+void setSchedulerSpeed(scheduler_t *s, uint32_t speed) {
+    atomic_store_explicit(&s->speed, speed, memory_order_relaxed);
+}
+
+void setSchedulerKeypad(scheduler_t *s, uint16_t keypad) {
+    if (atomic_load_explicit(&s->keypad, memory_order_relaxed) == keypad) return; // only the input side writes it
+    atomic_store_explicit(&s->keypadNs, nanoTime(), memory_order_relaxed);
+    atomic_store_explicit(&s->keypad, keypad, memory_order_release);
+    unpark(s);
+}
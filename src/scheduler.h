@@ -0,0 +1,92 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "chip8.h"
+
+// ##########  CPU THREAD AND FRAME HAND-OFF  ##########
+// the CPU runs on its own thread, cpuHz instructions per second, in slices of one 60 Hz timer tick
+// that are scheduled against absolute deadlines, so a slow frame on the display side never slows
+// the game down. Finished frames go to the display through a lock-free triple buffer.
+// While the rom waits on Fx0A the thread parks until the keypad changes, and then starts the next tick
+// straight away instead of at its deadline.
+// Fast-forward (setSchedulerSpeed()) runs the ticks closer together, or back to back, so the timers still go
+// down once per emulated frame. Frames are then published at most TIMER_HZ times per wall-clock second, and
+// the ones in between are counted as skipped rather than copied
+
+#define TIMER_HZ 60
+#define DEFAULT_CPU_HZ (INSTRUCTIONS_PER_FRAME * TIMER_HZ)
+#define SCHEDULER_MAX_CATCH_UP 15   // ticks it runs back to back after a stall, before giving up on them
+#define SCHEDULER_UNLIMITED 0       // speed: ticks back to back, as fast as the CPU thread can go
+
+#define FRAME_FRESH 4u              // in triple_buffer_t.middle: published and not read yet
+
+// one finished screen
+typedef struct {
+    frame_buffer_t screen;
+    uint64_t tick;                  // timer tick it was published on
+} frame_t;
+
+// the writer always has a slot of its own to fill, the reader one to read, and the third sits in
+// the middle holding the newest finished frame. Either side swaps with the middle atomically, so
+// neither ever waits, and the reader always gets the latest frame (older ones are just dropped)
+typedef struct {
+    frame_t slots[3];
+    _Atomic unsigned middle;        // slot index, | FRAME_FRESH
+    unsigned back, front;           // only touched by the writer and the reader
+} triple_buffer_t;
+
+// called on the CPU thread at the start of every tick, before the instructions. Can change the machine
+// freely (load a state, rewind...). Returning nonzero skips this tick's instructions and timers
+typedef int (*tick_hook_t)(machine_t *m, void *context);
+
+typedef struct {
+    machine_t  *m;                  // belongs to the CPU thread while it runs
+    uint32_t    cpuHz;
+    tick_hook_t hook;
+    void       *hookContext;
+    _Atomic uint32_t speed;         // emulated frames per 1/TIMER_HZ s, SCHEDULER_UNLIMITED for no pacing at all
+
+    triple_buffer_t display;
+    _Atomic uint16_t keypad;        // set from the input side, copied into the machine every tick
+    _Atomic uint64_t keypadNs;      // when it last changed, for the key latency (see machine_t.keyEventNs)
+    atomic_int  stop;
+    pthread_t   thread;
+    pthread_mutex_t parkLock;       // for keypadChanged, the CPU thread waits on it while parked
+    pthread_cond_t  keypadChanged;
+
+    // written by the CPU thread, the display can watch the first two while it runs
+    _Atomic uint64_t ticks;
+    _Atomic uint64_t skippedFrames; // fast-forwarding: changed screens that were never published
+    uint64_t instructions;          // everything from here on is only read after it stops
+    uint64_t lateTicks;             // started after their deadline, and run back to back to catch up
+    uint64_t droppedTicks;          // too far behind, skipped instead of run
+    uint64_t worstLateNs;
+    uint64_t parkedTicks;           // ended with the rom waiting on Fx0A, and the thread parked
+    uint64_t keyWakeups;            // parks a key change ended early
+} scheduler_t;
+
+void initTripleBuffer(triple_buffer_t *t);
+
+// the writer's slot, fill it and then publish it
+frame_t *backFrame(triple_buffer_t *t);
+void publishFrame(triple_buffer_t *t);
+
+// the newest published frame. fresh says whether it changed since the last call
+const frame_t *readFrame(triple_buffer_t *t, int *fresh);
+
+// starts the CPU thread on m. -1 if the thread can't be created
+int startScheduler(scheduler_t *s, machine_t *m, uint32_t cpuHz, tick_hook_t hook, void *hookContext);
+
+// stops it and waits for it, the machine can be used from the calling thread again afterwards
+void stopScheduler(scheduler_t *s);
+
+// how many emulated frames to run per 1/TIMER_HZ s from the next tick on, SCHEDULER_UNLIMITED for as many as it can
+void setSchedulerSpeed(scheduler_t *s, uint32_t speed);
+
+// hands the keypad bitmap to the CPU thread, it's used from the next tick. A change is timed from here
+// to the first instruction that reads it, and wakes the thread if it's parked
+void setSchedulerKeypad(scheduler_t *s, uint16_t keypad);
+
+#endif
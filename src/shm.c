@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shm.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_SHM_EXPORT
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// ##########  SHARED MEMORY EXPORT  ##########
+// see shm.h. The writer side of the seqlock: sequence goes odd, the frame is written, sequence goes even again.
+// The release fence keeps the frame's stores from moving above the odd store, the release store on the way out
+// keeps them from moving below the even one
+
+shm_export_t *createShmExport(const char *name) {
+#ifdef HAVE_SHM_EXPORT
+    shm_export_t *e = calloc(1, sizeof(shm_export_t));
+    if (e == NULL) return NULL;
+    snprintf(e->name, sizeof(e->name), "%s%s", name[0] == '/' ? "" : "/", name);
+
+    int fd = shm_open(e->name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(shm_segment_t)) != 0) {
+        printf("Couldn't create the shared memory segment %s\n", e->name);
+        if (fd >= 0) close(fd);
+        free(e);
+        return NULL;
+    }
+    void *mapping = mmap(NULL, sizeof(shm_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps it open
+    if (mapping == MAP_FAILED) {
+        printf("Couldn't map the shared memory segment %s\n", e->name);
+        shm_unlink(e->name);
+        free(e);
+        return NULL;
+    }
+
+    // a segment left behind by an emulator that crashed is taken over, readers see the sequence go on from 0
+    shm_segment_t *s = e->segment = mapping;
+    memset(s, 0, sizeof(shm_segment_t));
+    s->magic = SHM_MAGIC;
+    s->version = SHM_VERSION;
+    s->size = sizeof(shm_segment_t);
+    s->writerPid = (uint32_t)getpid();
+    atomic_store(&s->running, 1);
+    return e;
+#else
+    (void)name;
+    printf("--shm needs POSIX shared memory, not available in this build\n");
+    return NULL;
+#endif
+}
+
+void publishShmFrame(shm_export_t *e, const machine_t *m, uint64_t instructions) {
+    shm_segment_t *s = e->segment;
+    uint32_t sequence = atomic_load_explicit(&s->sequence, memory_order_relaxed);
+    atomic_store_explicit(&s->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    s->frame++;
+    s->timeNs = nanoTime();
+    s->instructions = instructions;
+    memcpy(s->v, m->v, sizeof(s->v));
+    memcpy(s->stack, m->stack, sizeof(s->stack));
+    s->I = m->I;
+    s->PC = m->PC;
+    s->SP = m->SP;
+    s->DT = m->DT;
+    s->ST = m->ST;
+    s->stopped = m->stopped != 0;
+    s->quirks = (uint8_t)m->quirks;
+    s->waitingForKey = waitingForKey(m) != 0;
+    s->screen = m->frameBuffer;
+
+    atomic_store_explicit(&s->sequence, sequence + 2, memory_order_release);
+}
+
+uint16_t shmKeypad(const shm_export_t *e) {
+    return atomic_load_explicit(&e->segment->keypad, memory_order_relaxed);
+}
+
+void destroyShmExport(shm_export_t *e) {
+    if (e == NULL) return;
+#ifdef HAVE_SHM_EXPORT
+    atomic_store(&e->segment->running, 0);
+    munmap(e->segment, sizeof(shm_segment_t));
+    shm_unlink(e->name);
+#endif
+    free(e);
+}
@@ -0,0 +1,73 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdatomic.h>
+#include "chip8.h"
+
+// ##########  SHARED MEMORY EXPORT  ##########
+// --shm NAME publishes the screen, the registers and the timers to the POSIX shared memory segment /NAME once a frame,
+// for other processes (a bot, a streamer, a second screen) to read straight from the mapping. The emulator never
+// waits for them: each frame is written under a seqlock, sequence is odd while it's being written and goes up by 2
+// for every frame, so a reader that saw the same even sequence before and after reading got a whole frame, and one
+// that didn't just reads again. Readers write the keypad back into the same segment, and while the export is on
+// it replaces the keyboard. Only on POSIX systems, createShmExport() says so and returns NULL anywhere else
+
+#define SHM_MAGIC   0x38504C43u     // "CLP8" little endian
+#define SHM_VERSION 1
+
+// the segment, the same layout in the emulator and in every reader
+typedef struct {
+    uint32_t magic, version;
+    uint32_t size;                  // sizeof(shm_segment_t), readers check it before trusting the rest
+    uint32_t writerPid;
+    _Atomic uint32_t running;       // cleared when the emulator closes the export
+    _Atomic uint32_t sequence;      // the seqlock, see shmReadBegin()
+
+    // the frame, only consistent between shmReadBegin() and shmReadRetry()
+    uint64_t frame;                 // frames published so far, this one included
+    uint64_t timeNs;                // nanoTime() when it was published
+    uint64_t instructions;          // run since the export was opened
+    uint8_t  v[0x10];
+    uint16_t stack[STACK_SIZE];
+    uint16_t I, PC;
+    uint8_t  SP, DT, ST;
+    uint8_t  stopped;
+    uint8_t  quirks;                // quirks_t
+    uint8_t  waitingForKey;         // the rom is stuck on Fx0A
+    frame_buffer_t screen;          // packed like machine_t's, bit 63 of word 0 is x = 0
+
+    // written by the readers, on a cache line of its own so they don't slow the frames down
+    _Alignas(64) _Atomic uint16_t keypad;   // bit n = key n, read by the emulator once a display frame
+} shm_segment_t;
+
+typedef struct {
+    shm_segment_t *segment;
+    char           name[64];        // with the leading /, for shm_unlink()
+} shm_export_t;
+
+// creates (or takes over) the segment /name and maps it. NULL if it can't, or this isn't a POSIX system
+shm_export_t *createShmExport(const char *name);
+
+// writes the machine's state as the next frame. Only one thread may publish
+void publishShmFrame(shm_export_t *e, const machine_t *m, uint64_t instructions);
+
+// the keypad the readers set
+uint16_t shmKeypad(const shm_export_t *e);
+
+// marks the segment closed, unmaps it and removes the name. Readers that have it mapped keep the last frame
+void destroyShmExport(shm_export_t *e);
+
+// readers: waits until no frame is being written and returns the sequence to hand to shmReadRetry()
+static inline uint32_t shmReadBegin(const shm_segment_t *s) {
+    uint32_t sequence;
+    while ((sequence = atomic_load_explicit(&s->sequence, memory_order_acquire)) & 1) {}
+    return sequence;
+}
+
+// nonzero if a frame was published while reading since shmReadBegin(), and what was read has to be thrown away
+static inline int shmReadRetry(const shm_segment_t *s, uint32_t sequence) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&s->sequence, memory_order_relaxed) != sequence;
+}
+
+#endif
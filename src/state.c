@@ -0,0 +1,310 @@
+#include "state.h"
+
+static uint64_t load64(const uint8_t *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static uint8_t *putVarint(uint8_t *out, size_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static int getVarint(const uint8_t **p, const uint8_t *end, size_t *value) {
+    *value = 0;
+    for (int shift = 0; *p < end && shift < 28; shift += 7) {
+        uint8_t b = *(*p)++;
+        *value |= (size_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return 0;
+    }
+    return -1;
+}
+
+size_t stateSize(const machine_t *m) {
+    return (size_t)m->memoryEnd + 1 + STATE_REST_SIZE;
+}
+
+void captureState(const machine_t *m, uint8_t *state) {
+    uint8_t *p = state;
+    memcpy(p, m->ram, (size_t)m->memoryEnd + 1);
+    p += m->memoryEnd + 1;
+    const frame_buffer_t *f = &m->frameBuffer;
+    for (int plane = 0; plane < PLANES; plane++) {
+        for (int j = 0; j < HIRES_HEIGHT; j++) {
+            for (int w = 0; w < ROW_WORDS; w++) { // left to right, like the hash
+                for (int b = 7; b >= 0; b--) *p++ = (uint8_t)(f->rows[plane][j][w] >> (b * 8));
+            }
+        }
+    }
+    *p++ = f->hires;
+    *p++ = f->planes;
+    for (int i = 0; i < STACK_SIZE; i++) {
+        *p++ = (uint8_t)m->stack[i];
+        *p++ = (uint8_t)(m->stack[i] >> 8);
+    }
+    memcpy(p, m->v, 0x10);
+    p += 0x10;
+    *p++ = m->SP;
+    *p++ = m->DT;
+    *p++ = m->ST;
+    *p++ = (uint8_t)m->I;
+    *p++ = (uint8_t)(m->I >> 8);
+    *p++ = (uint8_t)m->PC;
+    *p++ = (uint8_t)(m->PC >> 8);
+    for (int b = 0; b < 8; b++) *p++ = (uint8_t)(m->rngState >> (b * 8));
+    *p++ = m->keyHeld;
+    memcpy(p, m->rpl, RPL_FLAGS);
+    p += RPL_FLAGS;
+    memcpy(p, m->audioPattern, AUDIO_PATTERN_SIZE);
+    p += AUDIO_PATTERN_SIZE;
+    *p++ = m->pitch;
+}
+
+void restoreState(machine_t *m, const uint8_t *state) {
+    const uint8_t *p = state;
+
+    // copy RAM run by run, so only the instructions that really changed get re-decoded
+    const int ramSize = m->memoryEnd + 1;
+    for (int i = 0; i < ramSize; ) {
+        if (m->ram[i] == p[i]) { i++; continue; }
+        int end = i;
+        while (end < ramSize && m->ram[end] != p[end]) end++;
+        memcpy(&m->ram[i], &p[i], end - i);
+        invalidateDecodeCache(m, i, end - i);
+        i = end;
+    }
+    p += ramSize;
+
+    frame_buffer_t *f = &m->frameBuffer;
+    for (int plane = 0; plane < PLANES; plane++) {
+        for (int j = 0; j < HIRES_HEIGHT; j++) {
+            for (int w = 0; w < ROW_WORDS; w++) {
+                uint64_t row = 0;
+                for (int b = 0; b < 8; b++) row = row << 8 | *p++;
+                f->rows[plane][j][w] = row;
+            }
+        }
+    }
+    f->hires = *p++;
+    f->planes = *p++ & 3;
+    for (int i = 0; i < STACK_SIZE; i++, p += 2) {
+        m->stack[i] = p[0] | p[1] << 8;
+    }
+    memcpy(m->v, p, 0x10);
+    p += 0x10;
+    m->SP = *p++;
+    m->DT = *p++;
+    m->ST = *p++;
+    m->I  = p[0] | p[1] << 8;
+    m->PC = p[2] | p[3] << 8;
+    m->stopped = 0;
+    p += 4;
+    m->rngState = 0;
+    for (int b = 7; b >= 0; b--) m->rngState = m->rngState << 8 | p[b];
+    p += 8;
+    m->keyHeld = *p++;
+    memcpy(m->rpl, p, RPL_FLAGS);
+    p += RPL_FLAGS;
+    memcpy(m->audioPattern, p, AUDIO_PATTERN_SIZE);
+    p += AUDIO_PATTERN_SIZE;
+    m->pitch = *p++;
+    m->screenDirty = 1;
+}
+
+size_t encodeDelta(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out) {
+    uint8_t *o = out;
+    size_t i = 0;
+    while (i < size) {
+        // unchanged run, a word at a time while it lasts
+        size_t start = i;
+        while (i + 8 <= size && load64(a + i) == load64(b + i)) i += 8;
+        while (i < size && a[i] == b[i]) i++;
+        size_t same = i - start;
+
+        // changed run, up to the next 4 unchanged bytes in a row. Shorter gaps go in as zeroes,
+        // they'd cost as much as a new run header
+        size_t changed = i;
+        while (changed < size) {
+            if (a[changed] != b[changed]) { changed++; continue; }
+            size_t k = changed;
+            while (k < size && k - changed < 4 && a[k] == b[k]) k++;
+            if (k - changed >= 4 || k == size) break;
+            changed = k;
+        }
+        if (changed == i) break; // only unchanged bytes left
+
+        o = putVarint(o, same);
+        o = putVarint(o, changed - i);
+        for (; i < changed; i++) *o++ = a[i] ^ b[i];
+    }
+    return o - out;
+}
+
+int applyDelta(uint8_t *state, size_t size, const uint8_t *delta, size_t length) {
+    const uint8_t *p = delta, *end = delta + length;
+    size_t pos = 0;
+    while (p < end) {
+        size_t same, changed;
+        if (getVarint(&p, end, &same) || getVarint(&p, end, &changed)) return -1;
+        if (same > size - pos || changed > size - pos - same || changed > (size_t)(end - p)) return -1;
+        pos += same;
+        for (size_t i = 0; i < changed; i++) state[pos++] ^= *p++;
+    }
+    return 0;
+}
+
+int saveState(const machine_t *m, const char *path) {
+    static const uint8_t zero[STATE_SIZE];
+    uint8_t state[STATE_SIZE], packed[STATE_DELTA_MAX(STATE_SIZE)];
+    size_t size = stateSize(m);
+    captureState(m, state);
+    size_t length = encodeDelta(zero, state, size, packed); // against zeroes, mostly empty RAM packs well
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("Error opening state file");
+        return -1;
+    }
+    uint8_t header[8] = { 'C', '8', 'S', 'T', STATE_FILE_VERSION, (uint8_t)(size >> 16), // was 0 while it fit in 16 bits
+                          (uint8_t)size, (uint8_t)(size >> 8) };
+    int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+          && fwrite(packed, 1, length, file) == length;
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) {
+        perror("Error writing state file");
+        return -1;
+    }
+    return 0;
+}
+
+int loadState(machine_t *m, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("Error opening state file");
+        return -1;
+    }
+    uint8_t header[8], packed[STATE_DELTA_MAX(STATE_SIZE)];
+    size_t headerLength = fread(header, 1, sizeof(header), file);
+    size_t length = fread(packed, 1, sizeof(packed), file);
+    fclose(file);
+
+    if (headerLength != sizeof(header) || memcmp(header, STATE_FILE_MAGIC, 4) != 0) {
+        printf("%s is not a save state\n", path);
+        return -1;
+    }
+    size_t size = stateSize(m);
+    if (header[4] != STATE_FILE_VERSION) {
+        printf("%s was saved by a different version\n", path);
+        return -1;
+    }
+    if ((size_t)(header[5] << 16 | header[6] | header[7] << 8) != size) {
+        printf("%s was saved with other quirks, its RAM is a different size\n", path);
+        return -1;
+    }
+    uint8_t state[STATE_SIZE] = {0};
+    if (length == sizeof(packed) || applyDelta(state, size, packed, length)) {
+        printf("%s is corrupted\n", path);
+        return -1;
+    }
+    restoreState(m, state);
+    return 0;
+}
+
+
+// ##########  REWIND  ##########
+rewind_t *createRewind(size_t bytes, int maxFrames) {
+    rewind_t *r = calloc(1, sizeof(rewind_t));
+    if (r == NULL) return NULL;
+    r->capacity  = bytes;
+    r->maxFrames = maxFrames;
+    r->data      = malloc(bytes);
+    r->offsets   = malloc(sizeof(uint32_t) * maxFrames);
+    r->lengths   = malloc(sizeof(uint32_t) * maxFrames);
+    if (r->data == NULL || r->offsets == NULL || r->lengths == NULL || maxFrames < 1) {
+        destroyRewind(r);
+        return NULL;
+    }
+    return r;
+}
+
+void destroyRewind(rewind_t *r) {
+    if (r == NULL) return;
+    free(r->data);
+    free(r->offsets);
+    free(r->lengths);
+    free(r);
+}
+
+static void dropOldest(rewind_t *r) {
+    r->used -= r->lengths[r->head];
+    r->head = (r->head + 1) % r->maxFrames;
+    r->count--;
+}
+
+void rewindPush(rewind_t *r, const machine_t *m) {
+    uint64_t start = nanoTime();
+
+    captureState(m, r->scratch);
+    if (!r->hasCurrent || r->size != stateSize(m)) { // the first push, or its quirks changed what a state holds
+        r->hasCurrent = 1;
+        r->size = stateSize(m);
+        r->count = 0;
+        r->used = 0;
+    } else {
+        uint8_t delta[STATE_DELTA_MAX(STATE_SIZE)];
+        size_t length = encodeDelta(r->current, r->scratch, r->size, delta);
+
+        if (length > r->capacity) { // can't ever fit, the history before this frame is lost
+            r->count = 0;
+            r->used = 0;
+        } else {
+            if (r->count == r->maxFrames) dropOldest(r);
+
+            // records ahead of writePos are the oldest ones, in order, so they go until there's room
+            size_t offset = r->writePos;
+            if (offset + length > r->capacity) {
+                while (r->count > 0 && r->offsets[r->head] >= offset) dropOldest(r);
+                offset = 0;
+            }
+            while (r->count > 0 && r->offsets[r->head] >= offset
+                   && r->offsets[r->head] < offset + length) dropOldest(r);
+
+            memcpy(r->data + offset, delta, length);
+            int index = (r->head + r->count) % r->maxFrames;
+            r->offsets[index] = (uint32_t)offset;
+            r->lengths[index] = (uint32_t)length;
+            r->count++;
+            r->used += length;
+            r->writePos = offset + length;
+            r->bytesPushed += length;
+        }
+    }
+    memcpy(r->current, r->scratch, r->size);
+
+    r->pushes++;
+    r->pushNs += nanoTime() - start;
+}
+
+int rewindPop(rewind_t *r, machine_t *m) {
+    if (!r->hasCurrent || r->count == 0 || r->size != stateSize(m)) return -1;
+    int index = (r->head + r->count - 1) % r->maxFrames;
+    applyDelta(r->current, r->size, r->data + r->offsets[index], r->lengths[index]);
+    r->writePos = r->offsets[index]; // the newest record is always the last one written
+    r->used -= r->lengths[index];
+    r->count--;
+    restoreState(m, r->current);
+    return 0;
+}
+
+int rewindFrames(const rewind_t *r) {
+    return r->count;
+}
+
+size_t rewindBytes(const rewind_t *r) {
+    return r->used;
+}
@@ -0,0 +1,77 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include "chip8.h"
+
+// ##########  SAVE STATES AND REWIND  ##########
+// a state is everything the rom can see: RAM, screen (both planes, its resolution and which planes are
+// selected), stack, registers, timers, the RND generator, the key an Fx0A is waiting on, the RPL flags and
+// XO-CHIP's audio pattern and pitch, packed into stateSize() bytes. Caches, the core and the keypad aren't part
+// of it. The RAM is only as much as the machine's quirks give it, so a CHIP-8 state is 4 KB of it and XO-CHIP's 64
+
+#define STATE_SCREEN_SIZE (PLANES * HIRES_HEIGHT * ROW_WORDS * 8 + 2)
+#define STATE_REST_SIZE (STATE_SCREEN_SIZE + STACK_SIZE * 2 + 0x10 + 3 + 2 * 2 + 8 + 1 + RPL_FLAGS + AUDIO_PATTERN_SIZE + 1)
+#define STATE_SIZE (RAM_SIZE + STATE_REST_SIZE) // the most a state takes, what buffers for any machine's need
+
+#define STATE_FILE_MAGIC   "C8ST"
+#define STATE_FILE_VERSION 5
+
+// the rewind history: the latest state in full, and one XOR/RLE delta per older frame in a ring.
+// Stepping back XORs the newest delta into the latest state, so no keyframes are needed, and
+// when the ring is full the oldest frames are simply dropped
+typedef struct {
+    uint8_t  current[STATE_SIZE];   // the last state pushed
+    uint8_t  scratch[STATE_SIZE];
+    size_t   size;                  // stateSize() of the machine it was pushed from
+    int      hasCurrent;
+
+    uint8_t *data;                  // delta bytes, records are contiguous and wrap back to 0
+    size_t   capacity, writePos;
+    uint32_t *offsets, *lengths;    // record index, oldest at head
+    int      maxFrames, head, count;
+    size_t   used;                  // bytes the records take
+
+    uint64_t pushes, pushNs, bytesPushed;   // instrumentation
+} rewind_t;
+
+// the bytes a state of the machine takes, m->memoryEnd + 1 of them RAM
+size_t stateSize(const machine_t *m);
+
+// packs the machine into stateSize(m) bytes
+void captureState(const machine_t *m, uint8_t *state);
+
+// unpacks a state of stateSize(m) bytes into the machine. Only the decode cache and JIT blocks over RAM that changed are thrown away
+void restoreState(machine_t *m, const uint8_t *state);
+
+// writes the machine to a file as a magic, a version and the RLE'd state. -1 if it can't be written
+int saveState(const machine_t *m, const char *path);
+
+// reads a file written by saveState() into the machine. -1 (and the machine untouched) if it isn't a valid one
+int loadState(machine_t *m, const char *path);
+
+// stores whatever bytes differ between a and b as runs of (unchanged count, changed count, a XOR b),
+// returns the bytes written to out, which needs room for STATE_DELTA_MAX(size)
+size_t encodeDelta(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out);
+#define STATE_DELTA_MAX(size) ((size) + 32)
+
+// XORs an encoded delta into state, turning a into b or b into a. -1 if it's malformed
+int applyDelta(uint8_t *state, size_t size, const uint8_t *delta, size_t length);
+
+// a rewind buffer with up to bytes of deltas and maxFrames frames. NULL if it can't be allocated
+rewind_t *createRewind(size_t bytes, int maxFrames);
+void destroyRewind(rewind_t *r);
+
+// remembers the machine's current state, meant to be called once a frame. A machine whose quirks changed
+// its RAM size since the last push starts the history over
+void rewindPush(rewind_t *r, const machine_t *m);
+
+// puts the machine back to the state before the last one pushed, and forgets the last one. -1 if there's no history left
+int rewindPop(rewind_t *r, machine_t *m);
+
+// frames of history it holds
+int rewindFrames(const rewind_t *r);
+
+// bytes of delta data in use
+size_t rewindBytes(const rewind_t *r);
+
+#endif
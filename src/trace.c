@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_TRACE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// ##########  EXECUTION TRACE  ##########
+// see trace.h. runCyclesTraced() is with the quirk cores in chip8.c
+
+trace_t *createTrace(const char *path, uint32_t records, const machine_t *m) {
+#ifdef HAVE_TRACE
+    uint32_t capacity = 1;
+    while (capacity < records && capacity < (1u << 31)) capacity <<= 1;
+
+    trace_t *t = calloc(1, sizeof(trace_t));
+    if (t == NULL) return NULL;
+    t->size = sizeof(trace_header_t) + (size_t)capacity * sizeof(trace_record_t);
+    t->mask = capacity - 1;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)t->size) != 0) {
+        printf("Couldn't create the trace %s\n", path);
+        if (fd >= 0) close(fd);
+        free(t);
+        return NULL;
+    }
+    void *mapping = mmap(NULL, t->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps it open
+    if (mapping == MAP_FAILED) {
+        printf("Couldn't map the trace %s\n", path);
+        free(t);
+        return NULL;
+    }
+
+    trace_header_t *h = t->header = mapping;
+    t->records = (trace_record_t *)(h + 1);
+    h->magic = TRACE_MAGIC;
+    h->version = TRACE_VERSION;
+    h->recordSize = sizeof(trace_record_t);
+    h->capacity = capacity;
+    h->seed = m->seed;
+    h->quirks = (uint8_t)m->quirks;
+    return t;
+#else
+    (void)path; (void)records; (void)m;
+    printf("--trace needs mmap, not available in this build\n");
+    return NULL;
+#endif
+}
+
+void closeTrace(trace_t *t) {
+    if (t == NULL) return;
+#ifdef HAVE_TRACE
+    t->header->written = t->written;
+    printf("trace: %llu instructions, the last %llu kept\n", (unsigned long long)t->written,
+           (unsigned long long)(t->written < t->mask + 1ULL ? t->written : t->mask + 1ULL));
+    munmap(t->header, t->size);
+#endif
+    free(t);
+}
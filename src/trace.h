@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "chip8.h"
+
+// ##########  EXECUTION TRACE  ##########
+// --trace FILE records every instruction into a ring of fixed-size records in a memory-mapped file, for clip8-trace to
+// look at afterwards (or while it runs). Set m->trace to start recording, back to NULL to stop; while it's NULL the
+// only cost is one branch per runCycles() call, and while it's set everything runs through runCyclesTraced(): the
+// switch core for the machine's quirks, writing each 8-byte record from the decoded entry the instruction ran from,
+// and without idle loop fast-forwarding. That runs at about three quarters of the switch core's speed, the records
+// going out to memory being most of the difference. The file is mapped shared, so whatever was recorded up to the
+// last runCycles() call is in it even if the emulator is killed. Only on POSIX systems, createTrace() says so and
+// returns NULL anywhere else
+
+#define TRACE_MAGIC   0x54504C43u       // "CLPT" little endian
+#define TRACE_VERSION 1
+#define TRACE_DEFAULT_RECORDS (1u << 22) // 32 MB of file, the last hour and a half at the default 720 Hz
+
+#define TRACE_NO_REGISTER 0xFF          // trace_record_t.reg of an instruction that writes no V register
+
+// one instruction, as it was left after running
+typedef struct {
+    uint16_t pc;                        // where it was fetched from
+    uint16_t instruction;               // the word at pc. F000 nnnn's second word is what ended up in I
+    uint16_t I;
+    uint8_t  reg;                       // the V register it wrote, TRACE_NO_REGISTER if none. Vx for the ALU ones
+                                        // even when VF is set too, VF for DRW, the last one for Fx65, Fx85 and 5xy3
+    uint8_t  value;                     // what that register holds now
+} trace_record_t;
+
+// the start of the file, the records follow it
+typedef struct {
+    uint32_t magic, version;
+    uint32_t recordSize;                // sizeof(trace_record_t), readers check it before trusting the rest
+    uint32_t capacity;                  // records in the ring, a power of 2
+    uint64_t written;                   // records written since the trace started. Record k is at k % capacity,
+                                        // the last min(written, capacity) of them are still there
+    uint64_t seed;                      // the machine's, with quirks, to rerun the same thing
+    uint8_t  quirks;                    // quirks_t
+    uint8_t  padding[31];
+} trace_header_t;
+
+typedef struct trace {
+    trace_header_t *header;
+    trace_record_t *records;            // header->capacity of them, right after the header
+    uint64_t        written;            // the count being written, stored into the header after every run
+    uint32_t        mask;               // capacity - 1
+    size_t          size;               // of the whole mapping
+} trace_t;
+
+// creates path (truncating it) with room for at least records records, and maps it. NULL if it can't, or this
+// isn't a POSIX system
+trace_t *createTrace(const char *path, uint32_t records, const machine_t *m);
+
+// writes the count out, prints it and unmaps the file, which keeps everything recorded
+void closeTrace(trace_t *t);
+
+#endif
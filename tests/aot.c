@@ -0,0 +1,55 @@
+#include "tests.h"
+#include "aot.h"
+
+// ##########  AOT  ##########
+// built once for every conformance case, linked with what clip8-aot translated from its rom for its quirks (see
+// CLIP8_AOT_CASES in CMakeLists.txt). On CORE_AOT the rom has to end up on the same screen as on the switch core,
+// stopped or not the same way, with and without idle skip, and some of it has to have run as translated code
+
+#define AOT_TEST_CYCLES 20000       // what the conformance runs take
+
+extern const aot_program_t aotProgram;
+
+// a machine with the translated rom loaded, on core
+static machine_t *load(core_t core, int skipIdle) {
+    machine_t *m = createMachine(CORE_SWITCH);
+    if (m == NULL) return NULL;
+    setQuirks(m, aotProgram.quirks, aotProgram.wrapSprites);
+    setAotProgram(m, &aotProgram);
+    if (loadRomImage(m, aotProgram.rom, aotProgram.romSize) || setCore(m, core)) {
+        destroyMachine(m);
+        return NULL;
+    }
+    m->skipIdle = skipIdle;
+    return m;
+}
+
+int main() {
+    for (int skipIdle = 1; skipIdle >= 0; skipIdle--) {
+        machine_t *reference = load(CORE_SWITCH, skipIdle), *m = load(CORE_AOT, skipIdle);
+        CHECK(reference != NULL && m != NULL, "%s: couldn't load it", aotProgram.name);
+        if (reference == NULL || m == NULL) {
+            destroyMachine(reference);
+            destroyMachine(m);
+            return 1;
+        }
+
+        uint64_t cycles, frames;
+        int expectStopped = runUnpaced(reference, AOT_TEST_CYCLES, 0, &cycles, &frames) != 0;
+        int stopped = runUnpaced(m, AOT_TEST_CYCLES, 0, &cycles, &frames) != 0;
+        uint64_t expected = hashFrameBuffer(reference), hash = hashFrameBuffer(m);
+        const char *variant = skipIdle ? "" : " without idle skip";
+
+        CHECK(hash == expected, "%s (%s) on aot%s: hash 0x%016llx, the switch core's 0x%016llx", aotProgram.name,
+              quirksName(aotProgram.quirks), variant, (unsigned long long)hash, (unsigned long long)expected);
+        CHECK(stopped == expectStopped, "%s (%s) on aot%s: %s", aotProgram.name, quirksName(aotProgram.quirks),
+              variant, stopped ? "stopped" : "didn't stop");
+        CHECK(m->aotNativeInstructions > 0, "%s (%s) on aot%s: nothing ran translated", aotProgram.name,
+              quirksName(aotProgram.quirks), variant);
+        if (hash != expected) printScreen(&m->frameBuffer);
+
+        destroyMachine(reference);
+        destroyMachine(m);
+    }
+    return checksFailed != 0;
+}
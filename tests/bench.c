@@ -0,0 +1,132 @@
+#include "tests.h"
+
+// ##########  MICRO-BENCHMARKS  ##########
+// the hot paths one at a time: decoding, DRW, CLS, and whole roms on every core. Each benchmark runs once to warm up
+// (caches, branch predictors, the JIT's blocks), then `--reps N` times (15 by default), and prints the fastest and the
+// median in ns per operation. `--scale N` runs N times as many operations per repetition, for steadier numbers.
+// Whole rom runs also have to agree on the screen they end with on every core, so this fails if they don't
+
+#define MAX_REPS 101
+
+static int reps = 15;
+static uint64_t scale = 1;
+static volatile uint64_t sink; // keeps the compiler from throwing away what's being timed
+
+static machine_t *m;
+
+typedef void (*bench_fn_t)(uint64_t ops);
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench(const char *name, uint64_t ops, bench_fn_t fn) {
+    ops *= scale;
+    double ns[MAX_REPS];
+    fn(ops);
+    for (int r = 0; r < reps; r++) {
+        uint64_t start = nanoTime();
+        fn(ops);
+        ns[r] = (double)(nanoTime() - start) / ops;
+    }
+    qsort(ns, reps, sizeof(double), compareDoubles);
+    printf("%-36s %9.2f ns/op  (median %.2f, %d x %llu ops)\n", name, ns[0], ns[reps / 2], reps,
+           (unsigned long long)ops);
+}
+
+// every possible word
+static void decode(uint64_t ops) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < ops; i++) sum += decodeInstruction((uint16_t)(i * 0x9E37));
+    sink = sum;
+}
+
+static void decodeWords(uint64_t ops) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < ops; i++) sum += decodeWord((uint16_t)(i * 0x9E37)).nnn;
+    sink = sum;
+}
+
+// 15 row sprites all over the screen, some of them across the edges
+static void draw(uint64_t ops) {
+    decoded_t d = decodeWord(0xD01F);
+    uint32_t position = 1;
+    for (uint64_t i = 0; i < ops; i++) {
+        position = position * 1103515245 + 12345;
+        m->v[0] = position >> 16 & 0x7F;
+        m->v[1] = position >> 24 & 0x3F;
+        drawSpriteToFramebuffer(m, &d);
+    }
+    sink = m->v[0xF];
+}
+
+static void clear(uint64_t ops) {
+    for (uint64_t i = 0; i < ops; i++) clearFrameBuffer(m);
+    sink = m->frameBuffer.rows[0][0][0];
+}
+
+static void run(uint64_t ops) {
+    uint64_t cycles, frames;
+    runUnpaced(m, ops, 0, &cycles, &frames);
+    sink = cycles;
+}
+
+static void runRom(const test_rom_t *rom, quirks_t quirks, uint64_t ops) {
+    uint64_t hashes[CORE_COUNT] = { 0 };
+    for (core_t core = 0; core < CORE_COUNT; core++) {
+        m = loadTestRom(rom, core, quirks, 0);
+        if (m == NULL) continue;
+        m->skipIdle = 0;
+        char name[64];
+        snprintf(name, sizeof(name), "%s rom, %s core", rom->name, coreName(core));
+        bench(name, ops, run);
+
+        // the same run again from power-on, to compare the cores
+        destroyMachine(m);
+        m = loadTestRom(rom, core, quirks, 0);
+        m->skipIdle = 0;
+        run(ops * scale);
+        hashes[core] = hashFrameBuffer(m);
+        CHECK(hashes[core] == hashes[CORE_SWITCH], "%s: the %s core ended on 0x%016llx, the switch core on 0x%016llx",
+              rom->name, coreName(core), (unsigned long long)hashes[core], (unsigned long long)hashes[CORE_SWITCH]);
+        destroyMachine(m);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if      (strcmp(argv[i], "--reps") == 0 && i + 1 < argc)  reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) scale = strtoull(argv[++i], NULL, 10);
+        else {
+            printf("usage: %s [--reps N] [--scale N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (reps < 1) reps = 1;
+    if (reps > MAX_REPS) reps = MAX_REPS;
+    if (scale < 1) scale = 1;
+
+    bench("decodeInstruction()", 1 << 20, decode);
+    bench("decodeWord()", 1 << 20, decodeWords);
+
+    m = createMachine(CORE_SWITCH);
+    bench("DRW, lo-res", 1 << 18, draw);
+    setQuirks(m, QUIRKS_CLIP8, 1);
+    bench("DRW, lo-res wrapping", 1 << 18, draw);
+    setQuirks(m, QUIRKS_SCHIP, 0);
+    setResolution(&m->frameBuffer, 1);
+    bench("DRW, hi-res", 1 << 18, draw);
+    setQuirks(m, QUIRKS_XOCHIP, 0);
+    m->frameBuffer.planes = 3;
+    bench("DRW, hi-res on both planes", 1 << 18, draw);
+    bench("CLS, hi-res on both planes", 1 << 16, clear);
+    resetMachine(m);
+    bench("CLS, lo-res", 1 << 16, clear);
+    destroyMachine(m);
+
+    runRom(&busyRom, QUIRKS_CLIP8, 1 << 20);
+    runRom(&longLoopRom, QUIRKS_CLIP8, 1 << 20);
+
+    return checksFailed != 0;
+}
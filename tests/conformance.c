@@ -0,0 +1,144 @@
+#include "tests.h"
+#include "lockstep.h"
+
+// ##########  CONFORMANCE  ##########
+// every test rom on every core and on the lockstep engine, against the framebuffer hash it has to end up with.
+// The roms draw their results, so when a hash is wrong the screen it printed usually says what broke.
+// `--print` shows every screen and its hash instead, to look them over when a rom or an expected hash changes.
+// The AOT core needs each rom translated first, so the aot-* tests (aot.c) check it on the same cases instead:
+// CLIP8_AOT_CASES in CMakeLists.txt lists every one of them
+
+#define CONFORMANCE_CYCLES 20000    // every rom is long done by then, spinning on its last instruction
+#define LOCKSTEP_TEST_LANES 8
+
+typedef struct {
+    const test_rom_t *rom;
+    quirks_t quirks;
+    int      wrapSprites;
+    uint64_t hash;
+    int      stops;         // ends on 00FD instead of a jump to itself
+} conformance_t;
+
+static const conformance_t cases[] = {
+    { &flagsRom,  QUIRKS_CLIP8,  0, 0x2a3a9566f3d698a3ULL, 0 },
+    { &flagsRom,  QUIRKS_VIP,    0, 0x2a3a9566f3d698a3ULL, 0 },
+    { &flagsRom,  QUIRKS_CHIP48, 0, 0x2a3a9566f3d698a3ULL, 0 },
+    { &flagsRom,  QUIRKS_SCHIP,  0, 0x2a3a9566f3d698a3ULL, 0 },
+    { &flagsRom,  QUIRKS_XOCHIP, 0, 0x2a3a9566f3d698a3ULL, 0 },
+    { &quirksRom, QUIRKS_CLIP8,  0, 0xfc49856a05290f90ULL, 0 },
+    { &quirksRom, QUIRKS_CLIP8,  1, 0x12e04dea98f5315bULL, 0 },
+    { &quirksRom, QUIRKS_VIP,    0, 0xe33326a8f8d70ea8ULL, 0 },
+    { &quirksRom, QUIRKS_CHIP48, 0, 0x8399003ebd3bd409ULL, 0 },
+    { &quirksRom, QUIRKS_SCHIP,  0, 0x04780e9d4ad8fd2dULL, 0 },
+    { &quirksRom, QUIRKS_XOCHIP, 0, 0xc003900fc71a5b23ULL, 0 },
+    { &fontRom,   QUIRKS_CLIP8,  0, 0xabda4d99ebb41e81ULL, 0 },
+    { &mazeRom,   QUIRKS_CLIP8,  0, 0x5a0f8212a2be7ad5ULL, 0 },
+    { &scrollRom, QUIRKS_SCHIP,  0, 0xdb3217e602b67d95ULL, 0 },
+    { &hiresRom,  QUIRKS_SCHIP,  0, 0x77e202c0ec745e7dULL, 0 },
+    { &hiresRom,  QUIRKS_XOCHIP, 0, 0xf399682bcc5be4dfULL, 0 },
+    { &xochipRom, QUIRKS_XOCHIP, 0, 0x6d488c7c4939984bULL, 1 },
+    { &longLoopRom, QUIRKS_CLIP8, 0, 0x048cdd901b530ad2ULL, 0 },
+    { &wrapRom,   QUIRKS_CLIP8,  0, 0xb7e0d21254eb48f5ULL, 0 },
+    { &farSkipRom, QUIRKS_XOCHIP, 0, 0x7b2588e3d7cec2b5ULL, 1 },
+};
+
+// the ways a machine can run a rom, all of which have to end up the same
+typedef struct {
+    core_t      core;
+    int         skipIdle, fuse;
+    const char *name;
+} variant_t;
+
+static const variant_t variants[] = {
+    { CORE_SWITCH,   1, 1, "switch" },
+    { CORE_SWITCH,   0, 1, "switch without idle skip" },
+    { CORE_THREADED, 1, 1, "threaded" },
+    { CORE_THREADED, 1, 0, "threaded without superinstructions" },
+    { CORE_THREADED, 0, 1, "threaded without idle skip" },
+    { CORE_JIT,      1, 1, "jit" },
+    { CORE_JIT,      0, 1, "jit without idle skip" },
+};
+
+static void caseName(const conformance_t *c, char *out, size_t size) {
+    snprintf(out, size, "%s (%s%s)", c->rom->name, quirksName(c->quirks), c->wrapSprites ? ", wrap" : "");
+}
+
+// runs one case every way there is. Returns how many of them got it wrong
+static int runCase(const conformance_t *c, int print) {
+    char name[64];
+    caseName(c, name, sizeof(name));
+    int wrong = 0, shown = 0;
+
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        const variant_t *variant = &variants[i];
+        machine_t *m = loadTestRom(c->rom, variant->core, c->quirks, c->wrapSprites);
+        if (m == NULL) continue; // not in this build
+        m->skipIdle = variant->skipIdle;
+        setFusion(m, variant->fuse);
+
+        uint64_t cycles, frames;
+        int stopped = runUnpaced(m, CONFORMANCE_CYCLES, 0, &cycles, &frames) != 0;
+        uint64_t hash = hashFrameBuffer(m);
+
+        if (print && i == 0) {
+            printf("%s: 0x%016llx%s\n", name, (unsigned long long)hash, stopped ? ", stopped" : "");
+            printScreen(&m->frameBuffer);
+        } else if (!print && (hash != c->hash || stopped != c->stops)) {
+            wrong++;
+            CHECK(hash == c->hash, "%s on %s: hash 0x%016llx, expected 0x%016llx", name, variant->name,
+                  (unsigned long long)hash, (unsigned long long)c->hash);
+            CHECK(stopped == c->stops, "%s on %s: %s", name, variant->name,
+                  stopped ? "stopped" : "didn't stop");
+            if (!shown++) printScreen(&m->frameBuffer);
+        }
+        destroyMachine(m);
+    }
+    if (print) return 0;
+
+    uint8_t *image = malloc(RAM_SIZE);
+    size_t size = romImage(c->rom, image);
+    lockstep_t *g = createLockstep(image, size, LOCKSTEP_TEST_LANES, c->quirks, c->wrapSprites);
+    free(image);
+    CHECK(g != NULL, "%s: couldn't create a lockstep group", name);
+    if (g == NULL) return wrong + 1;
+    runLockstep(g, CONFORMANCE_CYCLES, 0);
+    for (int lane = 0; lane < LOCKSTEP_TEST_LANES; lane++) {
+        uint64_t hash = laneHash(g, lane);
+        int stopped = laneStopped(g, lane);
+        if (hash == c->hash && stopped == c->stops) continue;
+        wrong++;
+        CHECK(hash == c->hash, "%s on lockstep lane %d: hash 0x%016llx, expected 0x%016llx", name, lane,
+              (unsigned long long)hash, (unsigned long long)c->hash);
+        CHECK(stopped == c->stops, "%s on lockstep lane %d: %s", name, lane, stopped ? "stopped" : "didn't stop");
+    }
+    destroyLockstep(g);
+    return wrong;
+}
+
+#ifdef HAVE_JIT
+// a block longer than what's left of a frame still runs natively, up to the end of the frame
+static void jitLongBlocks() {
+    machine_t *m = loadTestRom(&longLoopRom, CORE_JIT, QUIRKS_CLIP8, 0);
+    if (m == NULL) return;
+    uint64_t cycles, frames;
+    runUnpaced(m, CONFORMANCE_CYCLES, 0, &cycles, &frames);
+    CHECK(m->jitNativeInstructions * 10 >= cycles * 9, "%s on jit: %llu of %llu instructions ran natively",
+          longLoopRom.name, (unsigned long long)m->jitNativeInstructions, (unsigned long long)cycles);
+    destroyMachine(m);
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    int print = argc > 1 && strcmp(argv[1], "--print") == 0;
+    int count = sizeof(cases) / sizeof(cases[0]), passed = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (runCase(&cases[i], print) == 0) passed++;
+    }
+#ifdef HAVE_JIT
+    if (!print) jitLongBlocks();
+#endif
+    if (!print) printf("%d of %d rom runs ended on the expected screen everywhere (%s lockstep vectors)\n",
+                       passed, count, lockstepVectorName());
+    return checksFailed != 0;
+}
@@ -0,0 +1,403 @@
+#include "tests.h"
+
+// ##########  OPCODES  ##########
+// every instruction on its own through runInstruction(), from a power-on machine with the registers it needs set
+// by hand, under each profile where they disagree. runInstruction() doesn't move PC past the instruction (clockCycle()
+// does), so a jump leaves PC 2 short of where it goes and a taken skip leaves it 2 ahead
+
+static machine_t *m;
+
+// a machine in its power-on state running roms for that interpreter, PC at 0x200
+static void fresh(quirks_t quirks, int wrapSprites) {
+    setQuirks(m, quirks, wrapSprites);
+    resetMachine(m);
+}
+
+static int run(uint16_t word) {
+    decoded_t d = decodeWord(word);
+    return runInstruction(m, &d);
+}
+
+// whether the lo-res pixel at (x, y) is on, in plane 1
+static int pixel(int x, int y) {
+    const frame_buffer_t *f = &m->frameBuffer;
+    return f->rows[0][y][x >> 6] >> (63 - (x & 63)) & 1;
+}
+
+static void decoding() {
+    static const struct { uint16_t word; opcode_t opcode; } table[] = {
+        { 0x0000, ROM_END }, { 0x0123, SYS },    { 0x00E0, CLS },     { 0x00EE, RET },     { 0x1ABC, JPADR },
+        { 0x2ABC, CALL },    { 0x3A12, SEIMM },  { 0x4A12, SNE },     { 0x5AB0, SEREG },   { 0x5AB1, ILLEGAL },
+        { 0x6A12, LDIMM },   { 0x7A12, ADDIMM }, { 0x8AB0, LDI },     { 0x8AB1, OR },      { 0x8AB2, AND },
+        { 0x8AB3, XOR },     { 0x8AB4, ADDREG }, { 0x8AB5, SUB },     { 0x8AB6, SHR },     { 0x8AB7, SUBN },
+        { 0x8AB8, ILLEGAL }, { 0x8ABE, SHL },    { 0x9AB0, SNEREG },  { 0x9AB1, ILLEGAL }, { 0xAABC, LD },
+        { 0xBABC, JPREG },   { 0xCA12, RND },    { 0xDAB5, DRW },     { 0xEA9E, SKP },     { 0xEAA1, SKNP },
+        { 0xEA00, ILLEGAL }, { 0xFA07, LDREGDT },{ 0xFA0A, LDK },     { 0xFA15, LDDTVX },  { 0xFA18, LDSTVX },
+        { 0xFA1E, ADDIVX },  { 0xFA29, LDFVX },  { 0xFA33, LDBVX },   { 0xFA55, LDIVX },   { 0xFA65, LDVXI },
+        { 0xFAFF, ILLEGAL }, { 0x00C3, SCD },    { 0x00FB, SCR },     { 0x00FC, SCL },     { 0x00FD, EXIT },
+        { 0x00FE, LOW },     { 0x00FF, HIGH },   { 0xFA30, LDHF },    { 0xFA75, LDRVX },   { 0xFA85, LDVXR },
+        { 0x00D3, SCU },     { 0x5AB2, SAVE },   { 0x5AB3, LOAD },    { 0xF000, LDILONG }, { 0xF100, ILLEGAL },
+        { 0xF201, PLANE },   { 0xF002, AUDIO },  { 0xF102, ILLEGAL }, { 0xFA3A, PITCH },
+    };
+    int covered[OPCODE_COUNT] = { 0 };
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        opcode_t opcode = decodeInstruction(table[i].word);
+        CHECK(opcode == table[i].opcode, "%04X decodes to %s, not %s", table[i].word, opcodeName(opcode),
+              opcodeName(table[i].opcode));
+        covered[table[i].opcode - ROM_END] = 1;
+    }
+    for (int op = ROM_END; op <= OPCODE_LAST; op++) {
+        CHECK(covered[op - ROM_END], "no decoding check for %s", opcodeName(op));
+    }
+
+    decoded_t d = decodeWord(0xDAB5);
+    CHECK(d.x == 0xA && d.y == 0xB && d.n == 5 && d.kk == 0xB5 && d.nnn == 0xAB5 && d.instruction == 0xDAB5,
+          "decodeWord() operands of DAB5");
+}
+
+static void flow() {
+    fresh(QUIRKS_CLIP8, 0);
+    run(0x1456);
+    CHECK(m->PC == 0x454, "1456: PC = %03X", m->PC);
+
+    fresh(QUIRKS_CLIP8, 0);
+    run(0x2345);
+    CHECK(m->PC == 0x343 && m->SP == 1 && m->stack[1] == 0x200, "2345: PC = %03X, SP = %d", m->PC, m->SP);
+    run(0x00EE);
+    CHECK(m->PC == 0x200 && m->SP == 0, "00EE: PC = %03X, SP = %d", m->PC, m->SP);
+
+    fresh(QUIRKS_CLIP8, 0); // Bnnn adds V0
+    m->v[0] = 4; m->v[3] = 8;
+    run(0xB312);
+    CHECK(m->PC == 0x314, "B312 (clip8): PC = %03X", m->PC);
+
+    quirks_t bxnn[] = { QUIRKS_CHIP48, QUIRKS_SCHIP }; // Bxnn adds Vx
+    for (int i = 0; i < 2; i++) {
+        fresh(bxnn[i], 0);
+        m->v[0] = 4; m->v[3] = 8;
+        run(0xB312);
+        CHECK(m->PC == 0x318, "B312 (%s): PC = %03X", quirksName(bxnn[i]), m->PC);
+    }
+
+    const uint16_t stops[] = { 0x0000, 0x0123, 0x5AB1, 0x8AB8, 0xEA00, 0xFAFF, 0x00FD };
+    for (size_t i = 0; i < sizeof(stops) / sizeof(stops[0]); i++) {
+        fresh(QUIRKS_CLIP8, 0);
+        int status = run(stops[i]);
+        CHECK(status == -1 && m->stopped, "%04X doesn't stop the rom", stops[i]);
+    }
+}
+
+static void skips() {
+    struct { uint16_t word; uint8_t vx, vy; uint16_t keypad; int taken; } table[] = {
+        { 0x3312, 0x12, 0,    0,       1 }, { 0x3312, 0x13, 0,    0,       0 },
+        { 0x4312, 0x12, 0,    0,       0 }, { 0x4312, 0x13, 0,    0,       1 },
+        { 0x5340, 0x12, 0x12, 0,       1 }, { 0x5340, 0x12, 0x13, 0,       0 },
+        { 0x9340, 0x12, 0x12, 0,       0 }, { 0x9340, 0x12, 0x13, 0,       1 },
+        { 0xE39E, 0x05, 0,    1 << 5,  1 }, { 0xE39E, 0x05, 0,    1 << 4,  0 },
+        { 0xE3A1, 0x05, 0,    1 << 5,  0 }, { 0xE3A1, 0x05, 0,    1 << 4,  1 },
+        { 0xE39E, 0x15, 0,    1 << 5,  1 }, // only the low nibble of Vx is a key
+    };
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        fresh(QUIRKS_CLIP8, 0);
+        m->v[3] = table[i].vx; m->v[4] = table[i].vy;
+        m->keypad = table[i].keypad;
+        run(table[i].word);
+        CHECK(m->PC == (table[i].taken ? 0x202 : 0x200), "%04X with V3 = %02X, V4 = %02X, keypad %04X: PC = %03X",
+              table[i].word, table[i].vx, table[i].vy, table[i].keypad, m->PC);
+    }
+
+    // XO-CHIP steps over all 4 bytes of an F000 nnnn, the others only know 2 byte instructions
+    quirks_t profiles[] = { QUIRKS_CLIP8, QUIRKS_XOCHIP };
+    for (int i = 0; i < 2; i++) {
+        fresh(profiles[i], 0);
+        m->ram[0x202] = 0xF0; m->ram[0x203] = 0x00;
+        run(0x3000);
+        CHECK(m->PC == (profiles[i] == QUIRKS_XOCHIP ? 0x204 : 0x202), "3000 over F000 (%s): PC = %03X",
+              quirksName(profiles[i]), m->PC);
+    }
+}
+
+static void alu() {
+    fresh(QUIRKS_CLIP8, 0);
+    m->v[0xF] = 7;
+    run(0x6A12); run(0x7AFF);
+    CHECK(m->v[0xA] == 0x11 && m->v[0xF] == 7, "6A12 7AFF: VA = %02X, VF = %02X", m->v[0xA], m->v[0xF]);
+    m->v[0xB] = 0x34;
+    run(0x8AB0);
+    CHECK(m->v[0xA] == 0x34, "8AB0: VA = %02X", m->v[0xA]);
+
+    struct { uint16_t word; uint8_t vx, vy, result, vf; } table[] = {
+        { 0x8AB4, 0x12, 0x34, 0x46, 0 }, { 0x8AB4, 0xFF, 0x02, 0x01, 1 },
+        { 0x8AB5, 0x30, 0x10, 0x20, 1 }, { 0x8AB5, 0x10, 0x30, 0xE0, 0 }, { 0x8AB5, 0x10, 0x10, 0x00, 1 },
+        { 0x8AB7, 0x10, 0x30, 0x20, 1 }, { 0x8AB7, 0x30, 0x10, 0xE0, 0 },
+        { 0x8AB6, 0x05, 0x00, 0x02, 1 }, { 0x8AB6, 0x04, 0x00, 0x02, 0 },
+        { 0x8ABE, 0x81, 0x00, 0x02, 1 }, { 0x8ABE, 0x40, 0x00, 0x80, 0 },
+    };
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        fresh(QUIRKS_CLIP8, 0);
+        m->v[0xA] = table[i].vx; m->v[0xB] = table[i].vy;
+        run(table[i].word);
+        CHECK(m->v[0xA] == table[i].result && m->v[0xF] == table[i].vf, "%04X with %02X, %02X: VA = %02X, VF = %d",
+              table[i].word, table[i].vx, table[i].vy, m->v[0xA], m->v[0xF]);
+    }
+
+    fresh(QUIRKS_CLIP8, 0); // the flag is written last, so it wins over the result
+    m->v[0xF] = 0xFF; m->v[0xB] = 1;
+    run(0x8FB4);
+    CHECK(m->v[0xF] == 1, "8FB4: VF = %02X", m->v[0xF]);
+
+    // 8xy6/8xyE: the VIP shifts Vy into Vx
+    fresh(QUIRKS_VIP, 0);
+    m->v[0xA] = 0x01; m->v[0xB] = 0x82;
+    run(0x8AB6);
+    CHECK(m->v[0xA] == 0x41 && m->v[0xF] == 0, "8AB6 (vip): VA = %02X, VF = %d", m->v[0xA], m->v[0xF]);
+    m->v[0xA] = 0x01;
+    run(0x8ABE);
+    CHECK(m->v[0xA] == 0x04 && m->v[0xF] == 1, "8ABE (vip): VA = %02X, VF = %d", m->v[0xA], m->v[0xF]);
+
+    // 8xy1/8xy2/8xy3: the VIP clears VF
+    for (quirks_t quirks = 0; quirks < QUIRKS_COUNT; quirks++) {
+        for (int op = 1; op <= 3; op++) {
+            fresh(quirks, 0);
+            m->v[0xA] = 0x3C; m->v[0xB] = 0x0F; m->v[0xF] = 7;
+            run(0x8AB0 | op);
+            uint8_t result = op == 1 ? 0x3F : op == 2 ? 0x0C : 0x33;
+            uint8_t vf = quirks == QUIRKS_VIP ? 0 : 7;
+            CHECK(m->v[0xA] == result && m->v[0xF] == vf, "8AB%d (%s): VA = %02X, VF = %d", op, quirksName(quirks),
+                  m->v[0xA], m->v[0xF]);
+        }
+    }
+
+    // RND: masked, and the same bytes from the same seed
+    fresh(QUIRKS_CLIP8, 0);
+    uint8_t first[16];
+    for (int i = 0; i < 16; i++) { run(0xCA0F); first[i] = m->v[0xA]; }
+    fresh(QUIRKS_CLIP8, 0);
+    for (int i = 0; i < 16; i++) {
+        run(0xCA0F);
+        CHECK(m->v[0xA] == first[i] && m->v[0xA] <= 0x0F, "CA0F: byte %d is %02X, was %02X", i, m->v[0xA], first[i]);
+    }
+    run(0xCA00);
+    CHECK(m->v[0xA] == 0, "CA00: VA = %02X", m->v[0xA]);
+}
+
+static void memory() {
+    fresh(QUIRKS_CLIP8, 0);
+    run(0xA123);
+    CHECK(m->I == 0x123, "A123: I = %03X", m->I);
+    m->v[3] = 0x20;
+    run(0xF31E);
+    CHECK(m->I == 0x143, "F31E: I = %03X", m->I);
+    m->v[3] = 0xA;
+    run(0xF329);
+    CHECK(m->I == FONT_START + 50 && m->ram[m->I] == 0xF0, "F329: I = %03X", m->I);
+    run(0xF330);
+    CHECK(m->I == BIG_FONT_START + 100, "F330: I = %03X", m->I);
+
+    fresh(QUIRKS_CLIP8, 0);
+    m->I = 0x300; m->v[3] = 254;
+    run(0xF333);
+    CHECK(m->ram[0x300] == 2 && m->ram[0x301] == 5 && m->ram[0x302] == 4, "F333 of 254: %d %d %d",
+          m->ram[0x300], m->ram[0x301], m->ram[0x302]);
+
+    // Fx55/Fx65, and where each interpreter leaves I
+    for (quirks_t quirks = 0; quirks < QUIRKS_COUNT; quirks++) {
+        int moved = quirks == QUIRKS_VIP || quirks == QUIRKS_XOCHIP ? 4 : quirks == QUIRKS_CHIP48 ? 3 : 0;
+        fresh(quirks, 0);
+        for (int i = 0; i < 4; i++) m->v[i] = 0x10 + i;
+        m->I = 0x300;
+        run(0xF355);
+        CHECK(m->ram[0x300] == 0x10 && m->ram[0x303] == 0x13 && m->ram[0x304] == 0, "F355 (%s) stored the wrong bytes",
+              quirksName(quirks));
+        CHECK(m->I == 0x300 + moved, "F355 (%s): I = %03X", quirksName(quirks), m->I);
+        memset(m->v, 0, 4);
+        m->I = 0x300;
+        run(0xF365);
+        CHECK(m->v[0] == 0x10 && m->v[3] == 0x13, "F365 (%s) loaded the wrong bytes", quirksName(quirks));
+        CHECK(m->I == 0x300 + moved, "F365 (%s): I = %03X", quirksName(quirks), m->I);
+    }
+
+    // XO-CHIP's sound: F002 copies the pattern, Fx3A sets the pitch
+    fresh(QUIRKS_XOCHIP, 0);
+    CHECK(m->pitch == DEFAULT_PITCH && m->audioPattern[0] == 0xF0, "power-on pitch %d, pattern %02X", m->pitch,
+          m->audioPattern[0]);
+    for (int i = 0; i < AUDIO_PATTERN_SIZE; i++) m->ram[0x300 + i] = (uint8_t)(0x11 * i);
+    m->I = 0x300;
+    run(0xF002);
+    CHECK(m->audioPattern[1] == 0x11 && m->audioPattern[15] == 0xFF && m->I == 0x300, "F002 loaded %02X..%02X, I = %03X",
+          m->audioPattern[1], m->audioPattern[15], m->I);
+    m->v[7] = 112;
+    run(0xF73A);
+    CHECK(m->pitch == 112, "F73A: pitch = %d", m->pitch);
+
+    // writing over code re-decodes it
+    fresh(QUIRKS_CLIP8, 0);
+    m->v[0] = 0x12; m->v[1] = 0x34;
+    m->I = 0x300;
+    run(0xF155);
+    CHECK(m->decodeCache[0x300 >> 1].opcode == JPADR && m->decodeCache[0x300 >> 1].nnn == 0x234,
+          "F155 over 0x300 left the decode cache at %s", opcodeName(m->decodeCache[0x300 >> 1].opcode));
+    fresh(QUIRKS_XOCHIP, 0);
+    m->v[2] = 0x12; m->v[3] = 0x34;
+    m->I = MEMORY_END - 1;
+    run(0xF355);
+    CHECK(m->decodeCache[0].opcode == JPADR && m->decodeCache[0].nnn == 0x234,
+          "F355 wrapping past the end left the decode cache at 0 at %s", opcodeName(m->decodeCache[0].opcode));
+    fresh(QUIRKS_CLIP8, 0); // the other profiles only have 4 KB, and wrap there
+    m->v[2] = 0x12; m->v[3] = 0x34;
+    m->I = CHIP8_RAM_SIZE - 2;
+    run(0xF355);
+    CHECK(m->decodeCache[0].opcode == JPADR && m->decodeCache[0].nnn == 0x234 && m->ram[CHIP8_RAM_SIZE] == 0,
+          "F355 wrapping past 4 KB left the decode cache at 0 at %s, 0x1000 = %02X",
+          opcodeName(m->decodeCache[0].opcode), m->ram[CHIP8_RAM_SIZE]);
+    m->I = CHIP8_RAM_SIZE - 1;
+    run(0xF165);
+    CHECK(m->v[0] == 0x00 && m->v[1] == 0x12, "F165 at 0xFFF read %02X %02X", m->v[0], m->v[1]);
+
+    // SUPER-CHIP's flag registers
+    fresh(QUIRKS_SCHIP, 0);
+    for (int i = 0; i < 8; i++) m->v[i] = 0x20 + i;
+    run(0xF775);
+    memset(m->v, 0, 8);
+    run(0xF585);
+    CHECK(m->v[0] == 0x20 && m->v[5] == 0x25 && m->v[6] == 0, "F775 F585: V0 = %02X, V5 = %02X, V6 = %02X",
+          m->v[0], m->v[5], m->v[6]);
+
+    // XO-CHIP: 5xy2/5xy3 either way round, I stays put, F000 nnnn
+    fresh(QUIRKS_XOCHIP, 0);
+    for (int i = 0; i < 4; i++) m->v[2 + i] = 0x30 + i;
+    m->I = 0x8000;
+    run(0x5252);
+    CHECK(m->ram[0x8000] == 0x30 && m->ram[0x8003] == 0x33 && m->I == 0x8000, "5252: %02X..%02X, I = %04X",
+          m->ram[0x8000], m->ram[0x8003], m->I);
+    run(0x5A73);
+    CHECK(m->v[0xA] == 0x30 && m->v[7] == 0x33, "5A73: VA = %02X, V7 = %02X", m->v[0xA], m->v[7]);
+    run(0x5542);
+    CHECK(m->ram[0x8000] == 0x33 && m->ram[0x8001] == 0x32, "5542: %02X %02X", m->ram[0x8000], m->ram[0x8001]);
+
+    m->ram[0x202] = 0xAB; m->ram[0x203] = 0xCD;
+    run(0xF000);
+    CHECK(m->I == 0xABCD && m->PC == 0x202, "F000 ABCD: I = %04X, PC = %03X", m->I, m->PC);
+}
+
+static void timersAndKeys() {
+    fresh(QUIRKS_CLIP8, 0);
+    m->v[3] = 0x40;
+    run(0xF315); run(0xF318);
+    CHECK(m->DT == 0x40 && m->ST == 0x40, "F315 F318: DT = %02X, ST = %02X", m->DT, m->ST);
+    tickTimers(m);
+    run(0xF407);
+    CHECK(m->v[4] == 0x3F, "F407 after a tick: V4 = %02X", m->v[4]);
+
+    // Fx0A waits for a key to go down and back up, running itself again until then
+    fresh(QUIRKS_CLIP8, 0);
+    run(0xF30A);
+    CHECK(m->PC == 0x1FE, "F30A with no key: PC = %03X", m->PC);
+    m->PC = 0x200; m->keypad = 1 << 7;
+    run(0xF30A);
+    CHECK(m->PC == 0x1FE && m->keyHeld == 7, "F30A with 7 down: PC = %03X", m->PC);
+    m->PC = 0x200; m->keypad = 0;
+    run(0xF30A);
+    CHECK(m->PC == 0x200 && m->v[3] == 7 && m->keyHeld == KEY_NONE, "F30A after 7 let go: PC = %03X, V3 = %d",
+          m->PC, m->v[3]);
+}
+
+static void display() {
+    // Dxyn: XOR, collision, clipping at the edges
+    fresh(QUIRKS_CLIP8, 0);
+    m->I = FONT_START; // the 0, F0 90 90 90 F0
+    m->v[0] = 2; m->v[1] = 3;
+    run(0xD015);
+    CHECK(pixel(2, 3) && pixel(5, 3) && !pixel(6, 3) && pixel(2, 4) && !pixel(3, 4) && m->v[0xF] == 0,
+          "D015 drew the wrong 0");
+    run(0xD015);
+    CHECK(!pixel(2, 3) && m->v[0xF] == 1, "D015 twice didn't erase it, VF = %d", m->v[0xF]);
+
+    m->I = 0x300; m->ram[0x300] = 0xFF;
+    m->v[0] = 60; m->v[1] = 31;
+    run(0xD012);
+    CHECK(pixel(63, 31) && !pixel(0, 31) && !pixel(60, 0), "D012 at (60, 31) wasn't clipped");
+
+    fresh(QUIRKS_CLIP8, 1);
+    m->I = 0x300; m->ram[0x300] = 0xFF; m->ram[0x301] = 0x80;
+    m->v[0] = 60; m->v[1] = 31;
+    run(0xD012);
+    CHECK(pixel(63, 31) && pixel(3, 31) && pixel(60, 0), "D012 at (60, 31) didn't wrap");
+
+    // the origin wraps on the VIP, and not on this emulator
+    quirks_t profiles[] = { QUIRKS_CLIP8, QUIRKS_VIP };
+    for (int i = 0; i < 2; i++) {
+        fresh(profiles[i], 0);
+        m->I = 0x300; m->ram[0x300] = 0x80;
+        m->v[0] = 70; m->v[1] = 33;
+        run(0xD011);
+        CHECK(pixel(6, 1) == (profiles[i] == QUIRKS_VIP), "D011 at (70, 33) (%s)", quirksName(profiles[i]));
+    }
+
+    // 00E0 clears
+    run(0x00E0);
+    CHECK(hashFrameBuffer(m) == hashFrame(&(frame_buffer_t){ .planes = 1 }), "00E0 left something on screen");
+
+    // hi-res and the scrolls, a pixel at a time
+    fresh(QUIRKS_SCHIP, 0);
+    m->frameBuffer.rows[0][0][0] = 1;
+    run(0x00FF);
+    CHECK(m->frameBuffer.hires && m->frameBuffer.rows[0][0][0] == 0, "00FF didn't switch to a clear hi-res screen");
+    m->I = 0x300; m->ram[0x300] = 0x80;
+    m->v[0] = 63; m->v[1] = 40;
+    run(0xD011);
+    CHECK(m->frameBuffer.rows[0][40][0] == 1, "D011 at (63, 40) in hi-res");
+    run(0x00FB);
+    CHECK(m->frameBuffer.rows[0][40][0] == 0 && m->frameBuffer.rows[0][40][1] == 1ULL << 60, "00FB across the words");
+    run(0x00FC);
+    run(0x00C5);
+    CHECK(m->frameBuffer.rows[0][45][0] == 1 && m->frameBuffer.rows[0][40][0] == 0, "00FC 00C5");
+    run(0x00FE);
+    CHECK(!m->frameBuffer.hires && m->frameBuffer.rows[0][45][0] == 0, "00FE didn't switch to a clear lo-res screen");
+
+    fresh(QUIRKS_SCHIP, 0); // in lo-res they move lo-res pixels
+    m->frameBuffer.rows[0][10][0] = 1ULL << 53; // (10, 10)
+    run(0x00C2); run(0x00FB);
+    CHECK(pixel(14, 12) && !pixel(10, 10), "00C2 00FB in lo-res");
+    run(0x00FC);
+    CHECK(pixel(10, 12), "00FC in lo-res");
+
+    // 16x16 sprites
+    fresh(QUIRKS_SCHIP, 0);
+    m->I = 0x300;
+    for (int i = 0; i < 32; i++) m->ram[0x300 + i] = 0xFF;
+    run(0xD010);
+    CHECK(pixel(15, 15) && !pixel(16, 0) && !pixel(0, 16), "D010 isn't 16x16");
+
+    // XO-CHIP's planes: DRW takes a sprite for each selected one, one after the other from I, and 00Dn scrolls up
+    fresh(QUIRKS_XOCHIP, 0);
+    m->I = 0x300; m->ram[0x300] = 0x80; m->ram[0x301] = 0x40;
+    run(0xF201);
+    CHECK(m->frameBuffer.planes == 2, "F201: planes = %d", m->frameBuffer.planes);
+    run(0xD011);
+    CHECK(!pixel(0, 0) && m->frameBuffer.rows[1][0][0] == 1ULL << 63, "D011 on plane 2");
+    run(0xF301);
+    run(0xD011);
+    CHECK(pixel(0, 0) && m->frameBuffer.rows[1][0][0] == (1ULL << 62 | 1ULL << 63), "D011 on both planes");
+    m->frameBuffer.rows[0][5][0] = 1;
+    run(0xF101);
+    run(0x00D3);
+    CHECK(m->frameBuffer.rows[0][2][0] == 1 && m->frameBuffer.rows[1][0][0] != 0, "00D3 on plane 1 only");
+}
+
+int main() {
+    m = createMachine(CORE_SWITCH);
+    if (m == NULL) return 1;
+
+    decoding();
+    flow();
+    skips();
+    alu();
+    memory();
+    timersAndKeys();
+    display();
+
+    destroyMachine(m);
+    if (checksFailed == 0) printf("every opcode checks out\n");
+    return checksFailed != 0;
+}
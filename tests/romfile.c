@@ -0,0 +1,31 @@
+#include "tests.h"
+
+// ##########  ROM FILES  ##########
+// writes one of the test roms out as a .ch8 file, for clip8-aot to translate (see CLIP8_AOT_CASES in CMakeLists.txt)
+//
+// usage: clip8-test-rom NAME FILE
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s NAME FILE\n", argv[0]);
+        return 1;
+    }
+    for (const test_rom_t *const *rom = testRoms; *rom != NULL; rom++) {
+        if (strcmp((*rom)->name, argv[1]) != 0) continue;
+        static uint8_t image[RAM_SIZE];
+        size_t size = romImage(*rom, image);
+        FILE *file = fopen(argv[2], "wb");
+        if (file == NULL) {
+            perror("Error opening output");
+            return 1;
+        }
+        int ok = fwrite(image, 1, size, file) == size;
+        if (fclose(file) != 0 || !ok) {
+            perror("Error writing output");
+            return 1;
+        }
+        return 0;
+    }
+    fprintf(stderr, "no test rom called %s\n", argv[1]);
+    return 1;
+}
@@ -0,0 +1,743 @@
+#include "tests.h"
+
+// ##########  TEST ROMS  ##########
+// small roms written for these tests (public domain, like the tests themselves), plus David Winter's Maze. All but
+// the benchmark one end in a jump to itself or 00FD, so the screen they leave is what gets hashed. The comments are
+// the source: address, label, instruction
+
+// ALU results and flags the profiles all agree on, checked by the rom itself. Each check draws a dash if it passed
+// and an X if it didn't: 31 dashes, 12 to a row, is a pass
+static const uint16_t flagsWords[] = {
+    0x1206,  // 200           JP main
+    0x1210,  // 202  table:   JP wrong                 Bnnn lands here with V0 = 0,
+    0x1214,  // 204           JP right                 here with V0 = 2 (or V2 = 2 with CHIP-48's Bxnn)
+    0x6C00,  // 206  main:    LD VC, 0
+    0x6D00,  // 208           LD VD, 0
+    0x6002,  // 20A           LD V0, 2
+    0x6202,  // 20C           LD V2, 2
+    0xB202,  // 20E           JPX 0x202                so every profile goes to the same place
+    0x6000,  // 210  wrong:   LD V0, 0
+    0x1216,  // 212           JP bnnn
+    0x6001,  // 214  right:   LD V0, 1
+    0x6801,  // 216  bnnn:    LD V8, 1
+    0x89F0,  // 218           LD V9, VF
+    0x237A,  // 21A           CALL check
+
+    // 8xy4, with and without carry, and into VF
+    0x6012,  // 21C           LD V0, 0x12
+    0x6134,  // 21E           LD V1, 0x34
+    0x8014,  // 220           ADD V0, V1
+    0x6846,  // 222           LD V8, 0x46
+    0x6900,  // 224           LD V9, 0
+    0x237A,  // 226           CALL check
+    0x60FF,  // 228           LD V0, 0xFF
+    0x6102,  // 22A           LD V1, 0x02
+    0x8014,  // 22C           ADD V0, V1
+    0x6801,  // 22E           LD V8, 0x01
+    0x6901,  // 230           LD V9, 1
+    0x237A,  // 232           CALL check
+    0x6000,  // 234           LD V0, 0
+    0x6F10,  // 236           LD VF, 0x10
+    0x6120,  // 238           LD V1, 0x20
+    0x8F14,  // 23A           ADD VF, V1               the flag wins
+    0x6800,  // 23C           LD V8, 0
+    0x6900,  // 23E           LD V9, 0
+    0x237A,  // 240           CALL check
+    0x6FFF,  // 242           LD VF, 0xFF
+    0x6101,  // 244           LD V1, 0x01
+    0x8F14,  // 246           ADD VF, V1
+    0x6901,  // 248           LD V9, 1
+    0x237A,  // 24A           CALL check
+
+    // 8xy5 and 8xy7: VF = no borrow
+    0x6030,  // 24C           LD V0, 0x30
+    0x6110,  // 24E           LD V1, 0x10
+    0x8015,  // 250           SUB V0, V1
+    0x6820,  // 252           LD V8, 0x20
+    0x6901,  // 254           LD V9, 1
+    0x237A,  // 256           CALL check
+    0x6010,  // 258           LD V0, 0x10
+    0x6130,  // 25A           LD V1, 0x30
+    0x8015,  // 25C           SUB V0, V1
+    0x68E0,  // 25E           LD V8, 0xE0
+    0x6900,  // 260           LD V9, 0
+    0x237A,  // 262           CALL check
+    0x6010,  // 264           LD V0, 0x10
+    0x6110,  // 266           LD V1, 0x10
+    0x8015,  // 268           SUB V0, V1
+    0x6800,  // 26A           LD V8, 0
+    0x6901,  // 26C           LD V9, 1
+    0x237A,  // 26E           CALL check
+    0x6010,  // 270           LD V0, 0x10
+    0x6130,  // 272           LD V1, 0x30
+    0x8017,  // 274           SUBN V0, V1
+    0x6820,  // 276           LD V8, 0x20
+    0x6901,  // 278           LD V9, 1
+    0x237A,  // 27A           CALL check
+    0x6030,  // 27C           LD V0, 0x30
+    0x6110,  // 27E           LD V1, 0x10
+    0x8017,  // 280           SUBN V0, V1
+    0x68E0,  // 282           LD V8, 0xE0
+    0x6900,  // 284           LD V9, 0
+    0x237A,  // 286           CALL check
+
+    // 8xy6 and 8xyE with x = y, which every profile shifts the same
+    0x6005,  // 288           LD V0, 0x05
+    0x8006,  // 28A           SHR V0, V0
+    0x6802,  // 28C           LD V8, 0x02
+    0x6901,  // 28E           LD V9, 1
+    0x237A,  // 290           CALL check
+    0x6004,  // 292           LD V0, 0x04
+    0x8006,  // 294           SHR V0, V0
+    0x6900,  // 296           LD V9, 0
+    0x237A,  // 298           CALL check
+    0x6081,  // 29A           LD V0, 0x81
+    0x800E,  // 29C           SHL V0, V0
+    0x6901,  // 29E           LD V9, 1
+    0x237A,  // 2A0           CALL check
+    0x6040,  // 2A2           LD V0, 0x40
+    0x800E,  // 2A4           SHL V0, V0
+    0x6880,  // 2A6           LD V8, 0x80
+    0x6900,  // 2A8           LD V9, 0
+    0x237A,  // 2AA           CALL check
+
+    // 8xy1/8xy2/8xy3 (VF depends on the profile), 8xy0, 7xkk wrapping without touching VF
+    0x600F,  // 2AC           LD V0, 0x0F
+    0x61F0,  // 2AE           LD V1, 0xF0
+    0x8011,  // 2B0           OR V0, V1
+    0x68FF,  // 2B2           LD V8, 0xFF
+    0x89F0,  // 2B4           LD V9, VF
+    0x237A,  // 2B6           CALL check
+    0x603C,  // 2B8           LD V0, 0x3C
+    0x610F,  // 2BA           LD V1, 0x0F
+    0x8012,  // 2BC           AND V0, V1
+    0x680C,  // 2BE           LD V8, 0x0C
+    0x89F0,  // 2C0           LD V9, VF
+    0x237A,  // 2C2           CALL check
+    0x60FF,  // 2C4           LD V0, 0xFF
+    0x8013,  // 2C6           XOR V0, V1
+    0x68F0,  // 2C8           LD V8, 0xF0
+    0x89F0,  // 2CA           LD V9, VF
+    0x237A,  // 2CC           CALL check
+    0x6177,  // 2CE           LD V1, 0x77
+    0x8010,  // 2D0           LD V0, V1
+    0x6877,  // 2D2           LD V8, 0x77
+    0x237A,  // 2D4           CALL check
+    0x6F05,  // 2D6           LD VF, 0x05
+    0x6002,  // 2D8           LD V0, 0x02
+    0x70FF,  // 2DA           ADD V0, 0xFF
+    0x6801,  // 2DC           LD V8, 0x01
+    0x6905,  // 2DE           LD V9, 5
+    0x237A,  // 2E0           CALL check
+
+    // 5xy0 taken and 9xy0 not, then the other way round
+    0x6111,  // 2E2           LD V1, 0x11
+    0x6211,  // 2E4           LD V2, 0x11
+    0x6000,  // 2E6           LD V0, 0
+    0x5120,  // 2E8           SE V1, V2
+    0x7001,  // 2EA           ADD V0, 1
+    0x9120,  // 2EC           SNE V1, V2
+    0x7002,  // 2EE           ADD V0, 2
+    0x6802,  // 2F0           LD V8, 2
+    0x89F0,  // 2F2           LD V9, VF
+    0x237A,  // 2F4           CALL check
+    0x6212,  // 2F6           LD V2, 0x12
+    0x6000,  // 2F8           LD V0, 0
+    0x5120,  // 2FA           SE V1, V2
+    0x7001,  // 2FC           ADD V0, 1
+    0x9120,  // 2FE           SNE V1, V2
+    0x7002,  // 300           ADD V0, 2
+    0x6801,  // 302           LD V8, 1
+    0x237A,  // 304           CALL check
+
+    // 2nnn and 00EE, two deep
+    0x6000,  // 306           LD V0, 0
+    0x2392,  // 308           CALL outer
+    0x6843,  // 30A           LD V8, 0x43
+    0x237A,  // 30C           CALL check
+
+    // Fx33, Fx55 and Fx65 (I is set again every time, the profiles don't agree on where they leave it)
+    0x60FE,  // 30E           LD V0, 254
+    0xA3A8,  // 310           LD I, scratch
+    0xF033,  // 312           LD B, V0
+    0xA3A8,  // 314           LD I, scratch
+    0xF265,  // 316           LD V2, [I]
+    0x6802,  // 318           LD V8, 2
+    0x237A,  // 31A           CALL check
+    0x8010,  // 31C           LD V0, V1
+    0x6805,  // 31E           LD V8, 5
+    0x237A,  // 320           CALL check
+    0x8020,  // 322           LD V0, V2
+    0x6804,  // 324           LD V8, 4
+    0x237A,  // 326           CALL check
+    0x6001,  // 328           LD V0, 1
+    0x6102,  // 32A           LD V1, 2
+    0x6203,  // 32C           LD V2, 3
+    0x6304,  // 32E           LD V3, 4
+    0xA3A8,  // 330           LD I, scratch
+    0xF355,  // 332           LD [I], V3
+    0x6000,  // 334           LD V0, 0
+    0x6300,  // 336           LD V3, 0
+    0xA3A8,  // 338           LD I, scratch
+    0xF365,  // 33A           LD V3, [I]
+    0x6801,  // 33C           LD V8, 1
+    0x237A,  // 33E           CALL check
+    0x8030,  // 340           LD V0, V3
+    0x6804,  // 342           LD V8, 4
+    0x237A,  // 344           CALL check
+
+    // Fx1E and Fx29
+    0xA3A4,  // 346           LD I, data
+    0x6002,  // 348           LD V0, 2
+    0xF01E,  // 34A           ADD I, V0
+    0xF065,  // 34C           LD V0, [I]
+    0x6833,  // 34E           LD V8, 0x33
+    0x237A,  // 350           CALL check
+    0x600A,  // 352           LD V0, 0xA
+    0xF029,  // 354           LD F, V0
+    0xF065,  // 356           LD V0, [I]               the top row of the A
+    0x68F0,  // 358           LD V8, 0xF0
+    0x237A,  // 35A           CALL check
+
+    // Dxyn on an empty spot, then again to erase it
+    0x6138,  // 35C           LD V1, 56
+    0x621C,  // 35E           LD V2, 28
+    0xA39C,  // 360           LD I, ok
+    0xD121,  // 362           DRW V1, V2, 1
+    0x80F0,  // 364           LD V0, VF
+    0x6800,  // 366           LD V8, 0
+    0x89F0,  // 368           LD V9, VF
+    0x237A,  // 36A           CALL check
+    0xA39C,  // 36C           LD I, ok
+    0xD121,  // 36E           DRW V1, V2, 1
+    0x80F0,  // 370           LD V0, VF
+    0x6801,  // 372           LD V8, 1
+    0x89F0,  // 374           LD V9, VF
+    0x237A,  // 376           CALL check
+    0x1378,  // 378  end:     JP end
+
+    // a dash if V0 = V8 and VF = V9, an X if not. 12 to a row
+    0xA39C,  // 37A  check:   LD I, ok
+    0x5080,  // 37C           SE V0, V8
+    0xA3A0,  // 37E           LD I, bad
+    0x5F90,  // 380           SE VF, V9
+    0xA3A0,  // 382           LD I, bad
+    0xDCD3,  // 384           DRW VC, VD, 3
+    0x7C05,  // 386           ADD VC, 5
+    0x3C3C,  // 388           SE VC, 60
+    0x00EE,  // 38A           RET
+    0x6C00,  // 38C           LD VC, 0
+    0x7D04,  // 38E           ADD VD, 4
+    0x00EE,  // 390           RET
+
+    0x7001,  // 392  outer:   ADD V0, 1
+    0x2398,  // 394           CALL inner
+    0x00EE,  // 396           RET
+    0x7042,  // 398  inner:   ADD V0, 0x42
+    0x00EE,  // 39A           RET
+
+    0xF000,  // 39C  ok:      DB 0xF0, 0x00
+    0x0000,  // 39E           DB 0x00, 0x00
+    0xA040,  // 3A0  bad:     DB 0xA0, 0x40
+    0xA000,  // 3A2           DB 0xA0, 0x00
+    0x1122,  // 3A4  data:    DB 0x11, 0x22
+    0x3344,  // 3A6           DB 0x33, 0x44
+    0x0000,  // 3A8  scratch: DB 0, 0
+    0x0000,  // 3AA           DB 0, 0
+};
+
+// what the profiles disagree on, drawn as digits: 8xy6/8xyE's source and VF, VF after 8xy1/8xy2/8xy3, where
+// Fx55/Fx65 leave I and which register Bnnn adds, then sprites past the edges and starting off screen
+static const uint16_t quirksWords[] = {
+    0x1206,  // 200           JP main
+    0x1266,  // 202  table:   JP bnnn0                 Bnnn lands here with V0 = 0,
+    0x126A,  // 204           JP bxnn                  here with CHIP-48's Bxnn and V2 = 2
+    0x6C00,  // 206  main:    LD VC, 0
+    0x6D02,  // 208           LD VD, 2
+
+    // 8xy6/8xyE: shifting Vx gives 1 1 2 1, shifting Vy 2 0 0 0
+    0x6003,  // 20A           LD V0, 3
+    0x6104,  // 20C           LD V1, 4
+    0x8016,  // 20E           SHR V0, V1
+    0x8BF0,  // 210           LD VB, VF
+    0x8A00,  // 212           LD VA, V0
+    0x228A,  // 214           CALL show
+    0x8AB0,  // 216           LD VA, VB
+    0x228A,  // 218           CALL show
+    0x6081,  // 21A           LD V0, 0x81
+    0x6140,  // 21C           LD V1, 0x40
+    0x801E,  // 21E           SHL V0, V1
+    0x8BF0,  // 220           LD VB, VF
+    0x8A00,  // 222           LD VA, V0
+    0x228A,  // 224           CALL show
+    0x8AB0,  // 226           LD VA, VB
+    0x228A,  // 228           CALL show
+
+    // 8xy1/8xy2/8xy3 leave VF at 7, or clear it
+    0x6F07,  // 22A           LD VF, 7
+    0x6005,  // 22C           LD V0, 5
+    0x6103,  // 22E           LD V1, 3
+    0x8011,  // 230           OR V0, V1
+    0x8AF0,  // 232           LD VA, VF
+    0x228A,  // 234           CALL show
+    0x6F07,  // 236           LD VF, 7
+    0x8012,  // 238           AND V0, V1
+    0x8AF0,  // 23A           LD VA, VF
+    0x228A,  // 23C           CALL show
+    0x6F07,  // 23E           LD VF, 7
+    0x8013,  // 240           XOR V0, V1
+    0x8AF0,  // 242           LD VA, VF
+    0x228A,  // 244           CALL show
+
+    // Fx55 and Fx65 leave I where it was (1 5), past the last register (D 7) or on it (3 6)
+    0x6001,  // 246           LD V0, 1
+    0x6102,  // 248           LD V1, 2
+    0x6203,  // 24A           LD V2, 3
+    0xA29A,  // 24C           LD I, stored
+    0xF255,  // 24E           LD [I], V2
+    0xF065,  // 250           LD V0, [I]
+    0x8A00,  // 252           LD VA, V0
+    0x228A,  // 254           CALL show
+    0xA29E,  // 256           LD I, loaded
+    0xF165,  // 258           LD V1, [I]
+    0xF065,  // 25A           LD V0, [I]
+    0x8A00,  // 25C           LD VA, V0
+    0x228A,  // 25E           CALL show
+
+    // Bnnn jumps with V0 (A), Bxnn with V2 (B)
+    0x6000,  // 260           LD V0, 0
+    0x6202,  // 262           LD V2, 2
+    0xB202,  // 264           JPX 0x202
+    0x6A0A,  // 266  bnnn0:   LD VA, 0xA
+    0x126C,  // 268           JP jumped
+    0x6A0B,  // 26A  bxnn:    LD VA, 0xB
+    0x228A,  // 26C  jumped:  CALL show
+
+    // sprites past the right and bottom edges, clipped or wrapped
+    0xA296,  // 26E           LD I, block
+    0x603C,  // 270           LD V0, 60
+    0x610A,  // 272           LD V1, 10
+    0xD014,  // 274           DRW V0, V1, 4
+    0x6014,  // 276           LD V0, 20
+    0x611E,  // 278           LD V1, 30
+    0xD014,  // 27A           DRW V0, V1, 4
+
+    // and starting off screen: nothing, or wrapped to (6, 16) and (30, 8)
+    0x6046,  // 27C           LD V0, 70
+    0x6110,  // 27E           LD V1, 16
+    0xD014,  // 280           DRW V0, V1, 4
+    0x601E,  // 282           LD V0, 30
+    0x6128,  // 284           LD V1, 40
+    0xD014,  // 286           DRW V0, V1, 4
+    0x1288,  // 288  end:     JP end
+
+    // the low digit of VA at (VC, VD)
+    0x690F,  // 28A  show:    LD V9, 0x0F
+    0x8A92,  // 28C           AND VA, V9
+    0xFA29,  // 28E           LD F, VA
+    0xDCD5,  // 290           DRW VC, VD, 5
+    0x7C05,  // 292           ADD VC, 5
+    0x00EE,  // 294           RET
+
+    0xFF81,  // 296  block:   DB 0xFF, 0x81
+    0x81FF,  // 298           DB 0x81, 0xFF
+    0x0000,  // 29A  stored:  DB 0, 0
+    0x000D,  // 29C           DB 0, 0x0D
+    0x0506,  // 29E  loaded:  DB 5, 6
+    0x0708,  // 2A0           DB 7, 8
+};
+
+// the 16 digits, Fx33 of 123, 0 and 255, and a 15 row sprite clipped by the bottom and right edges
+static const uint16_t fontWords[] = {
+    // every digit, 12 to a row
+    0x6A00,  // 200           LD VA, 0
+    0x6C00,  // 202           LD VC, 0
+    0x6D00,  // 204           LD VD, 0
+    0x2242,  // 206  digits:  CALL show
+    0x7A01,  // 208           ADD VA, 1
+    0x3A10,  // 20A           SE VA, 16
+    0x1206,  // 20C           JP digits
+
+    // Fx33 of 123, 0 and 255 in a row of their own
+    0x6C00,  // 20E           LD VC, 0
+    0x6D0C,  // 210           LD VD, 12
+    0x607B,  // 212           LD V0, 123
+    0x222C,  // 214           CALL bcd
+    0x6000,  // 216           LD V0, 0
+    0x222C,  // 218           CALL bcd
+    0x60FF,  // 21A           LD V0, 255
+    0x222C,  // 21C           CALL bcd
+
+    // a 15 row sprite clipped by the bottom edge, then by the bottom and right ones
+    0xA252,  // 21E           LD I, tall
+    0x6028,  // 220           LD V0, 40
+    0x6114,  // 222           LD V1, 20
+    0xD01F,  // 224           DRW V0, V1, 15
+    0x603C,  // 226           LD V0, 60
+    0xD01F,  // 228           DRW V0, V1, 15
+    0x122A,  // 22A  end:     JP end
+
+    // the three digits of V0, then a space
+    0xA262,  // 22C  bcd:     LD I, scratch
+    0xF033,  // 22E           LD B, V0
+    0xF265,  // 230           LD V2, [I]
+    0x8A00,  // 232           LD VA, V0
+    0x2242,  // 234           CALL show
+    0x8A10,  // 236           LD VA, V1
+    0x2242,  // 238           CALL show
+    0x8A20,  // 23A           LD VA, V2
+    0x2242,  // 23C           CALL show
+    0x7C05,  // 23E           ADD VC, 5
+    0x00EE,  // 240           RET
+
+    // digit VA at (VC, VD), moving on to the next row after 12
+    0xFA29,  // 242  show:    LD F, VA
+    0xDCD5,  // 244           DRW VC, VD, 5
+    0x7C05,  // 246           ADD VC, 5
+    0x3C3C,  // 248           SE VC, 60
+    0x00EE,  // 24A           RET
+    0x6C00,  // 24C           LD VC, 0
+    0x7D06,  // 24E           ADD VD, 6
+    0x00EE,  // 250           RET
+
+    0x8142,  // 252  tall:    DB 0x81, 0x42
+    0x2418,  // 254           DB 0x24, 0x18
+    0x1824,  // 256           DB 0x18, 0x24
+    0x4281,  // 258           DB 0x42, 0x81
+    0xFF81,  // 25A           DB 0xFF, 0x81
+    0x8181,  // 25C           DB 0x81, 0x81
+    0x8181,  // 25E           DB 0x81, 0x81
+    0xFF00,  // 260           DB 0xFF, 0x00
+    0x0000,  // 262  scratch: DB 0, 0
+};
+
+// SUPER-CHIP's 00Cn/00FB/00FC in lo-res: blocks drawn between scrolls, the last one half scrolled off
+static const uint16_t scrollWords[] = {
+    // SUPER-CHIP's scrolls in lo-res, where they move whole lo-res pixels
+    0xA226,  // 200           LD I, block
+    0x6000,  // 202           LD V0, 0
+    0x6100,  // 204           LD V1, 0
+    0xD018,  // 206           DRW V0, V1, 8
+    0x00C4,  // 208           SCD 4
+    0x6010,  // 20A           LD V0, 16
+    0xD018,  // 20C           DRW V0, V1, 8
+    0x00FB,  // 20E           SCR
+    0x00FB,  // 210           SCR
+    0x6020,  // 212           LD V0, 32
+    0xD018,  // 214           DRW V0, V1, 8
+    0x00FC,  // 216           SCL
+    0x6038,  // 218           LD V0, 56
+    0x6114,  // 21A           LD V1, 20
+    0xD018,  // 21C           DRW V0, V1, 8
+    0x00FB,  // 21E           SCR
+    0x00C0,  // 220           SCD 0
+    0x00C8,  // 222           SCD 8
+    0x1224,  // 224  end:     JP end
+
+    0xFFC3,  // 226  block:   DB 0xFF, 0xC3
+    0xA599,  // 228           DB 0xA5, 0x99
+    0x99A5,  // 22A           DB 0x99, 0xA5
+    0xC3FF,  // 22C           DB 0xC3, 0xFF
+};
+
+// 00FF, the big font, small sprites across the word boundary and past the right edge, Dxy0, scrolls that push
+// pixels off screen, and Fx75/Fx85
+static const uint16_t hiresWords[] = {
+    0x00FF,  // 200           HIGH
+
+    // the big digits across the top
+    0x6000,  // 202           LD V0, 0
+    0x6100,  // 204           LD V1, 0
+    0x6A00,  // 206           LD VA, 0
+    0xFA30,  // 208  big:     LD HF, VA
+    0xD01A,  // 20A           DRW V0, V1, 10
+    0x7008,  // 20C           ADD V0, 8
+    0x7A01,  // 20E           ADD VA, 1
+    0x3A10,  // 210           SE VA, 16
+    0x1208,  // 212           JP big
+
+    // small ones across the middle of the row, and clipped by the right edge
+    0x610E,  // 214           LD V1, 14
+    0x6A05,  // 216           LD VA, 5
+    0xFA29,  // 218           LD F, VA
+    0x603D,  // 21A           LD V0, 61
+    0xD015,  // 21C           DRW V0, V1, 5
+    0x607D,  // 21E           LD V0, 125
+    0xD015,  // 220           DRW V0, V1, 5
+
+    // 16x16 sprites, one of them clipped by the bottom right corner
+    0xA25A,  // 222           LD I, wide
+    0x6028,  // 224           LD V0, 40
+    0x611C,  // 226           LD V1, 28
+    0xD010,  // 228           DRW V0, V1, 0
+    0x6078,  // 22A           LD V0, 120
+    0x6138,  // 22C           LD V1, 56
+    0xD010,  // 22E           DRW V0, V1, 0
+
+    // down 3 and left 4, then one more row that didn't move
+    0x00C3,  // 230           SCD 3
+    0x00FB,  // 232           SCR
+    0x00FC,  // 234           SCL
+    0x00FC,  // 236           SCL
+    0x6A0E,  // 238           LD VA, 0xE
+    0xFA29,  // 23A           LD F, VA
+    0x6000,  // 23C           LD V0, 0
+    0x613A,  // 23E           LD V1, 58
+    0xD015,  // 240           DRW V0, V1, 5
+
+    // Fx75 and Fx85
+    0x6001,  // 242           LD V0, 1
+    0x6102,  // 244           LD V1, 2
+    0x6203,  // 246           LD V2, 3
+    0x6304,  // 248           LD V3, 4
+    0xF375,  // 24A           LD R, V3
+    0x6300,  // 24C           LD V3, 0
+    0xF385,  // 24E           LD V3, R
+    0xF329,  // 250           LD F, V3
+    0x6050,  // 252           LD V0, 80
+    0x6128,  // 254           LD V1, 40
+    0xD015,  // 256           DRW V0, V1, 5
+    0x1258,  // 258  end:     JP end
+
+    0xFFFF,  // 25A  wide:    DB 0xFF, 0xFF
+    0x8001,  // 25C           DB 0x80, 0x01
+    0xBFFD,  // 25E           DB 0xBF, 0xFD
+    0xA005,  // 260           DB 0xA0, 0x05
+    0xAFF5,  // 262           DB 0xAF, 0xF5
+    0xA815,  // 264           DB 0xA8, 0x15
+    0xABD5,  // 266           DB 0xAB, 0xD5
+    0xAA55,  // 268           DB 0xAA, 0x55
+    0xAA55,  // 26A           DB 0xAA, 0x55
+    0xABD5,  // 26C           DB 0xAB, 0xD5
+    0xA815,  // 26E           DB 0xA8, 0x15
+    0xAFF5,  // 270           DB 0xAF, 0xF5
+    0xA005,  // 272           DB 0xA0, 0x05
+    0xBFFD,  // 274           DB 0xBF, 0xFD
+    0x8001,  // 276           DB 0x80, 0x01
+    0xFFFF,  // 278           DB 0xFF, 0xFF
+};
+
+// both planes and Fn01, 5xy2/5xy3 to and from 0x8000, skips over F000 nnnn, 00Dn on one plane, wrapping, 00FD
+static const uint16_t xochipWords[] = {
+    // both planes: a 1 on plane 1, a 2 on plane 2 over it, then a sprite with data for each
+    0xF301,  // 200           PLANE 3
+    0x00E0,  // 202           CLS
+    0xF101,  // 204           PLANE 1
+    0x6A01,  // 206           LD VA, 1
+    0xFA29,  // 208           LD F, VA
+    0x6000,  // 20A           LD V0, 0
+    0x6100,  // 20C           LD V1, 0
+    0xD015,  // 20E           DRW V0, V1, 5
+    0xF201,  // 210           PLANE 2
+    0x6A02,  // 212           LD VA, 2
+    0xFA29,  // 214           LD F, VA
+    0x6002,  // 216           LD V0, 2
+    0xD015,  // 218           DRW V0, V1, 5
+    0xF301,  // 21A           PLANE 3
+    0xA272,  // 21C           LD I, planes
+    0x600A,  // 21E           LD V0, 10
+    0xD015,  // 220           DRW V0, V1, 5
+
+    // 5xy2 up to 0x8000, 5xy3 back the other way round: 4 1
+    0x6101,  // 222           LD V1, 1
+    0x6202,  // 224           LD V2, 2
+    0x6303,  // 226           LD V3, 3
+    0x6404,  // 228           LD V4, 4
+    0xF000,  // 22A           LDL 0x8000
+    0x8000,
+    0x5142,  // 22E           SAVE V1, V4
+    0x5853,  // 230           LOAD V8, V5
+    0x6C14,  // 232           LD VC, 20
+    0x6D00,  // 234           LD VD, 0
+    0x8A50,  // 236           LD VA, V5
+    0x2262,  // 238           CALL show
+    0x8A80,  // 23A           LD VA, V8
+    0x2262,  // 23C           CALL show
+
+    // a taken skip steps over all of F000 nnnn, one not taken runs it: E, then the 7 at 0x023
+    0x6001,  // 23E           LD V0, 1
+    0x3001,  // 240           SE V0, 1
+    0xF000,  // 242           LDL 0x1234
+    0x1234,
+    0x6A0E,  // 246           LD VA, 0xE
+    0x2262,  // 248           CALL show
+    0x4001,  // 24A           SNE V0, 1
+    0xF000,  // 24C           LDL 0x0023
+    0x0023,
+    0xDCD5,  // 250           DRW VC, VD, 5
+
+    // plane 1 scrolls up, plane 2 stays where it was
+    0xF101,  // 252           PLANE 1
+    0x00D2,  // 254           SCU 2
+    0xF301,  // 256           PLANE 3
+
+    // sprites wrap
+    0xA272,  // 258           LD I, planes
+    0x603C,  // 25A           LD V0, 60
+    0x611D,  // 25C           LD V1, 29
+    0xD015,  // 25E           DRW V0, V1, 5
+    0x00FD,  // 260           EXIT
+
+    // the low digit of VA at (VC, VD), on plane 1
+    0xF101,  // 262  show:    PLANE 1
+    0x690F,  // 264           LD V9, 0x0F
+    0x8A92,  // 266           AND VA, V9
+    0xFA29,  // 268           LD F, VA
+    0xDCD5,  // 26A           DRW VC, VD, 5
+    0x7C05,  // 26C           ADD VC, 5
+    0xF301,  // 26E           PLANE 3
+    0x00EE,  // 270           RET
+
+    0xF090,  // 272  planes:  DB 0xF0, 0x90
+    0xF090,  // 274           DB 0xF0, 0x90
+    0xF0FF,  // 276           DB 0xF0, 0xFF
+    0x00FF,  // 278           DB 0x00, 0xFF
+    0x00FF,  // 27A           DB 0x00, 0xFF
+};
+
+
+// David Winter's Maze, a public domain classic: random diagonals until the screen is full. RND makes the
+// picture depend on the seed
+static const uint16_t mazeWords[] = {
+    0xA21E,  // 200  loop:    LD I, right
+    0xC201,  // 202           RND V2, 1
+    0x3201,  // 204           SE V2, 1
+    0xA21A,  // 206           LD I, left
+    0xD014,  // 208           DRW V0, V1, 4
+    0x7004,  // 20A           ADD V0, 4
+    0x3040,  // 20C           SE V0, 64
+    0x1200,  // 20E           JP loop
+    0x6000,  // 210           LD V0, 0
+    0x7104,  // 212           ADD V1, 4
+    0x3120,  // 214           SE V1, 32
+    0x1200,  // 216           JP loop
+    0x1218,  // 218  end:     JP end
+    0x8040,  // 21A  left:    DB 0x80, 0x40
+    0x2010,  // 21C           DB 0x20, 0x10
+    0x2040,  // 21E  right:   DB 0x20, 0x40
+    0x8010,  // 220           DB 0x80, 0x10
+};
+
+
+// for the benchmarks: ALU work, a call and a draw every time round, and never an idle loop to fast-forward
+static const uint16_t busyWords[] = {
+    0xA232,  // 200           LD I, sprite
+    0x6101,  // 202           LD V1, 1
+    0x6203,  // 204           LD V2, 3
+    0x8124,  // 206  loop:    ADD V1, V2
+    0x8313,  // 208           XOR V3, V1
+    0x8436,  // 20A           SHR V4, V3
+    0x7507,  // 20C           ADD V5, 7
+    0x8655,  // 20E           SUB V6, V5
+    0x8761,  // 210           OR V7, V6
+    0x887E,  // 212           SHL V8, V7
+    0x8912,  // 214           AND V9, V1
+    0x8A47,  // 216           SUBN VA, V4
+    0x3580,  // 218           SE V5, 0x80
+    0x7201,  // 21A           ADD V2, 1
+    0x9320,  // 21C           SNE V3, V2
+    0x6203,  // 21E           LD V2, 3
+    0x2224,  // 220           CALL draw
+    0x1206,  // 222           JP loop
+
+    0x8010,  // 224  draw:    LD V0, V1
+    0x6B3F,  // 226           LD VB, 0x3F
+    0x80B2,  // 228           AND V0, VB
+    0x6B1F,  // 22A           LD VB, 0x1F
+    0x8B22,  // 22C           AND VB, V2
+    0xD0B4,  // 22E           DRW V0, VB, 4
+    0x00EE,  // 230           RET
+
+    0x3C7E,  // 232  sprite:  DB 0x3C, 0x7E
+    0x7E3C,  // 234           DB 0x7E, 0x3C
+};
+
+// for the JIT: a 20 instruction block round the loop, longer than a frame's INSTRUCTIONS_PER_FRAME, so most frames
+// end inside it. A draw every 125 times round
+static const uint16_t longLoopWords[] = {
+    0xA242,  // 200           LD I, sprite
+    0x6101,  // 202           LD V1, 1
+    0x6203,  // 204           LD V2, 3
+    0x8124,  // 206  loop:    ADD V1, V2
+    0x8313,  // 208           XOR V3, V1
+    0x8436,  // 20A           SHR V4, V3
+    0x7507,  // 20C           ADD V5, 7
+    0x8655,  // 20E           SUB V6, V5
+    0x8761,  // 210           OR V7, V6
+    0x887E,  // 212           SHL V8, V7
+    0x8812,  // 214           AND V8, V1
+    0x8347,  // 216           SUBN V3, V4
+    0x8414,  // 218           ADD V4, V1
+    0x8533,  // 21A           XOR V5, V3
+    0x7605,  // 21C           ADD V6, 5
+    0x8761,  // 21E           OR V7, V6
+    0x8856,  // 220           SHR V8, V5
+    0x8685,  // 222           SUB V6, V8
+    0x8172,  // 224           AND V1, V7
+    0x7111,  // 226           ADD V1, 0x11
+    0x8417,  // 228           SUBN V4, V1
+    0x7201,  // 22A           ADD V2, 1
+    0x3280,  // 22C           SE V2, 0x80
+    0x1206,  // 22E           JP loop
+    0x6203,  // 230           LD V2, 3
+    0x8010,  // 232           LD V0, V1
+    0x6F3F,  // 234           LD VF, 0x3F
+    0x80F2,  // 236           AND V0, VF
+    0x8B30,  // 238           LD VB, V3
+    0x6F1F,  // 23A           LD VF, 0x1F
+    0x8BF2,  // 23C           AND VB, VF
+    0xD0B4,  // 23E           DRW V0, VB, 4
+    0x1206,  // 240           JP loop
+
+    0x3C7E,  // 242  sprite:  DB 0x3C, 0x7E
+    0x7E3C,  // 244           DB 0x7E, 0x3C
+};
+
+// a jump past the end of a CHIP-8 profile's 4 KB, which has to wrap to the start of RAM: it writes a jump back
+// to 0x0F0 and gets there through 0xFFF + 0xF1. Draws a 0 if it came back, nothing if it went anywhere else
+static const uint16_t wrapWords[] = {
+    0x6012,  // 200           LD V0, 0x12
+    0x610E,  // 202           LD V1, 0x0E              JP back, as bytes
+    0xA0F0,  // 204           LD I, 0x0F0
+    0xF155,  // 206           LD [I], V1               at 0x0F0, below the rom
+    0x60F1,  // 208           LD V0, 0xF1
+    0xBFFF,  // 20A           JP V0, 0xFFF             0x10F0, which is 0x0F0
+    0x120C,  // 20C  lost:    JP lost
+    0xA000,  // 20E  back:    LD I, 0                  the font's 0
+    0x6A08,  // 210           LD VA, 8
+    0xDAA5,  // 212           DRW VA, VA, 5
+    0x1214,  // 214  done:    JP done
+};
+
+// XO-CHIP's long skip right at the end of the first 4 KB, where the F000 nnnn it steps over is past 0xFFF. Draws
+// V1 as a digit: 0 if the skip went over all 4 bytes, 2 if it landed on nnnn and ran it
+static const uint16_t farSkipWords[] = {
+    0x1FFE,  // 200           JP skip
+    [(0xFFE - PROGRAM_START) / 2] =
+    0x3000,  // FFE  skip:    SE V0, 0
+    0xF000,  // 1000          LD I, 0x6102             skipped, 6102 is LD V1, 2
+    0x6102,  // 1002
+    0xF129,  // 1004          LD F, V1
+    0xD005,  // 1006          DRW V0, V0, 5
+    0x00FD,  // 1008          EXIT
+};
+
+
+#define TEST_ROM(name) const test_rom_t name##Rom = { #name, name##Words, sizeof(name##Words) / sizeof(uint16_t) }
+
+TEST_ROM(flags);
+TEST_ROM(quirks);
+TEST_ROM(font);
+TEST_ROM(maze);
+TEST_ROM(scroll);
+TEST_ROM(hires);
+TEST_ROM(xochip);
+TEST_ROM(busy);
+TEST_ROM(longLoop);
+TEST_ROM(wrap);
+TEST_ROM(farSkip);
+
+const test_rom_t *const testRoms[] = {
+    &flagsRom, &quirksRom, &fontRom, &mazeRom, &scrollRom, &hiresRom, &xochipRom, &busyRom, &longLoopRom, &wrapRom,
+    &farSkipRom, NULL
+};
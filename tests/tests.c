@@ -0,0 +1,34 @@
+#include "tests.h"
+
+int checksFailed = 0;
+
+size_t romImage(const test_rom_t *rom, uint8_t *out) {
+    for (size_t i = 0; i < rom->count; i++) {
+        out[2 * i]     = rom->words[i] >> 8;
+        out[2 * i + 1] = rom->words[i] & 0xFF;
+    }
+    return rom->count * 2;
+}
+
+machine_t *loadTestRom(const test_rom_t *rom, core_t core, quirks_t quirks, int wrapSprites) {
+    if (!coreAvailable(core)) return NULL;
+    machine_t *m = createMachine(core);
+    if (m == NULL || m->core != core) { destroyMachine(m); return NULL; } // the JIT couldn't map its memory
+    setQuirks(m, quirks, wrapSprites);
+    static uint8_t image[RAM_SIZE];
+    loadRomImage(m, image, romImage(rom, image));
+    return m;
+}
+
+void printScreen(const frame_buffer_t *f) {
+    int width = f->hires ? HIRES_WIDTH : SCREEN_WIDTH, height = f->hires ? HIRES_HEIGHT : SCREEN_HEIGHT;
+    for (int y = 0; y < height; y++) {
+        printf("    |");
+        for (int x = 0; x < width; x++) {
+            int shift = 63 - (x & 63);
+            int pixel = (f->rows[0][y][x >> 6] >> shift & 1) | (f->rows[1][y][x >> 6] >> shift & 1) << 1;
+            putchar(" #o@"[pixel]);
+        }
+        printf("|\n");
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include "chip8.h"
+
+// ##########  TEST HELPERS  ##########
+// shared by the test programs. No framework: a failed CHECK prints where it was and the test carries on, main()
+// returns non-zero if anything failed, which is all ctest looks at
+
+extern int checksFailed;
+
+#define CHECK(condition, ...) do {                                  \
+        if (!(condition)) {                                         \
+            checksFailed++;                                         \
+            printf("%s:%d: failed: ", __FILE__, __LINE__);          \
+            printf(__VA_ARGS__);                                    \
+            printf("\n");                                           \
+        }                                                           \
+    } while (0)
+
+// a rom built into the tests, as big-endian words from 0x200 (see roms.c)
+typedef struct {
+    const char     *name;
+    const uint16_t *words;
+    size_t          count;
+} test_rom_t;
+
+extern const test_rom_t flagsRom, quirksRom, fontRom, mazeRom, scrollRom, hiresRom, xochipRom, busyRom,
+                        longLoopRom, wrapRom, farSkipRom;
+extern const test_rom_t *const testRoms[]; // all of them, NULL at the end
+
+// the rom as a .ch8 file would have it. Returns its size, out has room for RAM_SIZE bytes
+size_t romImage(const test_rom_t *rom, uint8_t *out);
+
+// a machine in its power-on state with the rom loaded, NULL if the core isn't available
+machine_t *loadTestRom(const test_rom_t *rom, core_t core, quirks_t quirks, int wrapSprites);
+
+// draws the screen with # and spaces (and o/@ for plane 2), for when a hash doesn't match
+void printScreen(const frame_buffer_t *f);
+
+#endif